@@ -11,10 +11,19 @@
 //  Change Log:
 //
 //  10/11/13    Added the timer comparison function definition (PDM)
+//  10/19/26    Inline 64-bit byte order conversion, SIMD array versions (XZ)
+//  10/19/26    Seedable xoshiro256** generator behind getRandomValue (XZ)
+//  10/19/26    CRC32C checksums, SSE4.2 with a table fallback (XZ)
 
 // System include files
 #include <stdint.h>
+#include <string.h>
+#include <sys/time.h>
 #include <gcrypt.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CMPSC311_X86_SIMD 1
+#endif
 
 // Project Include Files
 #include <cmpsc311_util.h>
@@ -23,25 +32,46 @@
 //
 // Defines
 
-#define CMPSC_BSWAP64(val) \
-	(((val & 0x00000000000000ff) << 56) | \
-	 ((val & 0x000000000000ff00) << 40) | \
-	 ((val & 0x0000000000ff0000) << 24) | \
-	 ((val & 0x00000000ff000000) << 8) | \
-	 ((val & 0x000000ff00000000) >> 8) | \
-	 ((val & 0x0000ff0000000000) >> 24) | \
-	 ((val & 0x00ff000000000000) >> 40) | \
-	 ((val & 0xff00000000000000) >> 56))
+#define CMPSC_B64_BENCH_COUNT 4096
+#define CMPSC_B64_BENCH_ROUNDS 1024
+#define CMPSC_CRC32C_POLY 0x82f63b78      // reflected Castagnoli polynomial
+#define CMPSC_CRC32C_CHECK 0xe3069283     // CRC32C of "123456789"
+#define CMPSC_CRC32C_BENCH_SIZE (1 << 20)
+#define CMPSC_CRC32C_BENCH_ROUNDS 64
 
 //
 // Global data
 
 int gcrypt_initialized = 0;  // Flag indicating the library needs to be initialized
 gcry_md_hd_t *hfunc = NULL;  // A pointer to the gcrypt hash structure
+int random_seeded = 0;       // Flag indicating the generator has been seeded
+uint64_t random_seed = 0;    // The seed the generator was started from
+uint64_t random_state[4];    // The xoshiro256** state
 
 //
 // Local functions
 int init_gcrypt(void); // initialize the GCRYPT library
+uint64_t splitmix64(uint64_t *state); // expand the seed into the generator state
+void bswap64_array_scalar(uint64_t *dst, const uint64_t *src, size_t count);
+void bswap64_array_dispatch(uint64_t *dst, const uint64_t *src, size_t count);
+#ifdef CMPSC311_X86_SIMD
+void bswap64_array_ssse3(uint64_t *dst, const uint64_t *src, size_t count);
+void bswap64_array_avx2(uint64_t *dst, const uint64_t *src, size_t count);
+#endif
+
+uint32_t crc32c_table(uint32_t crc, const unsigned char *buf, size_t len);
+uint32_t crc32c_dispatch(uint32_t crc, const unsigned char *buf, size_t len);
+#ifdef CMPSC311_X86_SIMD
+uint32_t crc32c_sse42(uint32_t crc, const unsigned char *buf, size_t len);
+#endif
+
+// The array swap to use, picked from what the CPU supports on first use
+void (*bswap64_array)(uint64_t *, const uint64_t *, size_t) = bswap64_array_dispatch;
+
+// Same for the CRC32C inner loop, the table is built on first use
+uint32_t (*crc32c_update)(uint32_t, const unsigned char *, size_t) = crc32c_dispatch;
+uint32_t crc32c_lookup[8][256];
+int crc32c_table_ready = 0;
 
 //
 // Functions
@@ -119,10 +149,53 @@ int bufToString( unsigned char *buf, uint32_t blen, unsigned char *str, uint32_t
 	return( 0 );
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : setRandomSeed
+// Description  : Seed the generator behind getRandomValue, the same seed
+//                gives the same sequence of values
+//
+// Inputs       : seed - the seed
+// Outputs      : none
+
+void setRandomSeed( uint64_t seed ) {
+
+	uint64_t sm = seed;
+	int i;
+
+	for (i=0; i<4; i++) {
+		random_state[i] = splitmix64( &sm );
+	}
+	random_seed = seed;
+	random_seeded = 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : getRandomSeed
+// Description  : Get the seed of the generator (seeding it from gcrypt if
+//                nothing has yet), so a run can be repeated
+//
+// Inputs       : none
+// Outputs      : the seed
+
+uint64_t getRandomSeed( void ) {
+
+	uint64_t seed;
+
+	if ( ! random_seeded ) {
+		init_gcrypt();
+		gcry_randomize( &seed, sizeof(seed), GCRY_WEAK_RANDOM );
+		setRandomSeed( seed );
+	}
+	return( random_seed );
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // Function     : getRandomValue
-// Description  : Using strong randomness, generate random number
+// Description  : Generate random number (xoshiro256**, not for cryptographic
+//                use; seeded from gcrypt unless setRandomSeed was called)
 //
 // Inputs       : min - the minimum number
 //                max - the maximum number
@@ -133,12 +206,24 @@ uint32_t getRandomValue( uint32_t min, uint32_t max ) {
 	// Local variables
 	uint32_t val;
     uint32_t range_length = max-min+1;
-	init_gcrypt();
-#if 0
-	gcry_randomize( &val, sizeof(val), GCRY_STRONG_RANDOM );
-#else
-	gcry_randomize( &val, sizeof(val), GCRY_WEAK_RANDOM );
-#endif
+	uint64_t *s = random_state, result, t;
+
+	if ( ! random_seeded ) {
+		getRandomSeed();
+	}
+
+	// Next xoshiro256** output, the high bits are the best ones
+	result = s[1] * 5;
+	result = ((result << 7) | (result >> 57)) * 9;
+	t = s[1] << 17;
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = (s[3] << 45) | (s[3] >> 19);
+	val = (uint32_t)(result >> 32);
+
 	// Adjust to range
     // range_length==0 when min=0 & max=UINT32_MAX due to integer overflow
 	if ( range_length != 0 ) {
@@ -172,48 +257,57 @@ long compareTimes( struct timeval * tm1, struct timeval * tm2 ) {
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : htonll64
-// Description  : 64-bit host to network long
+// Function     : htonll64_array
+// Description  : 64-bit host to network long, for a whole array
 //
-// Inputs       : val - the value to put into host byte order
-// Outputs      : the byte converted value
+// Inputs       : dst - the place to put the converted values (may be src)
+//                src - the values to convert
+//                count - the number of values
+// Outputs      : none
 
-uint64_t htonll64(uint64_t val) {
+void htonll64_array(uint64_t *dst, const uint64_t *src, size_t count) {
 
-	// Setup some local variables
-	uint32_t end = 1;
-	char *ptr =  (char *)&end;
-
-	// Lets check the endianess of the machine, swap if little endian
-	if ( *ptr == 0x1 ) {
-		return( CMPSC_BSWAP64(val) );
+	// Big endian is already in network order
+	if ( CMPSC311_BIG_ENDIAN ) {
+		if ( dst != src ) {
+			memmove( dst, src, count * sizeof(uint64_t) );
+		}
+		return;
 	}
-
-	// Big endian, just return that
-    return(val);
+	bswap64_array( dst, src, count );
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : htonll64
-// Description  : 64-bit network to host long
+// Function     : ntohll64_array
+// Description  : 64-bit network to host long, for a whole array
 //
-// Inputs       : val - the value to put into network byte order
-// Outputs      : the byte converted value
+// Inputs       : dst - the place to put the converted values (may be src)
+//                src - the values to convert
+//                count - the number of values
+// Outputs      : none
 
-uint64_t ntohll64(uint64_t val) {
+void ntohll64_array(uint64_t *dst, const uint64_t *src, size_t count) {
 
-	// Setup some local variables
-	uint32_t end = 1;
-	char *ptr = (char *)&end;
+	// The swap is the same both ways
+	htonll64_array( dst, src, count );
+}
 
-	// Lets check the endianess of the machine, swap if little endian
-	if ( *ptr == 0x1 ) {
-		return( CMPSC_BSWAP64(val) );
-	}
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crc32c
+// Description  : CRC32C (Castagnoli) checksum of a buffer, using the SSE4.2
+//                crc32 instruction when the CPU has it.  Passing the result
+//                for one buffer as crc continues it over the next, so
+//                crc32c(crc32c(0, a, n), b, m) is the checksum of a then b.
+//
+// Inputs       : crc - the checksum so far (0 to start)
+//                buf - the bytes
+//                len - the number of bytes
+// Outputs      : the checksum
 
-	// Big endian, just return that
-    return(val);
+uint32_t crc32c( uint32_t crc, const void *buf, size_t len ) {
+	return( ~crc32c_update(~crc, (const unsigned char *)buf, len) );
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -227,8 +321,12 @@ uint64_t ntohll64(uint64_t val) {
 int b64UnitTest( void ) {
 
 	// Local variables
-	int i;
-	uint64_t val, oval;
+	int i, round;
+	uint64_t val, oval, *in, *out;
+	volatile uint64_t sink = 0;
+	unsigned char *bytes;
+	struct timeval start, stop;
+	long times[2];
 
 	// Repeat for a good while
 	for (i=0; i<1000; i++) {
@@ -244,14 +342,352 @@ int b64UnitTest( void ) {
 		}
 	}
 
+	// Network order has the most significant byte first in memory
+	val = htonll64( 0x0102030405060708ull );
+	bytes = (unsigned char *)&val;
+	if ( (bytes[0] != 0x01) || (bytes[7] != 0x08) ) {
+		logMessage(LOG_ERROR_LEVEL, "b64 conversion unit test failed, not network order [%lx]", val);
+		return(-1);
+	}
+
+	// The array conversion has to match one at a time, for every length and
+	// an unaligned start (covers the SIMD tails)
+	in = malloc( (CMPSC_B64_BENCH_COUNT + 1) * sizeof(uint64_t) );
+	out = malloc( (CMPSC_B64_BENCH_COUNT + 1) * sizeof(uint64_t) );
+	for (i=0; i<=CMPSC_B64_BENCH_COUNT; i++) {
+		in[i] = ((uint64_t)getRandomValue(0,-1) << 32) | getRandomValue(0,-1);
+	}
+	for (round=0; round<=40; round++) {
+		memset( out, 0, (CMPSC_B64_BENCH_COUNT + 1) * sizeof(uint64_t) );
+		htonll64_array( &out[round & 1], &in[round & 1], round );
+		for (i=0; i<round; i++) {
+			if ( out[(round & 1) + i] != htonll64(in[(round & 1) + i]) ) {
+				logMessage(LOG_ERROR_LEVEL, "b64 array conversion unit test failed, [%d of %d]", i, round);
+				return(-1);
+			}
+		}
+		if ( out[(round & 1) + round] != 0 ) {
+			logMessage(LOG_ERROR_LEVEL, "b64 array conversion wrote past the end [%d]", round);
+			return(-1);
+		}
+	}
+
+	// Time one at a time against the array version
+	gettimeofday( &start, NULL );
+	for (round=0; round<CMPSC_B64_BENCH_ROUNDS; round++) {
+		for (i=0; i<CMPSC_B64_BENCH_COUNT; i++) {
+			out[i] = htonll64( in[i] );
+		}
+		sink += out[round % CMPSC_B64_BENCH_COUNT];
+	}
+	gettimeofday( &stop, NULL );
+	times[0] = compareTimes( &start, &stop );
+	gettimeofday( &start, NULL );
+	for (round=0; round<CMPSC_B64_BENCH_ROUNDS; round++) {
+		htonll64_array( out, in, CMPSC_B64_BENCH_COUNT );
+		sink += out[round % CMPSC_B64_BENCH_COUNT];
+	}
+	gettimeofday( &stop, NULL );
+	times[1] = compareTimes( &start, &stop );
+	logMessage(LOG_INFO_LEVEL, "b64 conversion: %d values in usec, single %ld, array %ld [%lx]",
+		CMPSC_B64_BENCH_COUNT * CMPSC_B64_BENCH_ROUNDS, times[0], times[1], sink);
+	free( in );
+	free( out );
+
 	// Log success and return
 	logMessage(LOG_ERROR_LEVEL, "b64 conversion unit test successful.");
 	return(0);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crc32cUnitTest
+// Description  : CRC32C checksum unit test, checks the standard check value,
+//                that checksums continue, that the table and the hardware
+//                versions agree, then times them
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int crc32cUnitTest( void ) {
+
+	// Local variables
+	unsigned char *buf;
+	uint32_t crc, part, table;
+	struct timeval start, stop;
+	long times[2] = { 0, 0 };
+	size_t i, len, split;
+	int round;
+
+	// The check value everyone publishes
+	if ( (crc = crc32c(0, "123456789", 9)) != CMPSC_CRC32C_CHECK ) {
+		logMessage(LOG_ERROR_LEVEL, "crc32c unit test failed, check value [%x != %x]", crc, CMPSC_CRC32C_CHECK);
+		return(-1);
+	}
+
+	// Random buffers, random lengths and split points, odd alignments
+	buf = malloc( CMPSC_CRC32C_BENCH_SIZE );
+	for (i=0; i<CMPSC_CRC32C_BENCH_SIZE; i++) {
+		buf[i] = getRandomValue(0, 0xff);
+	}
+	for (round=0; round<1000; round++) {
+		len = getRandomValue(0, 4096);
+		split = getRandomValue(0, len);
+		i = getRandomValue(0, 7);
+		crc = crc32c( 0, &buf[i], len );
+		part = crc32c( crc32c(0, &buf[i], split), &buf[i+split], len-split );
+		table = ~crc32c_table( ~0u, &buf[i], len );
+		if ( (crc != part) || (crc != table) ) {
+			logMessage(LOG_ERROR_LEVEL, "crc32c unit test failed, [%x, %x, %x] len %lu split %lu", crc, part, table, len, split);
+			return(-1);
+		}
+	}
+
+	// Time the table against whatever crc32c picked
+	gettimeofday( &start, NULL );
+	for (round=0; round<CMPSC_CRC32C_BENCH_ROUNDS; round++) {
+		crc = crc32c_table( crc, buf, CMPSC_CRC32C_BENCH_SIZE );
+	}
+	gettimeofday( &stop, NULL );
+	times[0] = compareTimes( &start, &stop );
+	gettimeofday( &start, NULL );
+	for (round=0; round<CMPSC_CRC32C_BENCH_ROUNDS; round++) {
+		crc = crc32c( crc, buf, CMPSC_CRC32C_BENCH_SIZE );
+	}
+	gettimeofday( &stop, NULL );
+	times[1] = compareTimes( &start, &stop );
+	logMessage(LOG_INFO_LEVEL, "crc32c: %d MB in usec, table %ld, crc32c %ld [%x]",
+		CMPSC_CRC32C_BENCH_SIZE * CMPSC_CRC32C_BENCH_ROUNDS >> 20, times[0], times[1], crc);
+	free( buf );
+
+	// Log success and return
+	logMessage(LOG_INFO_LEVEL, "crc32c unit test successful.");
+	return(0);
+}
+
 //
 // Local Functions
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crc32c_table
+// Description  : CRC32C inner loop without hardware help (slice-by-8 tables),
+//                works on the inverted checksum
+//
+// Inputs       : crc - the inverted checksum so far
+//                buf - the bytes
+//                len - the number of bytes
+// Outputs      : the inverted checksum
+
+uint32_t crc32c_table( uint32_t crc, const unsigned char *buf, size_t len ) {
+
+	uint32_t c, i, k;
+	uint64_t word;
+
+	// Build the tables the first time through
+	if ( ! crc32c_table_ready ) {
+		for (i=0; i<256; i++) {
+			c = i;
+			for (k=0; k<8; k++) {
+				c = (c & 1) ? (c >> 1) ^ CMPSC_CRC32C_POLY : c >> 1;
+			}
+			crc32c_lookup[0][i] = c;
+		}
+		for (i=0; i<256; i++) {
+			for (k=1; k<8; k++) {
+				c = crc32c_lookup[k-1][i];
+				crc32c_lookup[k][i] = (c >> 8) ^ crc32c_lookup[0][c & 0xff];
+			}
+		}
+		crc32c_table_ready = 1;
+	}
+
+	// Eight bytes at a time (the tables are for little endian words), then the rest
+	while ( !CMPSC311_BIG_ENDIAN && (len >= 8) ) {
+		memcpy( &word, buf, sizeof(word) );
+		word ^= crc;
+		crc = crc32c_lookup[7][word & 0xff] ^ crc32c_lookup[6][(word >> 8) & 0xff] ^
+		      crc32c_lookup[5][(word >> 16) & 0xff] ^ crc32c_lookup[4][(word >> 24) & 0xff] ^
+		      crc32c_lookup[3][(word >> 32) & 0xff] ^ crc32c_lookup[2][(word >> 40) & 0xff] ^
+		      crc32c_lookup[1][(word >> 48) & 0xff] ^ crc32c_lookup[0][word >> 56];
+		buf += 8;
+		len -= 8;
+	}
+	while ( len-- ) {
+		crc = (crc >> 8) ^ crc32c_lookup[0][(crc ^ *buf++) & 0xff];
+	}
+	return( crc );
+}
+
+#ifdef CMPSC311_X86_SIMD
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crc32c_sse42
+// Description  : CRC32C inner loop using the SSE4.2 crc32 instruction, works
+//                on the inverted checksum
+//
+// Inputs       : crc - the inverted checksum so far
+//                buf - the bytes
+//                len - the number of bytes
+// Outputs      : the inverted checksum
+
+__attribute__((target("sse4.2")))
+uint32_t crc32c_sse42( uint32_t crc, const unsigned char *buf, size_t len ) {
+
+#ifdef __x86_64__
+	uint64_t word, c = crc;
+
+	while ( len >= 8 ) {
+		memcpy( &word, buf, sizeof(word) );
+		c = _mm_crc32_u64( c, word );
+		buf += 8;
+		len -= 8;
+	}
+	crc = (uint32_t)c;
+#endif
+	while ( len-- ) {
+		crc = _mm_crc32_u8( crc, *buf++ );
+	}
+	return( crc );
+}
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crc32c_dispatch
+// Description  : Pick the CRC32C inner loop for this CPU, then run it
+//
+// Inputs       : crc - the inverted checksum so far
+//                buf - the bytes
+//                len - the number of bytes
+// Outputs      : the inverted checksum
+
+uint32_t crc32c_dispatch( uint32_t crc, const unsigned char *buf, size_t len ) {
+
+	crc32c_update = crc32c_table;
+#ifdef CMPSC311_X86_SIMD
+	__builtin_cpu_init();
+	if ( __builtin_cpu_supports("sse4.2") ) {
+		crc32c_update = crc32c_sse42;
+	}
+#endif
+	return( crc32c_update(crc, buf, len) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : splitmix64
+// Description  : Step the splitmix64 generator, used to spread a seed over
+//                the xoshiro256** state
+//
+// Inputs       : state - the splitmix64 state
+// Outputs      : the next value
+
+uint64_t splitmix64( uint64_t *state ) {
+
+	uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return( z ^ (z >> 31) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bswap64_array_scalar
+// Description  : Byte swap an array of 64-bit values, one at a time
+//
+// Inputs       : dst - the place to put the swapped values (may be src)
+//                src - the values to swap
+//                count - the number of values
+// Outputs      : none
+
+void bswap64_array_scalar(uint64_t *dst, const uint64_t *src, size_t count) {
+
+	size_t i;
+	for (i=0; i<count; i++) {
+		dst[i] = CMPSC_BSWAP64( src[i] );
+	}
+}
+
+#ifdef CMPSC311_X86_SIMD
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bswap64_array_ssse3
+// Description  : Byte swap an array of 64-bit values, two at a time (pshufb)
+//
+// Inputs       : dst - the place to put the swapped values (may be src)
+//                src - the values to swap
+//                count - the number of values
+// Outputs      : none
+
+__attribute__((target("ssse3")))
+void bswap64_array_ssse3(uint64_t *dst, const uint64_t *src, size_t count) {
+
+	const __m128i mask = _mm_set_epi8( 8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7 );
+	__m128i v;
+	size_t i;
+
+	for (i=0; i+2<=count; i+=2) {
+		v = _mm_loadu_si128( (const __m128i *)&src[i] );
+		_mm_storeu_si128( (__m128i *)&dst[i], _mm_shuffle_epi8(v, mask) );
+	}
+	bswap64_array_scalar( &dst[i], &src[i], count-i );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bswap64_array_avx2
+// Description  : Byte swap an array of 64-bit values, four at a time (vpshufb)
+//
+// Inputs       : dst - the place to put the swapped values (may be src)
+//                src - the values to swap
+//                count - the number of values
+// Outputs      : none
+
+__attribute__((target("avx2")))
+void bswap64_array_avx2(uint64_t *dst, const uint64_t *src, size_t count) {
+
+	const __m256i mask = _mm256_set_epi8( 8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7,
+	                                      8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7 );
+	__m256i v;
+	size_t i;
+
+	for (i=0; i+4<=count; i+=4) {
+		v = _mm256_loadu_si256( (const __m256i *)&src[i] );
+		_mm256_storeu_si256( (__m256i *)&dst[i], _mm256_shuffle_epi8(v, mask) );
+	}
+	bswap64_array_scalar( &dst[i], &src[i], count-i );
+}
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bswap64_array_dispatch
+// Description  : Pick the best array swap for this CPU, then do the swap
+//
+// Inputs       : dst - the place to put the swapped values (may be src)
+//                src - the values to swap
+//                count - the number of values
+// Outputs      : none
+
+void bswap64_array_dispatch(uint64_t *dst, const uint64_t *src, size_t count) {
+
+	bswap64_array = bswap64_array_scalar;
+#ifdef CMPSC311_X86_SIMD
+	__builtin_cpu_init();
+	if ( __builtin_cpu_supports("avx2") ) {
+		bswap64_array = bswap64_array_avx2;
+	} else if ( __builtin_cpu_supports("ssse3") ) {
+		bswap64_array = bswap64_array_ssse3;
+	}
+#endif
+	bswap64_array( dst, src, count );
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // Function     : init_gcrypt
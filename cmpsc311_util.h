@@ -13,9 +13,13 @@
 //  Change Log:
 //
 //  10/11/13	Added the timer comparison function definition (PDM)
+//  10/19/26	Inline 64-bit byte order conversion, array versions (XZ)
+//  10/19/26	Seedable random values (XZ)
+//  10/19/26	CRC32C checksums (XZ)
 //
 
 // Includes
+#include <stddef.h>
 #include <stdint.h>
 #include <gcrypt.h>
 
@@ -23,6 +27,27 @@
 #define CMPSC311_HASH_TYPE GCRY_MD_SHA1
 #define CMPSC311_HASH_LENGTH (gcry_md_get_algo_dlen(CMPSC311_HASH_TYPE))
 
+// Byte order of the machine, known at compile time
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define CMPSC311_BIG_ENDIAN 1
+#else
+#define CMPSC311_BIG_ENDIAN 0
+#endif
+
+#ifdef __GNUC__
+#define CMPSC_BSWAP64(val) __builtin_bswap64(val)
+#else
+#define CMPSC_BSWAP64(val) \
+	((((val) & 0x00000000000000ffull) << 56) | \
+	 (((val) & 0x000000000000ff00ull) << 40) | \
+	 (((val) & 0x0000000000ff0000ull) << 24) | \
+	 (((val) & 0x00000000ff000000ull) << 8) | \
+	 (((val) & 0x000000ff00000000ull) >> 8) | \
+	 (((val) & 0x0000ff0000000000ull) >> 24) | \
+	 (((val) & 0x00ff000000000000ull) >> 40) | \
+	 (((val) & 0xff00000000000000ull) >> 56))
+#endif
+
 // Functional prototypes
 
 int generate_md5_signature( unsigned char *buf, uint32_t size,
@@ -34,17 +59,39 @@ int bufToString( unsigned char *buf, uint32_t blen,
     // Convert the buffer into a readable hex string
 
 uint32_t getRandomValue( uint32_t min, uint32_t max );
-    // Using strong randomness, generate random number
+    // Generate a random number (fast, repeatable from the seed, not for crypto)
+
+void setRandomSeed( uint64_t seed );
+    // Seed the random number generator
+
+uint64_t getRandomSeed( void );
+    // Get the random number seed (picks one if none was set)
 
 long compareTimes(struct timeval * tm1, struct timeval * tm2);
     // Compare two timer values 
 
-uint64_t htonll64(uint64_t val);
+static inline uint64_t htonll64(uint64_t val) {
+	return( CMPSC311_BIG_ENDIAN ? val : CMPSC_BSWAP64(val) );
+}
 	// Create a 64-byte host-to-network conversion
 
-uint64_t ntohll64(uint64_t val);
+static inline uint64_t ntohll64(uint64_t val) {
+	return( CMPSC311_BIG_ENDIAN ? val : CMPSC_BSWAP64(val) );
+}
 	// Create a 64-byte network-to-host conversion
 
+void htonll64_array(uint64_t *dst, const uint64_t *src, size_t count);
+	// Convert an array of 64-bit values to network order (dst may be src)
+
+void ntohll64_array(uint64_t *dst, const uint64_t *src, size_t count);
+	// Convert an array of 64-bit values to host order (dst may be src)
+
+uint32_t crc32c( uint32_t crc, const void *buf, size_t len );
+	// CRC32C (Castagnoli) of a buffer, pass the last result to continue it (0 to start)
+
 int b64UnitTest( void );
 	// 64-bit conversion unit test
+
+int crc32cUnitTest( void );
+	// CRC32C checksum unit test
 #endif
@@ -0,0 +1,811 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File          : crud_bench.c
+//  Description   : This is the microbenchmark program for the driver
+//                  primitives: the request codec, byte swapping, file table
+//                  lookups, crud_read/crud_write against an in-process store
+//                  (crud_driver.c, no sockets), logging and workload parsing.
+//                  Each benchmark runs long enough to time reliably, and the
+//                  results can be written as JSON in the Google Benchmark
+//                  layout, so two commits can be diffed with its compare.py
+//                  (or any JSON tool):
+//
+//                    ./crud_bench -o before.json
+//                    ./crud_bench -o after.json
+//                    compare.py benchmarks before.json after.json
+//
+//  Author        : Xuejian Zhou
+//  Last Modified : Mon Oct 19 2026
+//
+
+// Include Files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+// Project Includes
+#include <crud_driver.h>
+#include <crud_network.h>
+#include <crud_request.h>
+#include <crud_file_io.h>
+#include <cmpsc311_log.h>
+#include <cmpsc311_util.h>
+
+// Defines
+#define CRUD_BENCH_ARGUMENTS "hlf:t:o:w:c:"
+#define CRUD_BENCH_MIN_TIME 0.2       // Seconds each benchmark runs for
+#define CRUD_BENCH_MAX_ITERATIONS 1000000000ULL
+#define CRUD_BENCH_WORDS 1024         // Requests/words per codec iteration
+#define CRUD_BENCH_FILES 1000         // Files in the table for the lookups
+#define CRUD_BENCH_MAX_LINES 4096     // Workload lines kept for parsing
+#define USAGE \
+	"USAGE: crud_bench [-h] [-l] [-f <filter>] [-t <sec>] [-o <json-file>] [-w <workload-file>] [-c <label>]\n" \
+	"\n" \
+	"where:\n" \
+	"    -h - help mode (display this message)\n" \
+	"    -l - list the benchmarks and exit\n" \
+	"    -f - only run the benchmarks whose name contains <filter>\n" \
+	"    -t - run each benchmark for at least <sec> seconds (default 0.2)\n" \
+	"    -o - write the results to <json-file> (Google Benchmark layout)\n" \
+	"    -w - workload file for the parsing benchmark (default workload-one.txt)\n" \
+	"    -c - label stored with the results (e.g. the commit)\n" \
+	"\n" \
+
+// A benchmark: runs its body so many times, returns the bytes it processed
+typedef uint64_t (*CrudBenchFunc)(uint64_t iterations, uint32_t arg);
+
+typedef struct {
+	const char    *name;  // The name (arg is appended when not 0)
+	CrudBenchFunc  func;  // The body
+	uint32_t       arg;   // Its argument (size, count ...)
+} CrudBenchmark;
+
+// The result of one benchmark
+typedef struct {
+	char      name[64];    // The name with its argument
+	uint64_t  iterations;  // Times the body ran
+	double    real_ns;     // Wall time per iteration
+	double    cpu_ns;      // CPU time per iteration
+	double    bytes;       // Bytes per second (0 if not relevant)
+} CrudBenchResult;
+
+//
+// Global Data
+int            crud_network_shutdown = 0;     // Flag indicating shutdown (unused)
+unsigned char *crud_network_address = NULL;   // Address of CRUD server (unused)
+unsigned short crud_network_port = 0;         // Port of CRUD server (unused)
+uint8_t        crud_network_capabilities = 0; // Flags from the INIT response
+uint32_t       crud_network_features = 0;     // Length from the INIT response
+
+volatile uint64_t bench_sink;              // Keeps results from being optimized away
+CrudRequest bench_requests[CRUD_BENCH_WORDS];
+CrudRequestFields bench_fields[CRUD_BENCH_WORDS];
+uint64_t bench_words[CRUD_BENCH_WORDS];
+char *bench_names[CRUD_BENCH_FILES];
+char *bench_lines[CRUD_BENCH_MAX_LINES];
+uint32_t bench_nlines = 0;
+char *bench_buffer = NULL;
+int bench_null_log = -1;
+
+//
+// Functional Prototypes
+
+int bench_setup(char *workload);
+void bench_teardown(void);
+int bench_run(CrudBenchmark *bench, double min_time, CrudBenchResult *result);
+int bench_write_json(char *path, char *label, CrudBenchResult *results, int count);
+double bench_clock(clockid_t clock);
+
+//
+// In-process bus (what crud_client.c does over the socket)
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_client_operation
+// Description  : Run a request straight against the local store, answering
+//                INIT the way crud_server does
+//
+// Inputs       : op - the request
+//                buf - the object for CREATE/UPDATE, the place for READ data
+// Outputs      : the response
+
+CrudResponse crud_client_operation(CrudRequest op, void *buf) {
+
+	CrudResponse response = crud_bus_request(op, buf);
+
+	if (crud_request_type(op) == CRUD_INIT) {
+		crud_network_capabilities = CRUD_RANGE_FLAG;
+		crud_network_features = CRUD_FEATURE_CLONE;
+	}
+	return (response);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_client_read_range
+// Description  : Read part of an object from the local store
+//
+// Inputs       : op - the READ request, length is the bytes wanted
+//                offset - the byte offset into the object
+//                buf - the place for the data
+// Outputs      : the response
+
+CrudResponse crud_client_read_range(CrudRequest op, uint32_t offset, void *buf) {
+	return (crud_bus_request_range(op, offset, buf));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_client_batch
+// Description  : Run a batch of writes against the local store
+//
+// Inputs       : ops - the requests
+//                bufs - the object for each CREATE/UPDATE
+//                responses - the place to put the responses
+//                count - the number of requests
+// Outputs      : 0
+
+int crud_client_batch(CrudRequest *ops, void **bufs, CrudResponse *responses, int count) {
+
+	int i;
+
+	for (i = 0; i < count; i++) {
+		responses[i] = crud_bus_request(ops[i], bufs[i]);
+	}
+	return (0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_client_session
+// Description  : The in-process bus never loses its session
+//
+// Inputs       : none
+// Outputs      : 1
+
+int crud_client_session(void) {
+	return (1);
+}
+
+//
+// Benchmarks
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_request_encode
+// Description  : Encode a block of requests one at a time
+//
+// Inputs       : iterations - the number of blocks
+//                arg - unused
+// Outputs      : the bytes encoded
+
+uint64_t bench_request_encode(uint64_t iterations, uint32_t arg) {
+
+	uint64_t i, sum = 0;
+	uint32_t j;
+
+	for (i = 0; i < iterations; i++) {
+		for (j = 0; j < CRUD_BENCH_WORDS; j++) {
+			sum += crud_request_encode(bench_fields[j].oid, bench_fields[j].req, bench_fields[j].length,
+					bench_fields[j].flags, bench_fields[j].res);
+		}
+	}
+	bench_sink = sum;
+	return (iterations * CRUD_BENCH_WORDS * sizeof(CrudRequest));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_request_decode
+// Description  : Decode a block of requests one at a time
+//
+// Inputs       : iterations - the number of blocks
+//                arg - unused
+// Outputs      : the bytes decoded
+
+uint64_t bench_request_decode(uint64_t iterations, uint32_t arg) {
+
+	uint64_t i, sum = 0;
+	uint32_t j, length;
+	CrudOID oid;
+	CRUD_REQUEST_TYPES req;
+	uint8_t flags, res;
+
+	for (i = 0; i < iterations; i++) {
+		for (j = 0; j < CRUD_BENCH_WORDS; j++) {
+			deconstruct_crud_request(bench_requests[j], &oid, &req, &length, &flags, &res);
+			sum += oid + req + length + flags + res;
+		}
+	}
+	bench_sink = sum;
+	return (iterations * CRUD_BENCH_WORDS * sizeof(CrudRequest));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_request_encode_batch
+// Description  : Encode a block of requests with the batch codec
+//
+// Inputs       : iterations - the number of blocks
+//                arg - unused
+// Outputs      : the bytes encoded
+
+uint64_t bench_request_encode_batch(uint64_t iterations, uint32_t arg) {
+
+	uint64_t i;
+
+	for (i = 0; i < iterations; i++) {
+		crud_request_encode_batch(bench_fields, bench_requests, CRUD_BENCH_WORDS);
+		bench_sink = bench_requests[i % CRUD_BENCH_WORDS];
+	}
+	return (iterations * CRUD_BENCH_WORDS * sizeof(CrudRequest));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_request_decode_batch
+// Description  : Decode a block of requests with the batch codec
+//
+// Inputs       : iterations - the number of blocks
+//                arg - unused
+// Outputs      : the bytes decoded
+
+uint64_t bench_request_decode_batch(uint64_t iterations, uint32_t arg) {
+
+	uint64_t i;
+
+	for (i = 0; i < iterations; i++) {
+		crud_request_decode_batch(bench_requests, bench_fields, CRUD_BENCH_WORDS);
+		bench_sink = bench_fields[i % CRUD_BENCH_WORDS].length;
+	}
+	return (iterations * CRUD_BENCH_WORDS * sizeof(CrudRequest));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_htonll64
+// Description  : Swap a block of words one at a time
+//
+// Inputs       : iterations - the number of blocks
+//                arg - unused
+// Outputs      : the bytes swapped
+
+uint64_t bench_htonll64(uint64_t iterations, uint32_t arg) {
+
+	uint64_t i, sum = 0;
+	uint32_t j;
+
+	for (i = 0; i < iterations; i++) {
+		for (j = 0; j < CRUD_BENCH_WORDS; j++) {
+			sum += htonll64(bench_words[j]);
+		}
+	}
+	bench_sink = sum;
+	return (iterations * CRUD_BENCH_WORDS * sizeof(uint64_t));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_htonll64_array
+// Description  : Swap a block of words with the array call
+//
+// Inputs       : iterations - the number of blocks
+//                arg - unused
+// Outputs      : the bytes swapped
+
+uint64_t bench_htonll64_array(uint64_t iterations, uint32_t arg) {
+
+	uint64_t i;
+
+	for (i = 0; i < iterations; i++) {
+		htonll64_array(bench_words, bench_words, CRUD_BENCH_WORDS);
+	}
+	bench_sink = bench_words[0];
+	return (iterations * CRUD_BENCH_WORDS * sizeof(uint64_t));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_crc32c
+// Description  : Checksum a buffer
+//
+// Inputs       : iterations - the number of buffers
+//                arg - the buffer size
+// Outputs      : the bytes checksummed
+
+uint64_t bench_crc32c(uint64_t iterations, uint32_t arg) {
+
+	uint64_t i;
+	uint32_t crc = 0;
+
+	for (i = 0; i < iterations; i++) {
+		crc = crc32c(crc, bench_buffer, arg);
+	}
+	bench_sink = crc;
+	return (iterations * arg);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_find_hit
+// Description  : Look up files that are in the table
+//
+// Inputs       : iterations - the number of lookups
+//                arg - unused
+// Outputs      : 0
+
+uint64_t bench_find_hit(uint64_t iterations, uint32_t arg) {
+
+	uint64_t i, sum = 0;
+
+	for (i = 0; i < iterations; i++) {
+		sum += crud_find(bench_names[i % CRUD_BENCH_FILES]);
+	}
+	bench_sink = sum;
+	return (0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_find_miss
+// Description  : Look up files that are not in the table
+//
+// Inputs       : iterations - the number of lookups
+//                arg - unused
+// Outputs      : 0
+
+uint64_t bench_find_miss(uint64_t iterations, uint32_t arg) {
+
+	char name[32];
+	uint64_t i, sum = 0;
+
+	for (i = 0; i < iterations; i++) {
+		snprintf(name, sizeof(name), "missing_%04lu", i % CRUD_BENCH_FILES);
+		sum += crud_find(name);
+	}
+	bench_sink = sum;
+	return (0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_crud_write
+// Description  : Overwrite a file of the given size from the start
+//
+// Inputs       : iterations - the number of writes
+//                arg - the file size
+// Outputs      : the bytes written
+
+uint64_t bench_crud_write(uint64_t iterations, uint32_t arg) {
+
+	char name[32];
+	int16_t fd;
+	uint64_t i;
+
+	snprintf(name, sizeof(name), "bench_%u", arg);
+	fd = crud_open(name);
+	for (i = 0; i < iterations; i++) {
+		bench_buffer[i % arg] ^= 1;
+		crud_seek(fd, 0);
+		if (crud_write(fd, bench_buffer, arg) != arg) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD bench write of %u bytes failed", arg);
+			break;
+		}
+	}
+	crud_close(fd);
+	return (i * arg);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_crud_read
+// Description  : Read a file of the given size from the start
+//
+// Inputs       : iterations - the number of reads
+//                arg - the file size
+// Outputs      : the bytes read
+
+uint64_t bench_crud_read(uint64_t iterations, uint32_t arg) {
+
+	char name[32], *buf = malloc(arg);
+	int16_t fd;
+	uint64_t i;
+
+	snprintf(name, sizeof(name), "bench_%u", arg);
+	fd = crud_open(name);
+	for (i = 0; i < iterations; i++) {
+		crud_seek(fd, 0);
+		if (crud_read(fd, buf, arg) != arg) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD bench read of %u bytes failed", arg);
+			break;
+		}
+	}
+	crud_close(fd);
+	free(buf);
+	return (i * arg);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_log
+// Description  : Log an INFO message, the level on or off (to /dev/null)
+//
+// Inputs       : iterations - the number of messages
+//                enabled - 1 if INFO is logged
+// Outputs      : 0
+
+uint64_t bench_log(uint64_t iterations, uint32_t enabled) {
+
+	uint64_t i;
+
+	initializeLogWithFilehandle(bench_null_log);
+	if (enabled) {
+		enableLogLevels(LOG_INFO_LEVEL);
+	}
+	for (i = 0; i < iterations; i++) {
+		logMessage(LOG_INFO_LEVEL, "CRUD_SIM : Writing %d bytes to file [%s]", (int)i, "bench.txt");
+	}
+	initializeLogWithFilehandle(CMPSC311_LOG_STDERR);
+	return (0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_workload_parse
+// Description  : Parse workload lines and decode their WRITE data
+//
+// Inputs       : iterations - the number of lines
+//                arg - unused
+// Outputs      : the bytes parsed
+
+uint64_t bench_workload_parse(uint64_t iterations, uint32_t arg) {
+
+	CrudWorkloadLine op;
+	char text[2048];
+	uint64_t i, bytes = 0;
+	char *line;
+
+	if (bench_nlines == 0) {
+		return (0);
+	}
+	for (i = 0; i < iterations; i++) {
+		line = bench_lines[i % bench_nlines];
+		if (crud_parse_workload_line(line, &op) == 0 && op.len < sizeof(text) &&
+			strncmp(op.command, "WRITE", 5) == 0) {
+			crud_workload_text(&op, text);
+		}
+		bytes += strlen(line);
+	}
+	bench_sink = bytes;
+	return (bytes);
+}
+
+// The benchmarks, in the order they run
+CrudBenchmark benchmarks[] = {
+	{ "request_encode",       bench_request_encode,       0 },
+	{ "request_decode",       bench_request_decode,       0 },
+	{ "request_encode_batch", bench_request_encode_batch, 0 },
+	{ "request_decode_batch", bench_request_decode_batch, 0 },
+	{ "htonll64",             bench_htonll64,             0 },
+	{ "htonll64_array",       bench_htonll64_array,       0 },
+	{ "crc32c",               bench_crc32c,               4096 },
+	{ "file_find_hit",        bench_find_hit,             0 },
+	{ "file_find_miss",       bench_find_miss,            0 },
+	{ "crud_write",           bench_crud_write,           16 },
+	{ "crud_write",           bench_crud_write,           256 },
+	{ "crud_write",           bench_crud_write,           4096 },
+	{ "crud_write",           bench_crud_write,           65536 },
+	{ "crud_write",           bench_crud_write,           CRUD_MAX_OBJECT_SIZE },
+	{ "crud_read",            bench_crud_read,            16 },
+	{ "crud_read",            bench_crud_read,            256 },
+	{ "crud_read",            bench_crud_read,            4096 },
+	{ "crud_read",            bench_crud_read,            65536 },
+	{ "crud_read",            bench_crud_read,            CRUD_MAX_OBJECT_SIZE },
+	{ "log_disabled",         bench_log,                  0 },
+	{ "log_enabled",          bench_log,                  1 },
+	{ "workload_parse",       bench_workload_parse,       0 },
+};
+#define CRUD_BENCH_COUNT (sizeof(benchmarks) / sizeof(CrudBenchmark))
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : main
+// Description  : The main function for the CRUD benchmarks
+//
+// Inputs       : argc - the number of command line parameters
+//                argv - the parameters
+// Outputs      : 0 if successful, -1 if failure
+
+int main( int argc, char *argv[] ) {
+
+	// Local variables
+	CrudBenchResult results[CRUD_BENCH_COUNT];
+	char *filter = NULL, *output = NULL, *workload = "workload-one.txt", *label = "", name[64];
+	double min_time = CRUD_BENCH_MIN_TIME;
+	int ch, list = 0, count = 0, ret = 0;
+	uint32_t b;
+
+	// Process the command line parameters
+	while ((ch = getopt(argc, argv, CRUD_BENCH_ARGUMENTS)) != -1) {
+
+		switch (ch) {
+		case 'h': // Help, print usage
+			fprintf( stderr, USAGE );
+			return( -1 );
+
+		case 'l': // List the benchmarks
+			list = 1;
+			break;
+
+		case 'f': // Only the matching benchmarks
+			filter = optarg;
+			break;
+
+		case 't': // Time per benchmark
+			if ( (sscanf(optarg, "%lf", &min_time) != 1) || (min_time <= 0) ) {
+				fprintf( stderr, "Bad  benchmark time [%s]\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'o': // JSON results file
+			output = optarg;
+			break;
+
+		case 'w': // Workload file to parse
+			workload = optarg;
+			break;
+
+		case 'c': // Label for the results
+			label = optarg;
+			break;
+
+		default:  // Default (unknown)
+			fprintf( stderr, "Unknown command line option (%c), aborting.\n", ch );
+			return( -1 );
+		}
+	}
+	initializeLogWithFilehandle( CMPSC311_LOG_STDERR );
+
+	// Set up the store and the inputs, then run the benchmarks
+	if ( !list && bench_setup(workload) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD bench setup failed." );
+		return( -1 );
+	}
+	if ( !list ) {
+		printf( "%-28s %14s %14s %14s %12s\n", "Benchmark", "Time(ns)", "CPU(ns)", "Iterations", "MB/s" );
+	}
+	for (b = 0; b < CRUD_BENCH_COUNT; b++) {
+		if ( benchmarks[b].arg && (benchmarks[b].func != bench_log) ) {
+			snprintf( name, sizeof(name), "%s/%u", benchmarks[b].name, benchmarks[b].arg );
+		} else {
+			snprintf( name, sizeof(name), "%s", benchmarks[b].name );
+		}
+		if ( (filter != NULL) && (strstr(name, filter) == NULL) ) {
+			continue;
+		}
+		if ( list ) {
+			printf( "%s\n", name );
+			continue;
+		}
+		strcpy( results[count].name, name );
+		if ( bench_run(&benchmarks[b], min_time, &results[count]) ) {
+			ret = -1;
+			continue;
+		}
+		printf( "%-28s %14.1f %14.1f %14lu %12.1f\n", results[count].name, results[count].real_ns,
+				results[count].cpu_ns, results[count].iterations, results[count].bytes / 1e6 );
+		count++;
+	}
+	if ( !list ) {
+		bench_teardown();
+	}
+
+	// Save the results
+	if ( (output != NULL) && bench_write_json(output, label, results, count) ) {
+		ret = -1;
+	}
+	return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_setup
+// Description  : Fill the codec inputs, format and mount the in-process store,
+//                make the files for the lookups and reads, and load the
+//                workload lines
+//
+// Inputs       : workload - the workload file to parse
+// Outputs      : 0 if successful, -1 if failure
+
+int bench_setup(char *workload) {
+
+	char line[2048];
+	uint32_t i, sizes[] = { 16, 256, 4096, 65536, CRUD_MAX_OBJECT_SIZE };
+	int16_t fd;
+	FILE *fhandle;
+
+	// The codec and byte swapping inputs
+	for (i = 0; i < CRUD_BENCH_WORDS; i++) {
+		bench_fields[i].oid = getRandomValue(1, 0xffffff);
+		bench_fields[i].req = getRandomValue(0, CRUD_MAXVAL - 1);
+		bench_fields[i].length = getRandomValue(0, CRUD_MAX_OBJECT_SIZE);
+		bench_fields[i].flags = getRandomValue(0, 7);
+		bench_fields[i].res = getRandomValue(0, 1);
+		bench_words[i] = ((uint64_t)getRandomValue(0, UINT32_MAX) << 32) | getRandomValue(0, UINT32_MAX);
+	}
+	crud_request_encode_batch(bench_fields, bench_requests, CRUD_BENCH_WORDS);
+	if ((bench_buffer = malloc(CRUD_MAX_OBJECT_SIZE)) == NULL ||
+		(bench_null_log = open("/dev/null", O_WRONLY)) == -1) {
+		return (-1);
+	}
+	for (i = 0; i < CRUD_MAX_OBJECT_SIZE; i++) {
+		bench_buffer[i] = getRandomValue(0, 255);
+	}
+
+	// A fresh store with the files in it
+	if (crud_format() || crud_mount()) {
+		return (-1);
+	}
+	for (i = 0; i < CRUD_BENCH_FILES; i++) {
+		snprintf(line, sizeof(line), "file_%04u", i);
+		bench_names[i] = strdup(line);
+		if ((fd = crud_open(bench_names[i])) == -1) {
+			return (-1);
+		}
+		crud_close(fd);
+	}
+	for (i = 0; i < sizeof(sizes) / sizeof(uint32_t); i++) {
+		snprintf(line, sizeof(line), "bench_%u", sizes[i]);
+		if (((fd = crud_open(line)) == -1) || (crud_write(fd, bench_buffer, sizes[i]) != sizes[i])) {
+			return (-1);
+		}
+		crud_close(fd);
+	}
+
+	// The workload lines (the benchmark is skipped without them)
+	if ((fhandle = fopen(workload, "r")) == NULL) {
+		logMessage(LOG_WARNING_LEVEL, "CRUD bench cannot open workload [%s], not parsing", workload);
+		return (0);
+	}
+	while ((bench_nlines < CRUD_BENCH_MAX_LINES) && (fgets(line, sizeof(line), fhandle) != NULL)) {
+		bench_lines[bench_nlines++] = strdup(line);
+	}
+	fclose(fhandle);
+	return (0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_teardown
+// Description  : Unmount the store and free the inputs
+//
+// Inputs       : none
+// Outputs      : none
+
+void bench_teardown(void) {
+
+	uint32_t i;
+
+	crud_unmount();
+	for (i = 0; i < CRUD_BENCH_FILES; i++) {
+		free(bench_names[i]);
+	}
+	for (i = 0; i < bench_nlines; i++) {
+		free(bench_lines[i]);
+	}
+	free(bench_buffer);
+	close(bench_null_log);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_run
+// Description  : Run a benchmark with more and more iterations until it
+//                takes at least min_time, and keep the last run
+//
+// Inputs       : bench - the benchmark
+//                min_time - the seconds it has to run for
+//                result - the place to put the timings
+// Outputs      : 0 if successful, -1 if failure
+
+int bench_run(CrudBenchmark *bench, double min_time, CrudBenchResult *result) {
+
+	uint64_t iterations = 1, bytes, next;
+	double real, cpu;
+
+	while (1) {
+		real = bench_clock(CLOCK_MONOTONIC);
+		cpu = bench_clock(CLOCK_PROCESS_CPUTIME_ID);
+		bytes = bench->func(iterations, bench->arg);
+		real = bench_clock(CLOCK_MONOTONIC) - real;
+		cpu = bench_clock(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+		if ((real >= min_time) || (iterations >= CRUD_BENCH_MAX_ITERATIONS)) {
+			break;
+		}
+
+		// Aim a little past the time from this run, growing at most 10x
+		next = (real > 0) ? (uint64_t)(iterations * min_time * 1.4 / real) : iterations * 10;
+		if (next > iterations * 10) {
+			next = iterations * 10;
+		}
+		iterations = (next > iterations) ? next : iterations + 1;
+	}
+	if (real <= 0) {
+		return (-1);
+	}
+	result->iterations = iterations;
+	result->real_ns = real * 1e9 / iterations;
+	result->cpu_ns = cpu * 1e9 / iterations;
+	result->bytes = bytes / real;
+	return (0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_write_json
+// Description  : Write the results in the Google Benchmark JSON layout
+//
+// Inputs       : path - the file to write
+//                label - a label for the run (e.g. the commit)
+//                results - the results
+//                count - the number of results
+// Outputs      : 0 if successful, -1 if failure
+
+int bench_write_json(char *path, char *label, CrudBenchResult *results, int count) {
+
+	char date[64], host[256];
+	time_t now = time(NULL);
+	FILE *fhandle;
+	int i;
+
+	if ((fhandle = fopen(path, "w")) == NULL) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD bench cannot write results [%s]", path);
+		return (-1);
+	}
+	strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", localtime(&now));
+	if (gethostname(host, sizeof(host)) != 0) {
+		strcpy(host, "unknown");
+	}
+	fprintf(fhandle, "{\n  \"context\": {\n");
+	fprintf(fhandle, "    \"date\": \"%s\",\n    \"host_name\": \"%s\",\n", date, host);
+	fprintf(fhandle, "    \"executable\": \"crud_bench\",\n    \"num_cpus\": %ld,\n", sysconf(_SC_NPROCESSORS_ONLN));
+	fprintf(fhandle, "    \"label\": \"%s\",\n    \"library_build_type\": \"debug\"\n  },\n", label);
+	fprintf(fhandle, "  \"benchmarks\": [\n");
+	for (i = 0; i < count; i++) {
+		fprintf(fhandle, "    {\n      \"name\": \"%s\",\n      \"run_name\": \"%s\",\n", results[i].name, results[i].name);
+		fprintf(fhandle, "      \"run_type\": \"iteration\",\n      \"repetitions\": 1,\n      \"repetition_index\": 0,\n");
+		fprintf(fhandle, "      \"threads\": 1,\n      \"iterations\": %lu,\n", results[i].iterations);
+		fprintf(fhandle, "      \"real_time\": %.3f,\n      \"cpu_time\": %.3f,\n      \"time_unit\": \"ns\"",
+				results[i].real_ns, results[i].cpu_ns);
+		if (results[i].bytes > 0) {
+			fprintf(fhandle, ",\n      \"bytes_per_second\": %.1f", results[i].bytes);
+		}
+		fprintf(fhandle, "\n    }%s\n", (i < count - 1) ? "," : "");
+	}
+	fprintf(fhandle, "  ]\n}\n");
+	if (fclose(fhandle) != 0) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD bench cannot write results [%s]", path);
+		return (-1);
+	}
+	return (0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_clock
+// Description  : Read a clock in seconds
+//
+// Inputs       : clock - the clock (CLOCK_MONOTONIC, CLOCK_PROCESS_CPUTIME_ID)
+// Outputs      : the time in seconds
+
+double bench_clock(clockid_t clock) {
+
+	struct timespec now;
+
+	clock_gettime(clock, &now);
+	return (now.tv_sec + now.tv_nsec / 1e9);
+}
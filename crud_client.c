@@ -11,6 +11,10 @@
 
 // Project Include Files
 #include <crud_network.h>
+#include <crud_request.h>
+#include <crud_compress.h>
+#include <crud_metrics.h>
+#include <crud_trace.h>
 #include <cmpsc311_log.h>
 #include <cmpsc311_util.h>
 #include <signal.h>
@@ -18,17 +22,57 @@
 #include <string.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <sys/time.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 
+// Defines
+#define CRUD_CLIENT_TIMEOUT_MS 10000    // Deadline for one operation (or batch)
+#define CRUD_CLIENT_RETRIES 4           // Attempts after the first
+#define CRUD_CLIENT_BACKOFF_MS 50       // Wait before the first retry, doubled after each
+#define CRUD_CLIENT_BACKOFF_MAX_MS 2000
+#define CRUD_CLIENT_TEST_SIZE 4096
+
 // Global variables
 int            crud_network_shutdown = 0; // Flag indicating shutdown
 unsigned char *crud_network_address = NULL; // Address of CRUD server 
 unsigned short crud_network_port = 0; // Port of CRUD server
 
-int sockfd;
+uint8_t        crud_network_capabilities = 0; // Flags from the INIT response
+uint32_t       crud_network_features = 0; // Length from the INIT response
+
+int sockfd = -1;
 struct sockaddr_in caddr;
+uint8_t session = 0; // INIT done and not CLOSEd, a lost connection is reopened
+uint8_t session_changed = 0; // the store was changed since INIT, servers only keep it at a CLOSE
+
+uint32_t timeout_ms = CRUD_CLIENT_TIMEOUT_MS; // 0 waits forever
+uint32_t max_retries = CRUD_CLIENT_RETRIES;
+struct timeval deadline; // When the current operation gives up
+CrudTransportStats transport_stats; // Timeouts, retries and reconnects
+
+uint32_t compress_threshold = CRUD_COMPRESS_THRESHOLD; // 0 turns compression off
+CrudCompressionStats compress_stats; // What compression bought on this connection
+char *packed = NULL; // Compressed payloads in and out
+
+// Local functions
+int write_all(void *buf, int length);
+int read_all(void *buf, int length);
+int read_payload(CrudResponse *response, void *buf, uint32_t capacity);
+int send_request(CrudRequest op, void *buf, uint32_t offset);
+int receive_response(CrudRequest op, void *buf, CrudResponse *response);
+CrudResponse client_transact(CrudRequest op, void *buf, uint32_t offset);
+int open_connection(void);
+int restore_session(void);
+void drop_connection(void);
+int request_changes_store(int type);
+void start_deadline(void);
+int wait_socket(short events);
 
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -48,140 +92,724 @@ struct sockaddr_in caddr;
 CrudResponse crud_client_operation(CrudRequest op, void *buf) {
 	
 
-	uint64_t response;
 	int type;
-    int type2;
-	int length;
-	int counter = 0;
-	int type3;
-	int length2;
-	int total;
-	uint64_t response2;
+	uint64_t response;
+	char *data = buf;
     
     //extract op to get the type 
-	type = ((op)<<32)>>60 ;
+	type = crud_request_type(op);
 
-	//when type is init
+	//when type is init, start a new connection
 	if(type == CRUD_INIT){
+		drop_connection();
+		memset(&compress_stats, 0, sizeof(compress_stats));
+	}
 
-		//creating a socket
-		sockfd = socket(PF_INET, SOCK_STREAM, 0);
-		if(sockfd == -1){
-			printf("Error on socket creation [%s]\n", strerror(errno));
-			return (-1);
+	// send the request, then wait for the response (retrying if it is safe to)
+	response = client_transact(op, data, 0);
+
+	// the INIT response flags tell us what the server supports
+	if(type == CRUD_INIT && response != (uint64_t)-1){
+		crud_network_capabilities = crud_request_flags(response);
+		crud_network_features = crud_request_length(response);
+		session = 1;
+		session_changed = 0;
+	}
+
+	//when type is close
+	if(type == CRUD_CLOSE){
+		drop_connection();
+		session = 0;
+		session_changed = 0;
+		if (crud_network_capabilities & CRUD_COMPRESS_FLAG)
+			logMessage(LOG_INFO_LEVEL, "CRUD compression: %lu payloads, %lu bytes sent as %lu, %lu not worth it, %lu usec",
+					compress_stats.payloads, compress_stats.raw_bytes, compress_stats.wire_bytes,
+					compress_stats.skipped, compress_stats.usec);
+		if (transport_stats.timeouts || transport_stats.retries || transport_stats.failures)
+			logMessage(LOG_INFO_LEVEL, "CRUD transport: %lu timeouts, %lu retries, %lu reconnects, %lu failures",
+					transport_stats.timeouts, transport_stats.retries, transport_stats.reconnects,
+					transport_stats.failures);
+		crud_network_capabilities = 0;
+		crud_network_features = 0;
+		free(packed);
+		packed = NULL;
+
+	}
+
+	return response;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : client_transact
+// Description  : This sends one request and receives its response within the
+//                deadline.  A lost connection is reopened (and INIT sent
+//                again) with a growing wait between attempts.  A request that
+//                fails after it may have reached the server is only sent
+//                again if doing it twice is harmless (READ and INIT).
+//
+// Inputs       : op - the request
+//                buf - the object for CREATE/UPDATE, the place for READ data
+//                offset - the object offset of a ranged READ
+// Outputs      : the response, -1 if failure
+
+CrudResponse client_transact(CrudRequest op, void *buf, uint32_t offset) {
+
+	int type = crud_request_type(op);
+	uint32_t attempt, wait = CRUD_CLIENT_BACKOFF_MS;
+	CrudResponse response;
+	struct timeval start, stop;
+
+	if (type != CRUD_INIT && !session && sockfd == -1)
+		return (-1);
+	CRUD_PROBE4(bus_entry, type, crud_request_oid(op), crud_request_length(op), crud_request_flags(op));
+	gettimeofday(&start, NULL);
+
+	for (attempt = 0; ; attempt++){
+
+		// wait a little longer before each retry
+		if (attempt > 0){
+			CRUD_PROBE3(bus_retry, type, crud_request_oid(op), attempt);
+			transport_stats.retries++;
+			usleep(wait * 1000);
+			wait = (wait * 2 > CRUD_CLIENT_BACKOFF_MAX_MS) ? CRUD_CLIENT_BACKOFF_MAX_MS : wait * 2;
 		}
-		
-		struct sockaddr_in caddr;
-		caddr.sin_family = AF_INET;
-		caddr.sin_port = htons(CRUD_DEFAULT_PORT);
-		if(inet_aton(CRUD_DEFAULT_IP, &caddr.sin_addr) == 0){
-				return(-1);
+
+		// (re)connect, nothing has been sent yet so any request can try again
+		// (unless restoring the session was refused, that will not change)
+		if (sockfd == -1 && ((type == CRUD_INIT) ? open_connection() : restore_session()) == -1){
+			if (attempt < max_retries && (type == CRUD_INIT || session))
+				continue;
+			break;
 		}
 
-		//connect
-		if( connect(sockfd, (const struct sockaddr*)&caddr, sizeof(struct sockaddr)) == -1){
-			return (-1);
+		start_deadline();
+		session_changed |= request_changes_store(type);
+		if (send_request(op, buf, offset) == 0 && receive_response(op, buf, &response) == 0){
+			gettimeofday(&stop, NULL);
+			crud_metric_op(type, compareTimes(&start, &stop), crud_request_result(response));
+			CRUD_PROBE4(bus_return, type, crud_request_oid(response), crud_request_length(response),
+					crud_request_result(response));
+			return response;
 		}
 
+		// the connection is in an unknown state, start again on a new one
+		drop_connection();
+		if ((type != CRUD_READ && type != CRUD_INIT) || attempt >= max_retries)
+			break;
 	}
 
-	// start to send the request to server
-	
+	transport_stats.failures++;
+	gettimeofday(&stop, NULL);
+	crud_metric_op(type, compareTimes(&start, &stop), 1);
+	CRUD_PROBE4(bus_return, type, crud_request_oid(op), 0, -1);
+	logMessage(LOG_ERROR_LEVEL, "CRUD %s request failed after %u attempts [OID %u]",
+			CRUD_REQUEST_TYPE_LABLES[type], attempt + 1, crud_request_oid(op));
+	return (-1);
+}
 
-	// extract the req to get the tyep and length
-	type2 =  ((op)<<32)>>60 ;
- 	length =  ((op)<<36)>>40;
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_client_batch
+// Description  : This sends a batch of CREATE/UPDATE/DELETE requests back to
+//                back and only then reads their responses, so the batch costs
+//                one round trip instead of one per request.  Only writes are
+//                allowed: their responses are bare headers, so the server
+//                never blocks sending them while we are still sending.
+//
+// Inputs       : ops - the requests
+//                bufs - the object for each CREATE/UPDATE (NULL for DELETE)
+//                responses - the place to put the responses, in order
+//                count - the number of requests
+// Outputs      : 0 if every request got a response (check each R bit), -1
+//                if the connection failed
 
-	// conver the type to the network byte order
-	uint64_t network = htonll64(op);
+int crud_client_batch(CrudRequest *ops, void **bufs, CrudResponse *responses, int count) {
 
-	// start to write 
-	write(sockfd, &network, sizeof(network));
+	int i, j, type;
+	struct timeval start, stop;
 
+	for (i = 0; i < count; i++){
+		type = crud_request_type(ops[i]);
+		if (type != CRUD_CREATE && type != CRUD_UPDATE && type != CRUD_DELETE)
+			return (-1);
+	}
 
-	// when the type is create
-	if (type2 == CRUD_CREATE ){
-		
-		write(sockfd, &buf[counter], length - counter);
-			
+	// none of them can be sent twice, so a lost connection is only reopened up front
+	if (sockfd == -1 && (!session || restore_session() == -1))
+		return (-1);
+
+	CRUD_PROBE1(batch_entry, count);
+	start_deadline();
+	session_changed = 1;
+	gettimeofday(&start, NULL);
+	for (i = 0; i < count && send_request(ops[i], bufs[i], 0) == 0; i++);
+	for (j = 0; i == count && j < count && receive_response(ops[j], bufs[j], &responses[j]) == 0; j++);
+	gettimeofday(&stop, NULL);
+
+	// the requests shared the wait, each is counted with its share of it
+	for (i = 0; i < count; i++)
+		crud_metric_op(crud_request_type(ops[i]), compareTimes(&start, &stop) / count,
+				i >= j || crud_request_result(responses[i]));
+	if (j != count){
+		drop_connection();
+		transport_stats.failures++;
+		CRUD_PROBE2(batch_return, count, -1);
+		return (-1);
+	}
+
+	CRUD_PROBE2(batch_return, count, 0);
+	return (0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : send_request
+// Description  : This sends one request and its object (compressed if the
+//                server takes it and it is worth it), or its offset word if
+//                it is a ranged READ
+//
+// Inputs       : op - the request
+//                buf - the object for CREATE/UPDATE
+//                offset - the object offset for a ranged READ
+// Outputs      : 0 if successful, -1 if failure
+
+int send_request(CrudRequest op, void *buf, uint32_t offset) {
+
+	int type = crud_request_type(op);
+	int length = crud_request_length(op);
+	uint32_t wire = 0;
+	uint64_t network[2];
+	char *data = buf;
+	struct timeval start, stop;
+
+	// compress the object of a create or update if the server takes it and it shrinks
+	if ((crud_network_capabilities & CRUD_COMPRESS_FLAG) && compress_threshold &&
+		(type == CRUD_CREATE || type == CRUD_UPDATE) && length >= compress_threshold){
+
+		if (packed == NULL)
+			packed = malloc(CRUD_MAX_OBJECT_SIZE);
+		// without the buffer the object just goes uncompressed (wire stays 0)
+		if (packed != NULL){
+			gettimeofday(&start, NULL);
+			wire = crud_compress(data, length, packed, length - 1);
+			gettimeofday(&stop, NULL);
+			compress_stats.usec += compareTimes(&start, &stop);
+		}
+
+		if (wire > 0){
+			compress_stats.payloads++;
+			compress_stats.raw_bytes += length;
+			compress_stats.wire_bytes += wire;
+			op = CRUD_SET_FIELD(op, LENGTH, wire);
+			op = CRUD_SET_FIELD(op, FLAGS, crud_request_flags(op) | CRUD_COMPRESS_FLAG);
+		} else {
+			compress_stats.skipped++;
+		}
 	}
 
-	// when the type is update
-	if(type2 == CRUD_UPDATE){
+	// let the server compress what it reads back
+	if ((crud_network_capabilities & CRUD_COMPRESS_FLAG) && compress_threshold && type == CRUD_READ)
+		op = CRUD_SET_FIELD(op, FLAGS, crud_request_flags(op) | CRUD_COMPRESS_FLAG);
+
+	// conver the type to the network byte order, a ranged READ's offset goes with it
+	network[0] = htonll64(op);
+	network[1] = htonll64(offset);
+
+	// start to write 
+	if (write_all(network, (crud_request_flags(op) & CRUD_RANGE_FLAG) ? sizeof(network) : sizeof(network[0])) == -1)
+		return (-1);
+
+	// when the type is create or update, the object follows the header
+	if (type == CRUD_CREATE || type == CRUD_UPDATE){
 		
-		write(sockfd, &buf[counter], length - counter);
+		if (write_all(wire ? packed : data, wire ? wire : (uint32_t)length) == -1)
+			return (-1);
 			
 	}
 
-	///////send is over in here
-	///////// start to receive
+	return (0);
+}
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : receive_response
+// Description  : This reads the response to a request, and the data of a
+//                good READ
+//
+// Inputs       : op - the request (as the caller made it)
+//                buf - the place to put READ data
+//                response - the place to put the response
+// Outputs      : 0 if successful, -1 if failure
 
+int receive_response(CrudRequest op, void *buf, CrudResponse *response) {
 
-	// extract the req to get the tyep and length
-	type3 =  ((op)<<32)>>60 ;
- 	length2 =  ((op)<<36)>>40;
+	uint64_t network;
 
 	// start to read
-	read(sockfd, &response2, sizeof(response2));
+	if (read_all(&network, sizeof(network)) == -1)
+		return (-1);
 
 	// Convert NBO to HBO
-	ntohll64(response2);
+	*response = ntohll64(network);
 
-	// when type is READ
-	if (type3 == CRUD_READ){
+	// when type is READ, the server tells us how many bytes follow
+	if (crud_request_type(op) == CRUD_READ && crud_request_result(*response) == 0){
 
-		total = 0;
+		if (read_payload(response, buf, crud_request_length(op)) == -1)
+			return (-1);
 
-		while(total != length2){
+	} 
 
-			int counter2;
+	return (0);
+}
 
-			counter2 =read(sockfd, &buf[total], length2-total);
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_client_read_range
+// Description  : This sends a ranged READ to the server and receives the data
+//                straight into the callers buffer (needs CRUD_RANGE_FLAG in
+//                crud_network_capabilities).
+//
+// Inputs       : op - the READ opcode, length is the number of bytes wanted
+//                offset - the offset in the object to start at
+//                buf - the place to put the bytes
+// Outputs      : the response, length is the number of bytes received
 
-			total = total + counter2;
-		} 
+CrudResponse crud_client_read_range(CrudRequest op, uint32_t offset, void *buf) {
 
-	} 
+	// the offset goes out with the header, and only the bytes sent come back
+	return (client_transact(CRUD_SET_FIELD(op, FLAGS, crud_request_flags(op) | CRUD_RANGE_FLAG), buf, offset));
+}
 
-	uint64_t reader = ntohll64(response2);
-	
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_client_set_compression
+// Description  : This sets the smallest payload worth compressing, payloads
+//                only go compressed to servers that offered CRUD_COMPRESS_FLAG
+//
+// Inputs       : threshold - the size in bytes, 0 to turn compression off
+// Outputs      : none
 
+void crud_client_set_compression(uint32_t threshold) {
+	compress_threshold = threshold;
+}
 
-	//when type is close
-	if(type == CRUD_CLOSE){
-		close(sockfd);
-		sockfd = -1;
-		
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_client_get_compression_stats
+// Description  : This copies out the compression counters
+//
+// Inputs       : stats - the place to put them
+// Outputs      : none
 
+void crud_client_get_compression_stats(CrudCompressionStats *stats) {
+	*stats = compress_stats;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_client_set_timeout
+// Description  : This sets the deadline of each operation and how many more
+//                attempts a failed one gets
+//
+// Inputs       : msec - the deadline in milliseconds, 0 waits forever
+//                retries - the attempts after the first
+// Outputs      : none
+
+void crud_client_set_timeout(uint32_t msec, uint32_t retries) {
+	timeout_ms = msec;
+	max_retries = retries;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_client_get_transport_stats
+// Description  : This copies out the timeout, retry and reconnect counters
+//
+// Inputs       : stats - the place to put them
+// Outputs      : none
+
+void crud_client_get_transport_stats(CrudTransportStats *stats) {
+	*stats = transport_stats;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : open_connection
+// Description  : This connects to the server
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int open_connection(void) {
+
+	int nodelay = 1;
+
+	//creating a socket
+	sockfd = socket(PF_INET, SOCK_STREAM, 0);
+	if (sockfd == -1){
+		logMessage(LOG_ERROR_LEVEL, "CRUD socket() create failed [%s]", strerror(errno));
+		return (-1);
+	}
+
+	caddr.sin_family = AF_INET;
+	caddr.sin_port = htons(crud_network_port ? crud_network_port : CRUD_DEFAULT_PORT);
+	if (inet_aton(crud_network_address ? (char *)crud_network_address : CRUD_DEFAULT_IP, &caddr.sin_addr) == 0 ||
+		connect(sockfd, (const struct sockaddr*)&caddr, sizeof(struct sockaddr)) == -1){
+		drop_connection();
+		return (-1);
+	}
+
+	// requests are small, send them without waiting to coalesce
+	setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+	return (0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : restore_session
+// Description  : This reconnects after the connection was lost, sending INIT
+//                again so the server's capabilities are known.  Once the
+//                store has been changed in this session it is not restored:
+//                the server may have dropped everything since the last CLOSE,
+//                so the session ends and requests fail until the next INIT.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int restore_session(void) {
+
+	CrudRequest op = crud_request_encode(0, CRUD_INIT, 0, 0, 0);
+	CrudResponse response;
+
+	if (session_changed){
+		logMessage(LOG_ERROR_LEVEL, "CRUD connection lost with unsaved changes, the session has ended.");
+		session = 0;
+		return (-1);
+	}
+	if (open_connection() == -1)
+		return (-1);
+	start_deadline();
+	if (send_request(op, NULL, 0) == -1 || receive_response(op, NULL, &response) == -1 ||
+		crud_request_result(response) != 0){
+		drop_connection();
+		return (-1);
 	}
 
-	return reader;
+	crud_network_capabilities = crud_request_flags(response);
+	crud_network_features = crud_request_length(response);
+	transport_stats.reconnects++;
+	logMessage(LOG_WARNING_LEVEL, "CRUD reconnected to the server.");
+	return (0);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : request_changes_store
+// Description  : This says whether a request type changes the store (so a
+//                lost connection after it cannot be quietly restored)
+//
+// Inputs       : type - the request type
+// Outputs      : 1 if it does, 0 if not
+
+int request_changes_store(int type) {
+
+	return (type == CRUD_FORMAT || type == CRUD_CREATE || type == CRUD_UPDATE ||
+		type == CRUD_DELETE || type == CRUD_CLONE);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_client_session
+// Description  : This says whether the client is in a session (INIT done,
+//                not CLOSEd and not ended by a lost connection)
+//
+// Inputs       : none
+// Outputs      : 1 if it is, 0 if not
+
+int crud_client_session(void) {
+
+	return (session);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : drop_connection
+// Description  : This closes the connection (if there is one)
+//
+// Inputs       : none
+// Outputs      : none
+
+void drop_connection(void) {
+
+	if (sockfd != -1){
+		close(sockfd);
+		sockfd = -1;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : start_deadline
+// Description  : This starts the clock on an operation
+//
+// Inputs       : none
+// Outputs      : none
 
+void start_deadline(void) {
 
+	gettimeofday(&deadline, NULL);
+	deadline.tv_sec += timeout_ms / 1000;
+	deadline.tv_usec += (timeout_ms % 1000) * 1000;
+	if (deadline.tv_usec >= 1000000){
+		deadline.tv_sec++;
+		deadline.tv_usec -= 1000000;
+	}
+}
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : wait_socket
+// Description  : This waits until the socket is ready or the operation's
+//                deadline passes
+//
+// Inputs       : events - POLLIN or POLLOUT
+// Outputs      : 0 if ready, -1 if timed out or failed
+
+int wait_socket(short events) {
+
+	struct pollfd pfd = { sockfd, events, 0 };
+	struct timeval now;
+	long left = -1;
+	int ready;
+
+	do {
+		if (timeout_ms){
+			gettimeofday(&now, NULL);
+			left = compareTimes(&now, &deadline) / 1000;
+			if (left < 0)
+				left = 0;
+		}
+		ready = poll(&pfd, 1, (int)left);
+	} while (ready == -1 && errno == EINTR);
 
+	if (ready == 0){
+		transport_stats.timeouts++;
+		logMessage(LOG_WARNING_LEVEL, "CRUD request timed out after %u ms.", timeout_ms);
+	}
+	return ((ready > 0) ? 0 : -1);
+}
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : read_payload
+// Description  : This reads the data of a good READ response into buf,
+//                decompressing it if the server sent it compressed.  The
+//                response is rewritten to look like an uncompressed one.
+//
+// Inputs       : response - the READ response, updated in place
+//                buf - the place to put the bytes
+//                capacity - the room in buf (the length asked for)
+// Outputs      : 0 if successful, -1 if failure
+
+int read_payload(CrudResponse *response, void *buf, uint32_t capacity) {
+
+	uint32_t length = crud_request_length(*response);
+	int32_t unpacked;
+	struct timeval start, stop;
+
+	// more than was asked for would run over the caller's buffer, the
+	// connection is out of step so the caller drops it
+	if (!(crud_request_flags(*response) & CRUD_COMPRESS_FLAG)){
+		if (length > capacity){
+			logMessage(LOG_ERROR_LEVEL, "CRUD READ response too long [OID %u, %u bytes, asked for %u]",
+					crud_request_oid(*response), length, capacity);
+			return (-1);
+		}
+		return (read_all(buf, length));
+	}
 
+	if (packed == NULL)
+		packed = malloc(CRUD_MAX_OBJECT_SIZE);
+	if (packed == NULL){
+		logMessage(LOG_ERROR_LEVEL, "CRUD no memory for compressed READ response [OID %u, %u bytes]",
+				crud_request_oid(*response), length);
+		return (-1);
+	}
+	if (length > CRUD_MAX_OBJECT_SIZE){
+		logMessage(LOG_ERROR_LEVEL, "CRUD compressed READ response too long [OID %u, %u bytes]",
+				crud_request_oid(*response), length);
+		return (-1);
+	}
+	if (read_all(packed, length) == -1)
+		return (-1);
+
+	gettimeofday(&start, NULL);
+	unpacked = crud_decompress(packed, length, buf, capacity);
+	gettimeofday(&stop, NULL);
+	compress_stats.usec += compareTimes(&start, &stop);
+	if (unpacked == -1){
+		logMessage(LOG_ERROR_LEVEL, "CRUD bad compressed READ response [OID %u, %u bytes]",
+				crud_request_oid(*response), length);
+		return (-1);
+	}
 
- 	
+	compress_stats.payloads++;
+	compress_stats.raw_bytes += unpacked;
+	compress_stats.wire_bytes += length;
+	*response = CRUD_SET_FIELD(*response, LENGTH, unpacked);
+	*response = CRUD_SET_FIELD(*response, FLAGS, crud_request_flags(*response) & ~CRUD_COMPRESS_FLAG);
+	return (0);
+}
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : write_all
+// Description  : This writes the whole buffer to the server socket before
+//                the operation's deadline
+//
+// Inputs       : buf - the bytes to send
+//                length - the number of bytes
+// Outputs      : 0 if successful, -1 if failure
 
+int write_all(void *buf, int length) {
 
+	int total = 0;
+	int counter;
+	char *data = buf;
 
+	while(total != length){
 
+		if (wait_socket(POLLOUT) == -1)
+			return (-1);
+		counter = send(sockfd, &data[total], length-total, MSG_NOSIGNAL);
+		if (counter == -1 && errno == EINTR)
+			continue;
+		if (counter <= 0)
+			return (-1);
 
+		total = total + counter;
+	}
+	crud_metric_add(CRUD_METRIC_BYTES_SENT, length);
 
+	return (0);
+}
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : read_all
+// Description  : This reads exactly length bytes from the server socket
+//                before the operation's deadline
+//
+// Inputs       : buf - the place to put the bytes
+//                length - the number of bytes
+// Outputs      : 0 if successful, -1 if failure
 
+int read_all(void *buf, int length) {
 
+	int total = 0;
+	int counter;
+	char *data = buf;
 
+	while(total != length){
 
+		if (wait_socket(POLLIN) == -1)
+			return (-1);
+		counter = recv(sockfd, &data[total], length-total, 0);
+		if (counter == -1 && errno == EINTR)
+			continue;
+		if (counter <= 0)
+			return (-1);
 
+		total = total + counter;
+	}
+	crud_metric_add(CRUD_METRIC_BYTES_RECEIVED, length);
 
+	return (0);
+}
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_client_unit_test
+// Description  : This checks the transport against a live server: a READ on a
+//                connection cut under it goes through on a new one, a CREATE
+//                is not sent again (and ends the session), and a server that
+//                never answers times out
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_client_unit_test(void) {
+
+	char out[CRUD_CLIENT_TEST_SIZE], in[CRUD_CLIENT_TEST_SIZE];
+	CrudTransportStats before, after;
+	CrudResponse response;
+	struct sockaddr_in saddr;
+	socklen_t slen = sizeof(saddr);
+	unsigned short port = crud_network_port;
+	CrudOID oid;
+	int i, quiet;
+
+	for (i = 0; i < CRUD_CLIENT_TEST_SIZE; i++)
+		out[i] = (char)getRandomValue(0, 0xff);
+	crud_client_get_transport_stats(&before);
+	crud_client_operation(crud_request_encode(0, CRUD_INIT, 0, 0, 0), NULL);
+	response = crud_client_operation(crud_request_encode(0, CRUD_CREATE, CRUD_CLIENT_TEST_SIZE, 0, 0), out);
+	if (crud_request_result(response)){
+		logMessage(LOG_ERROR_LEVEL, "CRUD client unit test failed, could not create an object");
+		return (-1);
+	}
+	oid = crud_request_oid(response);
+
+	// cut the connection under the client, a READ has to get through anyway
+	// (after a CLOSE, servers may only keep what was saved at one)
+	crud_client_operation(crud_request_encode(0, CRUD_CLOSE, 0, 0, 0), NULL);
+	crud_client_operation(crud_request_encode(0, CRUD_INIT, 0, 0, 0), NULL);
+	shutdown(sockfd, SHUT_RDWR);
+	response = crud_client_operation(crud_request_encode(oid, CRUD_READ, CRUD_CLIENT_TEST_SIZE, 0, 0), in);
+	crud_client_get_transport_stats(&after);
+	if (crud_request_result(response) || crud_request_length(response) != CRUD_CLIENT_TEST_SIZE ||
+		memcmp(out, in, CRUD_CLIENT_TEST_SIZE) || after.reconnects != before.reconnects + 1){
+		logMessage(LOG_ERROR_LEVEL, "CRUD client unit test failed, READ did not survive a lost connection");
+		return (-1);
+	}
 
+	// a CREATE fails rather than risk making two objects, and the session is
+	// over (it changed the store), so the next request fails until an INIT
+	shutdown(sockfd, SHUT_RDWR);
+	response = crud_client_operation(crud_request_encode(0, CRUD_CREATE, CRUD_CLIENT_TEST_SIZE, 0, 0), out);
+	if (crud_request_result(response) == 0 ||
+		crud_request_result(crud_client_operation(crud_request_encode(oid, CRUD_DELETE, 0, 0, 0), NULL)) == 0 ||
+		crud_client_session() ||
+		crud_request_result(crud_client_operation(crud_request_encode(0, CRUD_INIT, 0, 0, 0), NULL)) ||
+		crud_request_result(crud_client_operation(crud_request_encode(oid, CRUD_DELETE, 0, 0, 0), NULL)) ||
+		crud_request_result(crud_client_operation(crud_request_encode(0, CRUD_CLOSE, 0, 0, 0), NULL))){
+		logMessage(LOG_ERROR_LEVEL, "CRUD client unit test failed, CREATE was retried or the session outlived it");
+		return (-1);
+	}
 
+	// a server that takes the connection but never answers times out on every attempt
+	memset(&saddr, 0, sizeof(saddr));
+	saddr.sin_family = AF_INET;
+	saddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if ((quiet = socket(PF_INET, SOCK_STREAM, 0)) == -1 || bind(quiet, (struct sockaddr *)&saddr, sizeof(saddr)) ||
+		listen(quiet, CRUD_MAX_BACKLOG) || getsockname(quiet, (struct sockaddr *)&saddr, &slen)){
+		logMessage(LOG_ERROR_LEVEL, "CRUD client unit test failed, no listening socket [%s]", strerror(errno));
+		return (-1);
+	}
+	crud_network_port = ntohs(saddr.sin_port);
+	crud_client_set_timeout(100, 1);
+	response = crud_client_operation(crud_request_encode(0, CRUD_INIT, 0, 0, 0), NULL);
+	crud_network_port = port;
+	crud_client_set_timeout(CRUD_CLIENT_TIMEOUT_MS, CRUD_CLIENT_RETRIES);
+	close(quiet);
+	crud_client_get_transport_stats(&after);
+	if (response != (uint64_t)-1 || after.timeouts != before.timeouts + 2 || session){
+		logMessage(LOG_ERROR_LEVEL, "CRUD client unit test failed, silent server did not time out");
+		return (-1);
+	}
 
+	logMessage(LOG_INFO_LEVEL, "CRUD client unit test successful.");
+	return (0);
+}
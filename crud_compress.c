@@ -0,0 +1,227 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_compress.c
+//  Description    : This is the payload compression codec.  The compressed
+//                   form is the original length (4 bytes, network order)
+//                   followed by tokens: a control byte below 0x80 is followed
+//                   by that many plus one literal bytes, a control byte of
+//                   0x80 or more repeats the next byte (control - 0x80 + 3)
+//                   times.
+//
+//  Author         : Xuejian Zhou
+//  Last Modified  : Mon Oct 19 2026
+//
+
+// Includes
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <arpa/inet.h>
+
+// Project includes
+#include <crud_compress.h>
+#include <cmpsc311_log.h>
+#include <cmpsc311_util.h>
+
+// Defines
+#define CRUD_RLE_MIN_RUN 3
+#define CRUD_RLE_MAX_RUN (0x7f + CRUD_RLE_MIN_RUN)
+#define CRUD_RLE_MAX_LITERAL 0x80
+#define CRUD_COMPRESS_TEST_SIZE 65536
+#define CRUD_COMPRESS_TEST_ROUNDS 200
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_compress
+// Description  : Run-length code a buffer
+//
+// Inputs       : src - the bytes to compress
+//                length - the number of bytes
+//                dst - the place to put the compressed bytes
+//                capacity - the room in dst
+// Outputs      : the compressed size, 0 if it would not fit in capacity
+
+uint32_t crud_compress(const void *src, uint32_t length, void *dst, uint32_t capacity) {
+
+	const uint8_t *in = src;
+	uint8_t *out = dst;
+	uint32_t i = 0, o = CRUD_COMPRESS_HEADER_SIZE, lit = 0, run, n;
+	uint32_t header = htonl(length);
+
+	if (capacity < CRUD_COMPRESS_HEADER_SIZE) {
+		return(0);
+	}
+	memcpy(out, &header, CRUD_COMPRESS_HEADER_SIZE);
+
+	while (i < length) {
+
+		// How long is the run starting here
+		run = 1;
+		while ((i + run < length) && (run < CRUD_RLE_MAX_RUN) && (in[i + run] == in[i])) {
+			run++;
+		}
+
+		// Short runs are left in the literals
+		if (run < CRUD_RLE_MIN_RUN) {
+			i += run;
+			lit += run;
+			if (i < length) {
+				continue;
+			}
+		}
+
+		// Flush the literals before this run (or at the end)
+		while (lit > 0) {
+			n = (lit > CRUD_RLE_MAX_LITERAL) ? CRUD_RLE_MAX_LITERAL : lit;
+			if (o + 1 + n > capacity) {
+				return(0);
+			}
+			out[o++] = (uint8_t)(n - 1);
+			memcpy(&out[o], &in[i - lit], n);
+			o += n;
+			lit -= n;
+		}
+		if (run < CRUD_RLE_MIN_RUN) {
+			break;
+		}
+
+		// Then the run
+		if (o + 2 > capacity) {
+			return(0);
+		}
+		out[o++] = (uint8_t)(0x80 + run - CRUD_RLE_MIN_RUN);
+		out[o++] = in[i];
+		i += run;
+	}
+
+	return(o);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_decompress
+// Description  : Undo crud_compress
+//
+// Inputs       : src - the compressed bytes
+//                length - the number of compressed bytes
+//                dst - the place to put the original bytes
+//                capacity - the room in dst
+// Outputs      : the original size, -1 if the data is bad or will not fit
+
+int32_t crud_decompress(const void *src, uint32_t length, void *dst, uint32_t capacity) {
+
+	const uint8_t *in = src;
+	uint8_t *out = dst;
+	uint32_t i = CRUD_COMPRESS_HEADER_SIZE, o = 0, size, n;
+
+	if (length < CRUD_COMPRESS_HEADER_SIZE) {
+		return(-1);
+	}
+	memcpy(&size, in, CRUD_COMPRESS_HEADER_SIZE);
+	size = ntohl(size);
+	if (size > capacity) {
+		return(-1);
+	}
+
+	while (i < length) {
+		if (in[i] < 0x80) {
+			n = in[i] + 1;
+			if ((i + 1 + n > length) || (o + n > size)) {
+				return(-1);
+			}
+			memcpy(&out[o], &in[i + 1], n);
+			i += 1 + n;
+		} else {
+			n = in[i] - 0x80 + CRUD_RLE_MIN_RUN;
+			if ((i + 2 > length) || (o + n > size)) {
+				return(-1);
+			}
+			memset(&out[o], in[i + 1], n);
+			i += 2;
+		}
+		o += n;
+	}
+
+	return((o == size) ? (int32_t)size : -1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_compress_unit_test
+// Description  : Round trip buffers made of random runs and literals through
+//                the codec, check it refuses buffers that do not shrink, and
+//                time it
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_compress_unit_test(void) {
+
+	// Local variables
+	uint8_t *raw, *packed, *back;
+	uint32_t length, i, n, wire = 0, total = 0;
+	int32_t got;
+	struct timeval start, stop;
+	int round;
+
+	raw = malloc(CRUD_COMPRESS_TEST_SIZE);
+	packed = malloc(CRUD_COMPRESS_TEST_SIZE + CRUD_COMPRESS_HEADER_SIZE);
+	back = malloc(CRUD_COMPRESS_TEST_SIZE);
+
+	gettimeofday(&start, NULL);
+	for (round = 0; round < CRUD_COMPRESS_TEST_ROUNDS; round++) {
+
+		// Runs of random lengths, some of random bytes
+		length = getRandomValue(0, CRUD_COMPRESS_TEST_SIZE);
+		for (i = 0; i < length; i += n) {
+			n = getRandomValue(1, (round % 4 == 0) ? 4 : 600);
+			if (i + n > length) {
+				n = length - i;
+			}
+			if (getRandomValue(0, 3) == 0) {
+				for (uint32_t k = 0; k < n; k++) {
+					raw[i + k] = getRandomValue(0, 0xff);
+				}
+			} else {
+				memset(&raw[i], getRandomValue(0, 0xff), n);
+			}
+		}
+
+		// There is always room for it, so it has to round trip
+		n = crud_compress(raw, length, packed, CRUD_COMPRESS_TEST_SIZE + CRUD_COMPRESS_HEADER_SIZE);
+		got = crud_decompress(packed, n, back, CRUD_COMPRESS_TEST_SIZE);
+		if ((n == 0) || (got != (int32_t)length) || memcmp(raw, back, length)) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD compress unit test failed, round %d [%u bytes, %d back]", round, length, got);
+			return(-1);
+		}
+
+		// Asking for it to get smaller has to fail cleanly when it does not
+		if ((n > 1) && (crud_compress(raw, length, packed, n - 1) != 0)) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD compress unit test failed, overran capacity %u", n - 1);
+			return(-1);
+		}
+		total += length;
+		wire += n;
+	}
+	gettimeofday(&stop, NULL);
+
+	// A cut off buffer is bad data
+	length = 1000;
+	memset(raw, 'a', length);
+	n = crud_compress(raw, length, packed, CRUD_COMPRESS_TEST_SIZE);
+	if (crud_decompress(packed, n - 1, back, CRUD_COMPRESS_TEST_SIZE) != -1) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD compress unit test failed, accepted a truncated buffer");
+		return(-1);
+	}
+
+	logMessage(LOG_INFO_LEVEL, "CRUD compress: %u bytes to %u in %ld usec (with test data generation)",
+			total, wire, compareTimes(&start, &stop));
+	free(raw);
+	free(packed);
+	free(back);
+	logMessage(LOG_INFO_LEVEL, "CRUD compress unit test successful.");
+	return(0);
+}
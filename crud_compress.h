@@ -0,0 +1,47 @@
+#ifndef CRUD_COMPRESS_INCLUDED
+#define CRUD_COMPRESS_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_compress.h
+//  Description    : This is the header file for the payload compression used
+//                   on the wire (when the server offers CRUD_COMPRESS_FLAG)
+//                   and for the local store's chunks.  The codec is a simple
+//                   run-length coder, the payloads are mostly long runs of
+//                   one character.
+//
+//  Author         : Xuejian Zhou
+//  Last Modified  : Mon Oct 19 2026
+//
+
+// Includes
+#include <stdint.h>
+
+// Defines
+#define CRUD_COMPRESS_THRESHOLD 256    // Payloads smaller than this are sent as they are
+#define CRUD_COMPRESS_HEADER_SIZE 4    // The original length, in network byte order
+
+// Compression counters (see crud_client_get_compression_stats)
+typedef struct {
+	uint64_t  payloads;                // Payloads sent or received compressed
+	uint64_t  raw_bytes;               // Their size before compression
+	uint64_t  wire_bytes;              // Their size compressed
+	uint64_t  skipped;                 // Payloads that did not get smaller
+	uint64_t  usec;                    // Time spent compressing and decompressing
+} CrudCompressionStats;
+
+//
+// Functional prototypes
+
+uint32_t crud_compress(const void *src, uint32_t length, void *dst, uint32_t capacity);
+	// Compress length bytes into dst, returns the compressed size or 0 if it
+	// would not be smaller than capacity
+
+int32_t crud_decompress(const void *src, uint32_t length, void *dst, uint32_t capacity);
+	// Decompress into dst, returns the original size or -1 if the data is bad
+	// or does not fit in capacity
+
+int crud_compress_unit_test(void);
+	// Check the codec on random runs and literals, and time it
+
+#endif
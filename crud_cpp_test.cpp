@@ -0,0 +1,105 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_cpp_test.cpp
+//  Description    : This is a small test program for the C++20 front end in
+//                   crud_file_io.hpp: a few coroutines each open a file, write
+//                   it in two pieces and read it back, all on one EventLoop.
+//                   It formats the store of the server it talks to, like
+//                   crud_client -u does.
+//
+//                     ./crud_local_server &
+//                     ./crud_cpp_test
+//
+//  Author         : Xuejian Zhou
+//  Last Modified  : Mon Oct 19 2026
+//
+
+// Includes
+#include <array>
+#include <cstdio>
+#include <cstring>
+
+// Project includes
+#include <crud_file_io.hpp>
+extern "C" {
+#include <cmpsc311_log.h>
+}
+
+// Defines
+#define CRUD_CPP_TEST_FILES 4
+#define CRUD_CPP_TEST_SIZE 3000
+
+// Global data
+static int failures = 0;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : roundtrip
+// Description  : Write a file through the awaitables and check it reads back
+//
+// Inputs       : loop - the event loop the coroutine resumes on
+//                index - which file to use
+// Outputs      : none (failures are counted)
+
+static crud::Task roundtrip(crud::EventLoop &loop, int index) {
+
+	char path[32];
+	std::array<std::byte, CRUD_CPP_TEST_SIZE> out, in;
+	std::size_t half = out.size() / 2;
+
+	// Each file gets its own pattern
+	snprintf(path, sizeof(path), "cpp_test_%d.txt", index);
+	for (std::size_t i = 0; i < out.size(); i++) {
+		out[i] = (std::byte)((i * 7 + index) & 0xff);
+	}
+
+	crud::File f = co_await crud::open(loop, path);
+	if (!f) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD C++ test : open of %s failed", path);
+		failures++;
+		co_return;
+	}
+
+	// Two writes (the second grows the object), then one read of the lot
+	int32_t first = co_await f.write(std::span(out).first(half), 0);
+	int32_t second = co_await f.write(std::span(out).subspan(half), (uint32_t)half);
+	int32_t got = co_await f.read(std::span(in), 0);
+	if ((first != (int32_t)half) || (second != (int32_t)(out.size() - half)) ||
+		(got != (int32_t)in.size()) || memcmp(out.data(), in.data(), in.size())) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD C++ test : %s read back wrong [%d, %d, %d]",
+			path, first, second, got);
+		failures++;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : main
+// Description  : Run the coroutines against the CRUD server
+//
+// Inputs       : none
+// Outputs      : 0 if successful test, -1 if failure
+
+int main(void) {
+
+	initializeLogWithFilehandle(CMPSC311_LOG_STDERR);
+	if (crud_format() || crud_mount()) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD C++ test : format/mount failed");
+		return (-1);
+	}
+
+	{
+		crud::EventLoop loop;
+		for (int i = 0; i < CRUD_CPP_TEST_FILES; i++) {
+			roundtrip(loop, i);
+		}
+		loop.run();
+	}
+
+	if (crud_unmount() || failures) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD C++ test failed.");
+		return (-1);
+	}
+	logMessage(LOG_OUTPUT_LEVEL, "CRUD C++ test completed successfully.");
+	return (0);
+}
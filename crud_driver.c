@@ -0,0 +1,1085 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_driver.c
+//  Description    : This is the implementation of the CRUD object store used
+//                   by the local server.  Objects are kept in memory in a
+//                   hash table keyed by OID.  Their contents are split into
+//                   fixed size chunks that are shared (reference counted)
+//                   between every object holding the same bytes, and kept
+//                   compressed when that makes them smaller.  The store
+//                   is saved to/loaded from a disk file, either deduplicated
+//                   or in the same layout as the reference server.
+//
+//  Author         : Xuejian Zhou
+//  Last Modified  : Mon Oct 19 2026
+//
+
+// Includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+
+// Project includes
+#include <crud_driver.h>
+#include <crud_compress.h>
+#include <crud_metrics.h>
+#include <crud_trace.h>
+#include <cmpsc311_log.h>
+#include <cmpsc311_util.h>
+
+// Defines
+#define CRUD_FIRST_OID 4096
+#define CRUD_STORE_BUCKETS 4096
+#define CRUD_UNIT_TEST_ITERATIONS 1000
+#define CRUD_CHUNK_SIZE 4096
+#define CRUD_CHUNK_BUCKETS 16384
+#define CRUD_DEDUP_MAGIC 0x44445243   // "CRDD", first word of a deduplicated store file
+#define CRUD_DEDUP_VERSION 2           // 2 added the stored size of each chunk
+
+// Type definitions
+
+// This is a piece of object contents, shared by every object that holds it
+typedef struct crud_chunk {
+	uint32_t            hash;   // CRC32C of the contents (the chunk table key)
+	uint32_t            length; // The size of the chunk in bytes
+	uint32_t            stored; // The size of data, less than length if compressed
+	uint32_t            refs;   // The number of object references to it
+	uint32_t            index;  // Position in the store file while saving
+	char               *data;   // The contents (crud_compress() form if compressed)
+	struct crud_chunk  *next;   // The next chunk in the bucket
+} CrudChunk;
+
+// This is an object in the store (chained in the hash table)
+typedef struct crud_object {
+	CrudOID             oid;     // The object identifier
+	uint8_t             flags;   // The flags the object was created with
+	uint32_t            length;  // The size of the object in bytes
+	uint32_t            nchunks; // The number of chunks holding the contents
+	CrudChunk         **chunks;  // The chunks, CRUD_CHUNK_SIZE bytes each but the last
+	struct crud_object *next;    // The next object in the bucket
+} CrudObject;
+
+//
+// Global data
+
+CrudObject *crud_store[CRUD_STORE_BUCKETS];  // The object hash table
+CrudOID     crud_next_oid = CRUD_FIRST_OID;  // The next OID to hand out
+uint32_t    crud_num_objects = 0;            // The number of objects stored
+CrudChunk  *crud_chunks[CRUD_CHUNK_BUCKETS]; // The chunk hash table
+uint32_t    crud_num_chunks = 0;             // The number of distinct chunks
+uint64_t    crud_chunk_bytes = 0;            // The bytes held in chunks
+uint64_t    crud_stored_bytes = 0;           // The bytes they take up compressed
+uint64_t    crud_object_bytes = 0;           // The bytes the objects add up to
+int         crud_store_compatible = 1;       // Save in the reference server's layout (the default)
+
+//
+// Functional prototypes
+
+CrudResponse bus_request(CrudRequest request, void *buf);
+CrudResponse bus_request_range(CrudRequest request, uint32_t offset, void *buf);
+CrudObject **find_crud_object(CrudOID oid);
+CrudObject *find_priority_object(void);
+CrudObject *create_crud_object(CrudOID oid, uint8_t flags, uint32_t length, void *buf);
+CrudObject *clone_crud_object(CrudObject *src, CrudOID oid);
+void delete_crud_object(CrudObject **link);
+void format_crud(void);
+int fill_crud_object(CrudObject *obj, void *buf);
+void release_crud_chunks(CrudChunk **chunks, uint32_t nchunks);
+CrudChunk *get_crud_chunk(void *data, uint32_t length);
+char *unpack_crud_chunk(CrudChunk *chunk, char *tmp);
+void copy_crud_object(CrudObject *obj, uint32_t offset, uint32_t length, char *buf);
+int crud_load_dedup_store(FILE *fhandle, char *fname);
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_bus_request
+// Description  : This is the bus interface for the object store, it performs
+//                the request against the store (and counts it).
+//
+// Inputs       : request - the request (see crud_driver.h)
+//                buf - the buffer holding CREATE/UPDATE data or to READ into
+// Outputs      : the response, with the R bit set if the request failed
+
+CrudResponse crud_bus_request(CrudRequest request, void *buf) {
+
+	struct timeval start, stop;
+	CrudResponse response;
+	CrudOID oid;
+	CRUD_REQUEST_TYPES req;
+	uint32_t length;
+	uint8_t flags, res;
+
+	deconstruct_crud_request(request, &oid, &req, &length, &flags, &res);
+	CRUD_PROBE4(store_entry, req, oid, length, flags);
+	gettimeofday(&start, NULL);
+	response = bus_request(request, buf);
+	gettimeofday(&stop, NULL);
+	deconstruct_crud_request(response, &oid, &req, &length, &flags, &res);
+	crud_metric_op(req, compareTimes(&start, &stop), res);
+	CRUD_PROBE4(store_return, req, oid, length, res);
+	return(response);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_bus_request_range
+// Description  : Read part of an object (and count it), see bus_request_range
+//
+// Inputs       : request - the READ request, length is the bytes wanted
+//                offset - the byte offset into the object
+//                buf - the buffer to read into
+// Outputs      : the response, with the R bit set if the request failed
+
+CrudResponse crud_bus_request_range(CrudRequest request, uint32_t offset, void *buf) {
+
+	struct timeval start, stop;
+	CrudResponse response;
+	CrudOID oid;
+	CRUD_REQUEST_TYPES req;
+	uint32_t length;
+	uint8_t flags, res;
+
+	deconstruct_crud_request(request, &oid, &req, &length, &flags, &res);
+	CRUD_PROBE4(store_entry, CRUD_READ, oid, length, flags);
+	gettimeofday(&start, NULL);
+	response = bus_request_range(request, offset, buf);
+	gettimeofday(&stop, NULL);
+	deconstruct_crud_request(response, &oid, &req, &length, &flags, &res);
+	crud_metric_op(CRUD_READ, compareTimes(&start, &stop), res);
+	CRUD_PROBE4(store_return, CRUD_READ, oid, length, res);
+	return(response);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bus_request
+// Description  : Perform a request against the store
+//
+// Inputs       : request - the request (see crud_driver.h)
+//                buf - the buffer holding CREATE/UPDATE data or to READ into
+// Outputs      : the response, with the R bit set if the request failed
+
+CrudResponse bus_request(CrudRequest request, void *buf) {
+
+	// Local variables
+	CrudOID oid;
+	CRUD_REQUEST_TYPES req;
+	uint32_t length;
+	uint8_t flags, res;
+	CrudObject **link, *obj;
+
+	// Pull the request apart
+	deconstruct_crud_request(request, &oid, &req, &length, &flags, &res);
+
+	// Figure out which object this is about (priority is addressed by flag)
+	link = NULL;
+	obj = NULL;
+	if ((req == CRUD_READ) || (req == CRUD_UPDATE) || (req == CRUD_DELETE) || (req == CRUD_CLONE)) {
+		if (flags & CRUD_PRIORITY_OBJECT) {
+			obj = find_priority_object();
+			if (obj != NULL) {
+				link = find_crud_object(obj->oid);
+			}
+		} else {
+			link = find_crud_object(oid);
+			obj = (link != NULL) ? *link : NULL;
+		}
+		if (obj == NULL) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD: %s of non-existent object [OID %u]",
+					CRUD_REQUEST_TYPE_LABLES[req], oid);
+			return(construct_crud_request(oid, req, length, flags, 1));
+		}
+		oid = obj->oid;
+	}
+
+	// Do the request
+	switch (req) {
+
+	case CRUD_INIT:  // Nothing to do, the store is always up
+	case CRUD_CLOSE:
+		break;
+
+	case CRUD_FORMAT: // Throw away every object
+		format_crud();
+		break;
+
+	case CRUD_CREATE: // Make a new object
+		if (flags & CRUD_PRIORITY_OBJECT) {
+			// There is only one priority object, replace any old one
+			if ((obj = find_priority_object()) != NULL) {
+				delete_crud_object(find_crud_object(obj->oid));
+			}
+		}
+		obj = create_crud_object(crud_next_oid, flags, length, buf);
+		if (obj == NULL) {
+			return(construct_crud_request(0, req, length, flags, 1));
+		}
+		crud_next_oid++;
+		oid = obj->oid;
+		break;
+
+	case CRUD_READ: // Copy the object out, ranged reads use the other entry
+		if (flags & CRUD_RANGE_FLAG) {
+			return(bus_request_range(request, 0, buf));
+		}
+		if (length < obj->length) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD: read buffer too small [OID %u, %u<%u]",
+					oid, length, obj->length);
+			return(construct_crud_request(oid, req, length, flags, 1));
+		}
+		copy_crud_object(obj, 0, obj->length, buf);
+		length = obj->length;
+		break;
+
+	case CRUD_CLONE: // Copy the object, sharing its chunks (there is one priority object)
+		if ((obj->flags & CRUD_PRIORITY_OBJECT) || ((obj = clone_crud_object(obj, crud_next_oid)) == NULL)) {
+			return(construct_crud_request(oid, req, length, flags, 1));
+		}
+		crud_next_oid++;
+		oid = obj->oid;
+		length = obj->length;
+		break;
+
+	case CRUD_UPDATE: // Overwrite the object, the size cannot change
+		if (length != obj->length) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD: update changes object size [OID %u, %u!=%u]",
+					oid, length, obj->length);
+			return(construct_crud_request(oid, req, length, flags, 1));
+		}
+		if (fill_crud_object(obj, buf)) {
+			return(construct_crud_request(oid, req, length, flags, 1));
+		}
+		break;
+
+	case CRUD_DELETE: // Remove the object
+		delete_crud_object(link);
+		length = 0;
+		break;
+
+	default:
+		logMessage(LOG_ERROR_LEVEL, "CRUD Driver Error: unkown request type (%u)", req);
+		return(construct_crud_request(oid, req, length, flags, 1));
+	}
+
+	// Return the successful response
+	return(construct_crud_request(oid, req, length, flags, 0));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bus_request_range
+// Description  : Read part of an object, the response length is the number
+//                of bytes copied (short when the range runs off the end)
+//
+// Inputs       : request - the READ request, length is the bytes wanted
+//                offset - the byte offset into the object
+//                buf - the buffer to read into
+// Outputs      : the response, with the R bit set if the request failed
+
+CrudResponse bus_request_range(CrudRequest request, uint32_t offset, void *buf) {
+
+	// Local variables
+	CrudOID oid;
+	CRUD_REQUEST_TYPES req;
+	uint32_t length;
+	uint8_t flags, res;
+	CrudObject **link, *obj;
+
+	// Find the object being read
+	deconstruct_crud_request(request, &oid, &req, &length, &flags, &res);
+	if (flags & CRUD_PRIORITY_OBJECT) {
+		obj = find_priority_object();
+	} else {
+		link = find_crud_object(oid);
+		obj = (link != NULL) ? *link : NULL;
+	}
+	if ((req != CRUD_READ) || (obj == NULL) || (offset > obj->length)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD: bad ranged read [OID %u, offset %u]", oid, offset);
+		return(construct_crud_request(oid, req, length, flags, 1));
+	}
+
+	// Clip to the end of the object and copy
+	if (length > obj->length - offset) {
+		length = obj->length - offset;
+	}
+	copy_crud_object(obj, offset, length, buf);
+	return(construct_crud_request(obj->oid, req, length, flags, 0));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_save_store
+// Description  : Write the contents of the CRUD store to disk file.  Each
+//                object is written whole (the reference server's layout),
+//                unless deduplicated saves were asked for with
+//                crud_set_store_compatible, then each chunk is written once.
+//
+// Inputs       : fname - the file to write
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_save_store(char *fname) {
+
+	// Local variables
+	FILE *fhandle;
+	CrudObject *obj;
+	CrudChunk *chunk;
+	uint32_t header[5], index, c;
+	char tmp[CRUD_CHUNK_SIZE];
+	int i, failed = 0;
+
+	// Open the file
+	logMessage(LOG_INFO_LEVEL, "Storing the CRUD store contents to [%s] ...", fname);
+	if ((fhandle = fopen(fname, "w")) == NULL) {
+		logMessage(LOG_ERROR_LEVEL, "Failure opening array data for store [%s], error=[%s]",
+				fname, strerror(errno));
+		return(-1);
+	}
+
+	// Reference layout: next OID and element count, then each element whole
+	if (crud_store_compatible) {
+		failed = (fwrite(&crud_next_oid, sizeof(crud_next_oid), 1, fhandle) != 1) ||
+			(fwrite(&crud_num_objects, sizeof(crud_num_objects), 1, fhandle) != 1);
+		for (i=0; (i<CRUD_STORE_BUCKETS) && !failed; i++) {
+			for (obj=crud_store[i]; (obj!=NULL) && !failed; obj=obj->next) {
+				failed = (fwrite(&obj->oid, sizeof(obj->oid), 1, fhandle) != 1) ||
+					(fwrite(&obj->flags, sizeof(obj->flags), 1, fhandle) != 1) ||
+					(fwrite(&obj->length, sizeof(obj->length), 1, fhandle) != 1);
+				for (c=0; (c<obj->nchunks) && !failed; c++) {
+					failed = (fwrite(unpack_crud_chunk(obj->chunks[c], tmp), 1, obj->chunks[c]->length, fhandle) !=
+						obj->chunks[c]->length);
+				}
+			}
+		}
+	}
+
+	// Deduplicated layout: header, the chunks, then the objects as chunk lists
+	else {
+		header[0] = CRUD_DEDUP_MAGIC;
+		header[1] = CRUD_DEDUP_VERSION;
+		header[2] = crud_next_oid;
+		header[3] = crud_num_chunks;
+		header[4] = crud_num_objects;
+		failed = (fwrite(header, sizeof(header), 1, fhandle) != 1);
+		index = 0;
+		for (i=0; (i<CRUD_CHUNK_BUCKETS) && !failed; i++) {
+			for (chunk=crud_chunks[i]; (chunk!=NULL) && !failed; chunk=chunk->next) {
+				chunk->index = index++;
+				failed = (fwrite(&chunk->length, sizeof(chunk->length), 1, fhandle) != 1) ||
+					(fwrite(&chunk->stored, sizeof(chunk->stored), 1, fhandle) != 1) ||
+					(fwrite(chunk->data, 1, chunk->stored, fhandle) != chunk->stored);
+			}
+		}
+		for (i=0; (i<CRUD_STORE_BUCKETS) && !failed; i++) {
+			for (obj=crud_store[i]; (obj!=NULL) && !failed; obj=obj->next) {
+				failed = (fwrite(&obj->oid, sizeof(obj->oid), 1, fhandle) != 1) ||
+					(fwrite(&obj->flags, sizeof(obj->flags), 1, fhandle) != 1) ||
+					(fwrite(&obj->length, sizeof(obj->length), 1, fhandle) != 1);
+				for (c=0; (c<obj->nchunks) && !failed; c++) {
+					failed = (fwrite(&obj->chunks[c]->index, sizeof(uint32_t), 1, fhandle) != 1);
+				}
+			}
+		}
+	}
+	if (failed) {
+		logMessage(LOG_ERROR_LEVEL, "Failure writing CRUD data [%s], error=[%s]",
+				fname, strerror(errno));
+		fclose(fhandle);
+		return(-1);
+	}
+
+	// Close and return successfully
+	fclose(fhandle);
+	logMessage(LOG_INFO_LEVEL, "Stored the disk array contents successfully [%u objects, %lu bytes in %u chunks of %lu bytes, %lu compressed].",
+			crud_num_objects, crud_object_bytes, crud_num_chunks, crud_chunk_bytes, crud_stored_bytes);
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_load_store
+// Description  : Read the contents of the storage device from a disk file
+//                (either layout).
+//
+// Inputs       : fname - the file to read
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_load_store(char *fname) {
+
+	// Local variables
+	FILE *fhandle;
+	CrudOID oid, next_oid;
+	uint32_t count, length, i;
+	uint8_t flags;
+	char *data;
+	int ret;
+
+	// Open the file, start with an empty store
+	if ((fhandle = fopen(fname, "r")) == NULL) {
+		logMessage(LOG_ERROR_LEVEL, "Failure opening CRUD data for read [%s], error=[%s]",
+				fname, strerror(errno));
+		return(-1);
+	}
+	format_crud();
+
+	// Read the next OID (or the deduplicated layout's magic) and element count
+	if (fread(&next_oid, sizeof(next_oid), 1, fhandle) != 1) {
+		logMessage(LOG_ERROR_LEVEL, "Failure reading CRUD initial data [%s], error=[%s]",
+				fname, strerror(errno));
+		fclose(fhandle);
+		return(-1);
+	}
+	if (next_oid == CRUD_DEDUP_MAGIC) {
+		ret = crud_load_dedup_store(fhandle, fname);
+		fclose(fhandle);
+		return(ret);
+	}
+	if (fread(&count, sizeof(count), 1, fhandle) != 1) {
+		logMessage(LOG_ERROR_LEVEL, "Failure reading CRUD initial data [%s], error=[%s]",
+				fname, strerror(errno));
+		fclose(fhandle);
+		return(-1);
+	}
+
+	// Now read each of the objects
+	data = malloc(CRUD_MAX_OBJECT_SIZE);
+	for (i=0; i<count; i++) {
+		if ((fread(&oid, sizeof(oid), 1, fhandle) != 1) ||
+			(fread(&flags, sizeof(flags), 1, fhandle) != 1) ||
+			(fread(&length, sizeof(length), 1, fhandle) != 1) ||
+			(length > CRUD_MAX_OBJECT_SIZE) ||
+			(fread(data, 1, length, fhandle) != length) ||
+			(create_crud_object(oid, flags, length, data) == NULL)) {
+			logMessage(LOG_ERROR_LEVEL, "Failure reading CRUD element content [%s], error=[%s]",
+					fname, strerror(errno));
+			free(data);
+			fclose(fhandle);
+			return(-1);
+		}
+	}
+	crud_next_oid = next_oid;
+
+	// Cleanup and return successfully
+	free(data);
+	fclose(fhandle);
+	logMessage(LOG_INFO_LEVEL, "CRUD: Object store loaded [%u objects, next OID %u]",
+			crud_num_objects, crud_next_oid);
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_set_store_compatible
+// Description  : Choose the layout crud_save_store writes
+//
+// Inputs       : compatible - 1 for the reference server's layout (every
+//                object whole), 0 for the deduplicated one
+// Outputs      : none
+
+void crud_set_store_compatible(int compatible) {
+	crud_store_compatible = compatible;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_unit_test
+// Description  : This function is used to test the CRUD store by doing
+//                random operations and checking them against a local copy.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_unit_test(void) {
+
+	// Local variables
+	CrudOID oid, roid;
+	CRUD_REQUEST_TYPES req;
+	uint32_t length, rlength, offset, i;
+	uint8_t flags, res;
+	CrudResponse response;
+	char *mirror, *tbuf;
+
+	// Start from an empty store with one object
+	mirror = malloc(CRUD_MAX_OBJECT_SIZE);
+	tbuf = malloc(CRUD_MAX_OBJECT_SIZE);
+	format_crud();
+	length = getRandomValue(1, 4096);
+	memset(mirror, 'a', length);
+	response = crud_bus_request(construct_crud_request(0, CRUD_CREATE, length, CRUD_NULL_FLAG, 0), mirror);
+	deconstruct_crud_request(response, &oid, &req, &rlength, &flags, &res);
+	if (res != 0) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_UNIT_TEST : Failure creating block.");
+		return(-1);
+	}
+
+	// Update, read back and range read the object a bunch of times
+	for (i=0; i<CRUD_UNIT_TEST_ITERATIONS; i++) {
+
+		// Change the contents, update the object
+		memset(mirror, getRandomValue(0, 0xff), getRandomValue(0, length));
+		response = crud_bus_request(construct_crud_request(oid, CRUD_UPDATE, length, CRUD_NULL_FLAG, 0), mirror);
+		deconstruct_crud_request(response, &roid, &req, &rlength, &flags, &res);
+		if (res != 0) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_UNIT_TEST : Failure updating block [%d].", i);
+			return(-1);
+		}
+
+		// Read the whole thing
+		response = crud_bus_request(construct_crud_request(oid, CRUD_READ, CRUD_MAX_OBJECT_SIZE, CRUD_NULL_FLAG, 0), tbuf);
+		deconstruct_crud_request(response, &roid, &req, &rlength, &flags, &res);
+		if ((res != 0) || (rlength != length) || (memcmp(mirror, tbuf, length))) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_UNIT_TEST : Failure read comparison block.");
+			return(-1);
+		}
+
+		// Read some range of it (possibly past the end)
+		offset = getRandomValue(0, length);
+		rlength = getRandomValue(0, length);
+		response = crud_bus_request_range(construct_crud_request(oid, CRUD_READ, rlength, CRUD_RANGE_FLAG, 0), offset, tbuf);
+		deconstruct_crud_request(response, &roid, &req, &rlength, &flags, &res);
+		if ((res != 0) || (offset+rlength > length) || (memcmp(&mirror[offset], tbuf, rlength))) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_UNIT_TEST : Failure reading block.");
+			return(-1);
+		}
+	}
+
+	// A copy of the object has to share all of its chunks, until it changes
+	i = crud_num_chunks;
+	response = crud_bus_request(construct_crud_request(0, CRUD_CREATE, length, CRUD_NULL_FLAG, 0), mirror);
+	deconstruct_crud_request(response, &roid, &req, &rlength, &flags, &res);
+	if ((res != 0) || (crud_num_chunks != i)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_UNIT_TEST : copy was not deduplicated [%u != %u chunks].", crud_num_chunks, i);
+		return(-1);
+	}
+	mirror[0] ^= 0xff;
+	crud_bus_request(construct_crud_request(roid, CRUD_UPDATE, length, CRUD_NULL_FLAG, 0), mirror);
+	response = crud_bus_request(construct_crud_request(roid, CRUD_READ, length, CRUD_NULL_FLAG, 0), tbuf);
+	deconstruct_crud_request(response, &roid, &req, &rlength, &flags, &res);
+	if ((res != 0) || memcmp(mirror, tbuf, length) || (crud_num_chunks != i + 1)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_UNIT_TEST : changed copy is wrong [%u chunks].", crud_num_chunks);
+		return(-1);
+	}
+	mirror[0] ^= 0xff;
+	response = crud_bus_request(construct_crud_request(oid, CRUD_READ, length, CRUD_NULL_FLAG, 0), tbuf);
+	deconstruct_crud_request(response, &oid, &req, &rlength, &flags, &res);
+	if ((res != 0) || memcmp(mirror, tbuf, length)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_UNIT_TEST : changing a copy changed the original.");
+		return(-1);
+	}
+	crud_bus_request(construct_crud_request(roid, CRUD_DELETE, 0, CRUD_NULL_FLAG, 0), NULL);
+	if (crud_num_chunks != i) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_UNIT_TEST : deleting the copy leaked chunks [%u != %u].", crud_num_chunks, i);
+		return(-1);
+	}
+
+	// A clone shares everything without the bytes going anywhere, until it is written
+	response = crud_bus_request(construct_crud_request(oid, CRUD_CLONE, 0, CRUD_NULL_FLAG, 0), NULL);
+	deconstruct_crud_request(response, &roid, &req, &rlength, &flags, &res);
+	if ((res != 0) || (roid == oid) || (rlength != length) || (crud_num_chunks != i)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_UNIT_TEST : clone failed or copied chunks [%u != %u].", crud_num_chunks, i);
+		return(-1);
+	}
+	mirror[length - 1] ^= 0xff;
+	crud_bus_request(construct_crud_request(roid, CRUD_UPDATE, length, CRUD_NULL_FLAG, 0), mirror);
+	mirror[length - 1] ^= 0xff;
+	response = crud_bus_request(construct_crud_request(oid, CRUD_READ, length, CRUD_NULL_FLAG, 0), tbuf);
+	deconstruct_crud_request(response, &oid, &req, &rlength, &flags, &res);
+	if ((res != 0) || memcmp(mirror, tbuf, length)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_UNIT_TEST : writing a clone changed the original.");
+		return(-1);
+	}
+	crud_bus_request(construct_crud_request(roid, CRUD_DELETE, 0, CRUD_NULL_FLAG, 0), NULL);
+	if (crud_num_chunks != i) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_UNIT_TEST : deleting the clone leaked chunks [%u != %u].", crud_num_chunks, i);
+		return(-1);
+	}
+
+	// A chunk of one byte over and over has to be kept compressed, and come back whole
+	memset(tbuf, 'z', CRUD_CHUNK_SIZE);
+	response = crud_bus_request(construct_crud_request(0, CRUD_CREATE, CRUD_CHUNK_SIZE, CRUD_NULL_FLAG, 0), tbuf);
+	deconstruct_crud_request(response, &roid, &req, &rlength, &flags, &res);
+	if ((res != 0) || ((*find_crud_object(roid))->chunks[0]->stored >= CRUD_CHUNK_SIZE / 16)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_UNIT_TEST : run chunk was not compressed.");
+		return(-1);
+	}
+	memset(tbuf, 0x0, CRUD_CHUNK_SIZE);
+	response = crud_bus_request(construct_crud_request(roid, CRUD_READ, CRUD_CHUNK_SIZE, CRUD_NULL_FLAG, 0), tbuf);
+	deconstruct_crud_request(response, &roid, &req, &rlength, &flags, &res);
+	for (offset=0; (res == 0) && (offset<CRUD_CHUNK_SIZE) && (tbuf[offset] == 'z'); offset++);
+	if (offset != CRUD_CHUNK_SIZE) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_UNIT_TEST : compressed chunk read back wrong at %u.", offset);
+		return(-1);
+	}
+	crud_bus_request(construct_crud_request(roid, CRUD_DELETE, 0, CRUD_NULL_FLAG, 0), NULL);
+
+	// Delete it and make sure it is gone
+	crud_bus_request(construct_crud_request(oid, CRUD_DELETE, 0, CRUD_NULL_FLAG, 0), NULL);
+	response = crud_bus_request(construct_crud_request(oid, CRUD_READ, length, CRUD_NULL_FLAG, 0), tbuf);
+	deconstruct_crud_request(response, &roid, &req, &rlength, &flags, &res);
+	if ((res == 0) || (crud_num_chunks != 0)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_UNIT_TEST : Failure deleting block [%d].", i);
+		return(-1);
+	}
+
+	// Cleanup and return successfully
+	free(mirror);
+	free(tbuf);
+	logMessage(LOG_INFO_LEVEL, "CRUD_UNIT_TEST : store unit test successful.");
+	return(0);
+}
+
+//
+// Local functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : find_crud_object
+// Description  : Find the link in the hash table pointing at an object
+//
+// Inputs       : oid - the object to find
+// Outputs      : pointer to the link holding the object, NULL if not found
+
+CrudObject **find_crud_object(CrudOID oid) {
+
+	CrudObject **link = &crud_store[oid % CRUD_STORE_BUCKETS];
+	while (*link != NULL) {
+		if ((*link)->oid == oid) {
+			return(link);
+		}
+		link = &(*link)->next;
+	}
+	return(NULL);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : find_priority_object
+// Description  : Find the priority object in the store
+//
+// Inputs       : none
+// Outputs      : the object, NULL if there is none
+
+CrudObject *find_priority_object(void) {
+
+	CrudObject *obj;
+	int i;
+
+	for (i=0; i<CRUD_STORE_BUCKETS; i++) {
+		for (obj=crud_store[i]; obj!=NULL; obj=obj->next) {
+			if (obj->flags & CRUD_PRIORITY_OBJECT) {
+				return(obj);
+			}
+		}
+	}
+	return(NULL);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : create_crud_object
+// Description  : Add an object to the store
+//
+// Inputs       : oid - the OID to give the object
+//                flags - the object flags
+//                length - the object size
+//                buf - the contents
+// Outputs      : the new object, NULL if failure
+
+CrudObject *create_crud_object(CrudOID oid, uint8_t flags, uint32_t length, void *buf) {
+
+	CrudObject *obj;
+
+	// Don't allow two objects with one OID
+	if (find_crud_object(oid) != NULL) {
+		logMessage(LOG_ERROR_LEVEL, "Inserting new object that already exists [OID=%d]", oid);
+		return(NULL);
+	}
+
+	// Make the object, share its contents, and put it at the front of its bucket
+	obj = malloc(sizeof(CrudObject));
+	if (obj == NULL) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD: object allocation failed [%u bytes]", length);
+		return(NULL);
+	}
+	crud_metric_add(CRUD_METRIC_ALLOCATIONS, 1);
+	crud_metric_add(CRUD_METRIC_ALLOC_BYTES, sizeof(CrudObject));
+	obj->oid = oid;
+	obj->flags = flags & CRUD_PRIORITY_OBJECT;
+	obj->length = length;
+	obj->nchunks = 0;
+	obj->chunks = NULL;
+	if (fill_crud_object(obj, buf)) {
+		free(obj);
+		return(NULL);
+	}
+	crud_object_bytes += length;
+	obj->next = crud_store[oid % CRUD_STORE_BUCKETS];
+	crud_store[oid % CRUD_STORE_BUCKETS] = obj;
+	crud_num_objects++;
+
+	logMessage(LOG_INFO_LEVEL, "CRUD: new object [OID %u], length %d bytes", oid, length);
+	return(obj);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : clone_crud_object
+// Description  : Add an object with the same contents as another, taking a
+//                reference to each of its chunks instead of copying them
+//
+// Inputs       : src - the object to copy
+//                oid - the new object's OID
+// Outputs      : the new object, NULL if failure
+
+CrudObject *clone_crud_object(CrudObject *src, CrudOID oid) {
+
+	CrudObject *obj;
+	uint32_t c;
+
+	if (find_crud_object(oid) != NULL) {
+		logMessage(LOG_ERROR_LEVEL, "Inserting new object that already exists [OID=%d]", oid);
+		return(NULL);
+	}
+	obj = malloc(sizeof(CrudObject));
+	if ((obj == NULL) || ((obj->chunks = malloc((src->nchunks ? src->nchunks : 1) * sizeof(CrudChunk *))) == NULL)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD: object allocation failed [%u bytes]", src->length);
+		free(obj);
+		return(NULL);
+	}
+	crud_metric_add(CRUD_METRIC_ALLOCATIONS, 2);
+	crud_metric_add(CRUD_METRIC_ALLOC_BYTES, sizeof(CrudObject) + (src->nchunks ? src->nchunks : 1) * sizeof(CrudChunk *));
+	obj->oid = oid;
+	obj->flags = CRUD_NULL_FLAG;
+	obj->length = src->length;
+	obj->nchunks = src->nchunks;
+	for (c=0; c<src->nchunks; c++) {
+		obj->chunks[c] = src->chunks[c];
+		obj->chunks[c]->refs++;
+	}
+	crud_object_bytes += obj->length;
+	obj->next = crud_store[oid % CRUD_STORE_BUCKETS];
+	crud_store[oid % CRUD_STORE_BUCKETS] = obj;
+	crud_num_objects++;
+
+	logMessage(LOG_INFO_LEVEL, "CRUD: cloned object [OID %u] as [OID %u], length %d bytes", src->oid, oid, obj->length);
+	return(obj);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : delete_crud_object
+// Description  : Remove an object from the store
+//
+// Inputs       : link - the hash table link pointing at the object
+// Outputs      : none
+
+void delete_crud_object(CrudObject **link) {
+
+	CrudObject *obj = *link;
+	*link = obj->next;
+	release_crud_chunks(obj->chunks, obj->nchunks);
+	free(obj->chunks);
+	crud_object_bytes -= obj->length;
+	free(obj);
+	crud_num_objects--;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : format_crud
+// Description  : Remove every object from the store
+//
+// Inputs       : none
+// Outputs      : none
+
+void format_crud(void) {
+
+	CrudChunk *chunk;
+	int i;
+
+	for (i=0; i<CRUD_STORE_BUCKETS; i++) {
+		while (crud_store[i] != NULL) {
+			delete_crud_object(&crud_store[i]);
+		}
+	}
+
+	// Anything left was only held by a failed load
+	for (i=0; i<CRUD_CHUNK_BUCKETS; i++) {
+		while ((chunk = crud_chunks[i]) != NULL) {
+			crud_chunks[i] = chunk->next;
+			free(chunk->data);
+			free(chunk);
+		}
+	}
+	crud_num_chunks = 0;
+	crud_chunk_bytes = 0;
+	crud_stored_bytes = 0;
+	crud_next_oid = CRUD_FIRST_OID;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fill_crud_object
+// Description  : Set the contents of an object, sharing any chunk the store
+//                already has.  The old chunks are let go after the new ones
+//                are found, so unchanged chunks are never freed.
+//
+// Inputs       : obj - the object (length is the size of the new contents)
+//                buf - the contents
+// Outputs      : 0 if successful, -1 if failure
+
+int fill_crud_object(CrudObject *obj, void *buf) {
+
+	uint32_t nchunks = (obj->length + CRUD_CHUNK_SIZE - 1) / CRUD_CHUNK_SIZE;
+	uint32_t c, size;
+	CrudChunk **chunks;
+
+	chunks = malloc((nchunks ? nchunks : 1) * sizeof(CrudChunk *));
+	if (chunks == NULL) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD: object allocation failed [%u bytes]", obj->length);
+		return(-1);
+	}
+	crud_metric_add(CRUD_METRIC_ALLOCATIONS, 1);
+	crud_metric_add(CRUD_METRIC_ALLOC_BYTES, (nchunks ? nchunks : 1) * sizeof(CrudChunk *));
+	for (c=0; c<nchunks; c++) {
+		size = obj->length - c * CRUD_CHUNK_SIZE;
+		if (size > CRUD_CHUNK_SIZE) {
+			size = CRUD_CHUNK_SIZE;
+		}
+		if ((chunks[c] = get_crud_chunk((char *)buf + c * CRUD_CHUNK_SIZE, size)) == NULL) {
+			release_crud_chunks(chunks, c);
+			free(chunks);
+			return(-1);
+		}
+	}
+	release_crud_chunks(obj->chunks, obj->nchunks);
+	free(obj->chunks);
+	obj->chunks = chunks;
+	obj->nchunks = nchunks;
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : get_crud_chunk
+// Description  : Find the chunk holding these bytes, or add one, and take a
+//                reference to it
+//
+// Inputs       : data - the bytes
+//                length - the number of bytes
+// Outputs      : the chunk, NULL if failure
+
+CrudChunk *get_crud_chunk(void *data, uint32_t length) {
+
+	uint32_t hash = crc32c(0, data, length), stored = 0;
+	CrudChunk **link = &crud_chunks[hash % CRUD_CHUNK_BUCKETS];
+	CrudChunk *chunk;
+	char packed[CRUD_CHUNK_SIZE];
+
+	// Keep it compressed if that saves anything, the compressed form of
+	// the same bytes is always the same so it can be compared as is
+	if (length >= CRUD_COMPRESS_THRESHOLD) {
+		stored = crud_compress(data, length, packed, length - 1);
+	}
+	if (stored > 0) {
+		data = packed;
+	} else {
+		stored = length;
+	}
+
+	// The hash only finds candidates, the bytes have to match too
+	for (chunk=*link; chunk!=NULL; chunk=chunk->next) {
+		if ((chunk->hash == hash) && (chunk->length == length) && (chunk->stored == stored) &&
+			!memcmp(chunk->data, data, stored)) {
+			chunk->refs++;
+			crud_metric_add(CRUD_METRIC_CHUNK_HITS, 1);
+			return(chunk);
+		}
+	}
+	crud_metric_add(CRUD_METRIC_CHUNK_MISSES, 1);
+
+	// New contents
+	chunk = malloc(sizeof(CrudChunk));
+	if ((chunk == NULL) || ((chunk->data = malloc(stored)) == NULL)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD: chunk allocation failed [%u bytes]", stored);
+		free(chunk);
+		return(NULL);
+	}
+	crud_metric_add(CRUD_METRIC_ALLOCATIONS, 2);
+	crud_metric_add(CRUD_METRIC_ALLOC_BYTES, sizeof(CrudChunk) + stored);
+	chunk->hash = hash;
+	chunk->length = length;
+	chunk->stored = stored;
+	chunk->refs = 1;
+	memcpy(chunk->data, data, stored);
+	chunk->next = *link;
+	*link = chunk;
+	crud_num_chunks++;
+	crud_chunk_bytes += length;
+	crud_stored_bytes += stored;
+	return(chunk);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : unpack_crud_chunk
+// Description  : Get at the contents of a chunk, decompressing them if needed
+//
+// Inputs       : chunk - the chunk
+//                tmp - CRUD_CHUNK_SIZE bytes to decompress into
+// Outputs      : the contents (the chunk's own data or tmp)
+
+char *unpack_crud_chunk(CrudChunk *chunk, char *tmp) {
+
+	if (chunk->stored == chunk->length) {
+		return(chunk->data);
+	}
+	crud_decompress(chunk->data, chunk->stored, tmp, CRUD_CHUNK_SIZE);
+	return(tmp);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : release_crud_chunks
+// Description  : Drop a reference to each chunk, freeing the ones no object
+//                holds any more
+//
+// Inputs       : chunks - the chunks
+//                nchunks - the number of chunks
+// Outputs      : none
+
+void release_crud_chunks(CrudChunk **chunks, uint32_t nchunks) {
+
+	CrudChunk **link;
+	uint32_t c;
+
+	for (c=0; c<nchunks; c++) {
+		if (--chunks[c]->refs > 0) {
+			continue;
+		}
+		link = &crud_chunks[chunks[c]->hash % CRUD_CHUNK_BUCKETS];
+		while (*link != chunks[c]) {
+			link = &(*link)->next;
+		}
+		*link = chunks[c]->next;
+		crud_num_chunks--;
+		crud_chunk_bytes -= chunks[c]->length;
+		crud_stored_bytes -= chunks[c]->stored;
+		free(chunks[c]->data);
+		free(chunks[c]);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : copy_crud_object
+// Description  : Copy part of an object's contents out of its chunks
+//
+// Inputs       : obj - the object
+//                offset - where to start in the object
+//                length - the number of bytes (must be inside the object)
+//                buf - the place to put them
+// Outputs      : none
+
+void copy_crud_object(CrudObject *obj, uint32_t offset, uint32_t length, char *buf) {
+
+	uint32_t c = offset / CRUD_CHUNK_SIZE, skip = offset % CRUD_CHUNK_SIZE, size;
+	char tmp[CRUD_CHUNK_SIZE];
+
+	while (length > 0) {
+		size = obj->chunks[c]->length - skip;
+		if (size > length) {
+			size = length;
+		}
+		memcpy(buf, &unpack_crud_chunk(obj->chunks[c], tmp)[skip], size);
+		buf += size;
+		length -= size;
+		skip = 0;
+		c++;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_load_dedup_store
+// Description  : Read the rest of a deduplicated store file (after the magic)
+//
+// Inputs       : fhandle - the open store file
+//                fname - the file name (for messages)
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_load_dedup_store(FILE *fhandle, char *fname) {
+
+	// Local variables
+	uint32_t header[4], i, c, length, stored, index;
+	CrudChunk **chunks = NULL;
+	CrudOID oid;
+	uint8_t flags;
+	char *data, packed[CRUD_CHUNK_SIZE];
+	int failed;
+
+	// Version, next OID, chunk count and object count (version 1 chunks are
+	// never compressed)
+	data = malloc(CRUD_MAX_OBJECT_SIZE);
+	failed = (data == NULL) || (fread(header, sizeof(header), 1, fhandle) != 1) ||
+		(header[0] < 1) || (header[0] > CRUD_DEDUP_VERSION);
+	if (!failed) {
+		chunks = malloc((header[2] ? header[2] : 1) * sizeof(CrudChunk *));
+		failed = (chunks == NULL);
+	}
+
+	// The chunks, each one referenced by the loader until the end
+	for (i=0; !failed && (i<header[2]); i++) {
+		failed = (fread(&length, sizeof(length), 1, fhandle) != 1) || (length > CRUD_CHUNK_SIZE);
+		stored = length;
+		if (!failed && (header[0] > 1)) {
+			failed = (fread(&stored, sizeof(stored), 1, fhandle) != 1) || (stored > length);
+		}
+		if (!failed && (stored < length)) {
+			failed = (fread(packed, 1, stored, fhandle) != stored) ||
+				(crud_decompress(packed, stored, data, length) != (int32_t)length);
+		} else if (!failed) {
+			failed = (fread(data, 1, length, fhandle) != length);
+		}
+		failed = failed || ((chunks[i] = get_crud_chunk(data, length)) == NULL);
+	}
+
+	// The objects, each a list of chunk numbers
+	for (i=0; !failed && (i<header[3]); i++) {
+		failed = (fread(&oid, sizeof(oid), 1, fhandle) != 1) ||
+			(fread(&flags, sizeof(flags), 1, fhandle) != 1) ||
+			(fread(&length, sizeof(length), 1, fhandle) != 1) ||
+			(length > CRUD_MAX_OBJECT_SIZE);
+		for (c=0; !failed && (c<(length + CRUD_CHUNK_SIZE - 1) / CRUD_CHUNK_SIZE); c++) {
+			// every chunk fills its slot but the last, which ends the object
+			failed = (fread(&index, sizeof(index), 1, fhandle) != 1) || (index >= header[2]) ||
+				(chunks[index]->length != ((length - c * CRUD_CHUNK_SIZE < CRUD_CHUNK_SIZE) ?
+					length - c * CRUD_CHUNK_SIZE : CRUD_CHUNK_SIZE));
+			if (!failed) {
+				memcpy(&data[c * CRUD_CHUNK_SIZE], unpack_crud_chunk(chunks[index], packed),
+						chunks[index]->length);
+			}
+		}
+		failed = failed || (create_crud_object(oid, flags, length, data) == NULL);
+	}
+	if (chunks != NULL) {
+		release_crud_chunks(chunks, failed ? 0 : header[2]);
+	}
+	free(chunks);
+	free(data);
+	if (failed) {
+		logMessage(LOG_ERROR_LEVEL, "Failure reading CRUD element content [%s], error=[%s]",
+				fname, strerror(errno));
+		format_crud();
+		return(-1);
+	}
+
+	crud_next_oid = header[1];
+	logMessage(LOG_INFO_LEVEL, "CRUD: Object store loaded [%u objects, %u chunks, next OID %u]",
+			crud_num_objects, crud_num_chunks, crud_next_oid);
+	return(0);
+}
@@ -17,6 +17,8 @@
 // Defines
 #define CRUD_MAX_OBJECT_SIZE 0xfffff
 #define CRUD_NO_OBJECT 0
+#define CRUD_RANGE_HEADER_SIZE sizeof(uint64_t)
+#define CRUD_FEATURE_CLONE 0x1 // CRUD_INIT response Length bit: CRUD_CLONE is served
 
 //
 // Type definitions
@@ -33,22 +35,34 @@ typedef enum {
 	CRUD_DELETE  = 5, // Delete an object
 	CRUD_CLOSE   = 6, // Close the CRUD device
 	CRUD_UNKNOWN = 7, // Unknown type
-	CRUD_MAXVAL  = 8, // Max value
+	CRUD_CLONE   = 8, // Copy an object, sharing its contents (CRUD_FEATURE_CLONE)
+	CRUD_MAXVAL  = 9, // Max value
 } CRUD_REQUEST_TYPES;
-const char *CRUD_REQUEST_TYPE_LABLES[CRUD_MAXVAL];
+extern const char *CRUD_REQUEST_TYPE_LABLES[CRUD_MAXVAL];
 
 // These are the CRUD flags
 typedef enum {
 	CRUD_NULL_FLAG       = 0,  // This is the "no flag" flag
 	CRUD_PRIORITY_OBJECT = 1,  // Flag indicating that object is a "priority object"
-	CRUD_FLAGMAX         = 2,  // Max value
+	CRUD_RANGE_FLAG      = 2,  // READ of a byte range, offset word follows header
+	CRUD_COMPRESS_FLAG   = 4,  // Payload is compressed (crud_compress.h)
+	CRUD_FLAGMAX         = 5,  // Max value
 } CRUD_FLAG_TYPES;
-const char *CRUD_FLAG_TYPE_LABLES[CRUD_FLAGMAX];
+extern const char *CRUD_FLAG_TYPE_LABLES[CRUD_FLAGMAX];
 
 // CRUD request and response types
 typedef uint64_t CrudRequest;
 typedef uint64_t CrudResponse;
 
+// One line of a simulator workload file: "<file> <COMMAND> <len> <off> :<text>"
+typedef struct {
+	char     fname[128];    // The file the command is for
+	char     command[128];  // FORMAT, MOUNT, UNMOUNT, WRITE, WRITEAT, SEEK, READ
+	int32_t  len;           // The length (or expected result)
+	int32_t  off;           // The offset
+	char    *text;          // The text after the ':' (WRITE data, still encoded)
+} CrudWorkloadLine;
+
 /*
 
  Request/Response Specification
@@ -66,9 +80,27 @@ typedef uint64_t CrudResponse;
    0-31 - OID - the object ID (0 if not relevant)
   32-35 - Request type - this is the request type (CRUD_REQUEST_TYPES)
   36-59 - Length - this is the size of the object in bytes
-  60-62 - Flags - these are flags for commands (UNUSED)
+  60-62 - Flags - these are flags for commands (CRUD_FLAG_TYPES bits)
      63 - R - this is the result bit (0 success, 1 is failure)
 
+ Ranged reads: a CRUD_READ carrying CRUD_RANGE_FLAG is followed by a 64-bit
+ word (network byte order) holding the byte offset into the object.  Length
+ is the number of bytes wanted, and the response length is the number of
+ bytes actually returned (short at the end of the object).  Servers that
+ support it set CRUD_RANGE_FLAG in the flags of their CRUD_INIT response.
+
+ Compression: servers that set CRUD_COMPRESS_FLAG in their CRUD_INIT response
+ accept CRUD_CREATE/CRUD_UPDATE payloads in crud_compress() form; the request
+ carries the flag and Length is the compressed size.  A CRUD_READ carrying the
+ flag lets the server answer in the same form, in which case the response
+ carries the flag and Length is the compressed size.  The flag never reaches
+ the store, responses to writes are for the uncompressed object.
+
+ Clones: a CRUD_CLONE of an object (not the priority object) makes a new
+ object with the same contents and answers with its OID and Length.  The two
+ share storage until either one is written.  Servers that serve it set
+ CRUD_FEATURE_CLONE in the Length of their CRUD_INIT response.
+
 */
 
 //
@@ -77,12 +109,18 @@ typedef uint64_t CrudResponse;
 CrudResponse crud_bus_request( CrudRequest request, void *buf );
 	// This is the interface to the CRUD interfaces
 
+CrudResponse crud_bus_request_range( CrudRequest request, uint32_t offset, void *buf );
+	// Read length bytes starting at offset of an object (CRUD_RANGE_FLAG reads)
+
 int crud_save_store(char *fname);
 	// Write the contents of the CRUD store to disk file.
 
 int crud_load_store(char *fname);
 	// Read the contents of the storage device from a disk file.
 
+void crud_set_store_compatible(int compatible);
+	// Save the store in the reference server's layout (1) or deduplicated (0)
+
 //
 // Unit testing for the module
 
@@ -101,4 +139,10 @@ int deconstruct_crud_request(CrudRequest request, CrudOID *oid,
 		uint8_t *res);
     // Extract values from a 64-bit bus request buffer
 
+int crud_parse_workload_line(char *line, CrudWorkloadLine *op);
+    // Split a workload file line into its fields
+
+int32_t crud_workload_text(CrudWorkloadLine *op, char *text);
+    // Copy out the len bytes of WRITE data, decoding '*' as a newline
+
 #endif
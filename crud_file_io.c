@@ -10,16 +10,46 @@
 
 // Includes
 #include <malloc.h>
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/time.h>
 #include <crud_file_io.h>
 #include <crud_driver.h>
+#include <crud_request.h>
+#include <crud_metrics.h>
+#include <crud_trace.h>
 #include <cmpsc311_log.h>
 #include <cmpsc311_util.h>
 #include <crud_network.h>
 
 #define CIO_UNIT_TEST_MAX_WRITE_SIZE 1024
 #define CRUD_IO_UNIT_TEST_ITERATIONS 10240
+#define CRUD_IO_UNIT_TEST_BULK_FILES 100
+#define CRUD_IO_UNIT_TEST_VECTOR_ROUNDS 200
+#define CRUD_IO_UNIT_TEST_MAX_VECTORS 8
+#define CRUD_IO_UNIT_TEST_ASYNC_ROUNDS 100
+#define CRUD_IO_UNIT_TEST_ASYNC_OPS 32
+#define CRUD_ASYNC_MAX_OPS 256
+#define CRUD_SCHED_META_WEIGHT 8
+#define CRUD_SCHED_READ_WEIGHT 4
+#define CRUD_SCHED_BULK_WEIGHT 1
+#define CRUD_SCHED_BULK_BYTES 65536
+#define CRUD_READAHEAD_MIN 4096
+#define CRUD_READAHEAD_MAX 65536
+#define CRUD_READAHEAD_PASS -2
+#define CRUD_TABLE_MAGIC 0x54445243
+#define CRUD_TABLE_VERSION 2
+#define CRUD_V1_TABLE_FILES 1024
+#define CRUD_SYNC_INTERVAL 5
+#define CRUD_CREATE_BATCH 32
+#define CRUD_PAGE_FILTER_BYTES 256
+#define CRUD_PAGE_FILTER_HASHES 4
+#define CRUD_PAGE_SIZE (CRUD_FILE_TABLE_PAGE * (sizeof(page_entry) + CRUD_MAX_PATH_LENGTH))
+#define CRUD_TABLE_MAX_PAGES ((CRUD_MAX_TOTAL_FILES + CRUD_FILE_TABLE_PAGE) / CRUD_FILE_TABLE_PAGE)
+#define CRUD_TABLE_SIZE (sizeof(table_header) + CRUD_TABLE_MAX_PAGES * sizeof(page_summary))
 
 // when the flag is 0 , it means the curd is not initialzed yet 
 int flag = 0 ;
@@ -44,23 +74,186 @@ typedef struct{
 }Cruid;
 
 
+// The file table is split in two: the fields every read/write touches are kept
+// in a small array indexed by fd, and the names (only needed by crud_open) are
+// kept apart, with a hash index from name to fd.  Both grow a page of entries
+// at a time (CRUD_FILE_TABLE_PAGE) up to CRUD_MAX_TOTAL_FILES.
 typedef struct{
-	
+
+	uint32_t oid;
+	uint32_t length;
+	uint32_t current_position;
+	uint32_t checksum;    // CRC32C of the object, 0 if not known
+	uint8_t open;
+
+}file;
+
+file *File = NULL;
+char (*Names)[CRUD_MAX_PATH_LENGTH] = NULL;
+int16_t *NameIndex = NULL;       // fd+1 of the file with that name, 0 if empty
+uint32_t name_index_size = 0;    // slots in NameIndex (a power of two)
+uint32_t file_count = 0;         // entries in use, up to the last one
+uint32_t page_count = 0;         // pages of entries the table has room for
+CrudOID *PageOid = NULL;         // object holding each page, 0 if not written yet
+uint8_t *PageLoaded = NULL;      // whether each page has been read in
+uint8_t *PageDirty = NULL;       // whether each page changed since it was last written
+uint8_t header_dirty = 0;        // whether the priority object needs writing
+uint32_t sync_interval = CRUD_SYNC_INTERVAL;  // seconds between automatic syncs, 0 = off
+time_t last_sync = 0;            // when the table was last synced
+uint8_t (*PageFilter)[CRUD_PAGE_FILTER_BYTES] = NULL;  // bloom filter of the names on each page
+CRUD_MOUNT_MODE mount_mode = CRUD_MOUNT_LAZY;         // whether mount reads every page up front
+uint8_t checksums = 1;           // whether objects are checksummed (see crud_set_checksums)
+
+// On-device file table.  Version 1 was a straight copy of the old in-memory
+// table.  Version 2 keeps only a header and the list of page objects in the
+// priority object, each with a bloom filter of the names on it, so crud_open
+// only reads the pages that may hold the name it is after.  Each page is its
+// own object holding CRUD_FILE_TABLE_PAGE entries (with a CRC32C of the
+// file's object, checked whenever a read brings the whole object over)
+// followed by their names, and is read the first time one of its entries is
+// needed.  Version 1 tables are read whole and written back as version 2.
+// The priority object is made big enough for the largest page list
+// (CRUD_TABLE_SIZE) so a sync is always an UPDATE, there is never a moment
+// with no table on the device.  A version 1 object is bigger still and is
+// updated in place.
+typedef struct{
+
 	char filename[128];
 	uint32_t oid;
 	uint32_t length;
 	uint8_t open;
 	uint32_t current_position;
 
-}file;
+}file_v1;
+
+typedef struct{
+
+	uint32_t magic;       // CRUD_TABLE_MAGIC
+	uint32_t version;     // CRUD_TABLE_VERSION
+	uint32_t count;       // number of entries in use
+	uint32_t pages;       // number of page summaries that follow
+
+}table_header;
+
+typedef struct{
+
+	uint32_t oid;
+	uint32_t length;
+	uint32_t checksum;
+
+}page_entry;
+
+typedef struct{
+
+	CrudOID oid;
+	uint8_t filter[CRUD_PAGE_FILTER_BYTES];
+
+}page_summary;
+
+uint32_t table_size = 0;   // size of the priority object on the device
+
+// Scratch buffer reused by read/write for whole-object temporaries.  It grows
+// to the largest object seen and is kept between calls unless it exceeds the
+// retention limit (see crud_set_scratch_limit).
+char *scratch_buff = NULL;
+uint32_t scratch_size = 0;
+uint32_t scratch_limit = CRUD_MAX_OBJECT_SIZE;
+
+// Per handle read-ahead state.  Reads that continue the previous one (or keep
+// the same forward stride) fetch a window ahead of what was asked for, and the
+// window doubles each time the pattern holds.  Kept apart from File[] so the
+// hot table stays small.
+typedef struct{
+
+	CrudOID oid;          // object the buffered bytes belong to (0 = none)
+	uint32_t start;       // object offset of the first buffered byte
+	uint32_t end;         // object offset one past the last buffered byte
+	uint32_t size;        // allocated size of data
+	char *data;           // the buffered bytes
+	uint32_t last_start;  // where the previous read started
+	uint32_t last_end;    // where the previous read ended
+	uint32_t stride;      // distance between the last two read starts
+	uint32_t window;      // current read-ahead size, 0 when not sequential
+
+}readahead;
+
+readahead *Ahead = NULL;
+uint32_t readahead_max = CRUD_READAHEAD_MAX;
+CrudReadAheadStats readahead_stats;
+
+// Asynchronous operations.  They are queued by class (see CRUD_SCHED_CLASS)
+// and run by one I/O thread: each turn it takes a run of operations of one
+// class on the same file from the head of that class's queue and serves them
+// together with one crud_readv/crud_writev.  Turns are shared out by weight
+// (see async_next_batch), and a read or write never goes ahead of an earlier
+// write or read of the same file.  The thread is the only one using the
+// client while operations are outstanding: the blocking calls wait for it to
+// go idle first (see async_exclusive).  A handle is an index into ops[].
+typedef enum {
+	CRUD_ASYNC_FREE   = 0,  // slot not in use
+	CRUD_ASYNC_QUEUED = 1,  // waiting for or being run by the I/O thread
+	CRUD_ASYNC_DONE   = 2,  // finished, result is waiting to be collected
+} CRUD_ASYNC_STATE;
 
-file File[1024];
+typedef enum {
+	CRUD_ASYNC_READ  = 0,
+	CRUD_ASYNC_WRITE = 1,
+	CRUD_ASYNC_OPEN  = 2,
+	CRUD_ASYNC_SYNC  = 3,
+} CRUD_ASYNC_KIND;
+
+static const CRUD_SCHED_CLASS async_class[] = { CRUD_SCHED_READ, CRUD_SCHED_BULK, CRUD_SCHED_META, CRUD_SCHED_META };
+static const char *async_class_labels[CRUD_SCHED_CLASSES] = { "metadata", "reads", "bulk writes" };
+
+typedef struct{
+
+	CRUD_ASYNC_STATE state;
+	CRUD_ASYNC_KIND kind;
+	int16_t fd;
+	CrudIoVec iov;               // the bytes and where they go in the file
+	char path[CRUD_MAX_PATH_LENGTH];  // the file to open
+	CrudAsyncCallback callback;  // NULL if the caller waits for it
+	void *arg;
+	int32_t result;              // bytes read/written (fd for an open), -1 if failure
+	int32_t next;                // next operation in its class's queue, -1 if last
+	uint64_t seq;                // submission order
+	struct timeval queued;       // when it was submitted
+
+}async_op;
+
+struct {
+
+	pthread_mutex_t lock;        // protects everything below
+	pthread_cond_t queued;       // an operation was queued (or stop was asked)
+	pthread_cond_t finished;     // operations finished (or slots were freed)
+	pthread_t thread;
+	uint8_t running;             // the I/O thread has been started
+	uint8_t stopping;            // the I/O thread should exit once idle
+	uint8_t held;                // the I/O thread may not start anything (unit test)
+	int32_t head[CRUD_SCHED_CLASSES];    // the queues, -1 if empty
+	int32_t tail[CRUD_SCHED_CLASSES];
+	uint32_t weight[CRUD_SCHED_CLASSES]; // turns each class gets per round
+	uint32_t credit[CRUD_SCHED_CLASSES]; // turns each class has left this round
+	uint32_t bulk_bytes;         // most write bytes in one turn
+	uint32_t outstanding;        // operations queued or running
+	uint64_t seq;                // operations ever submitted
+	CrudScheduleStats stats;
+	async_op ops[CRUD_ASYNC_MAX_OPS];
+
+} async = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.queued = PTHREAD_COND_INITIALIZER,
+	.finished = PTHREAD_COND_INITIALIZER,
+	.weight = { CRUD_SCHED_META_WEIGHT, CRUD_SCHED_READ_WEIGHT, CRUD_SCHED_BULK_WEIGHT },
+	.credit = { CRUD_SCHED_META_WEIGHT, CRUD_SCHED_READ_WEIGHT, CRUD_SCHED_BULK_WEIGHT },
+	.bulk_bytes = CRUD_SCHED_BULK_BYTES,
+};
 
 
 ////////////////////////////////////////////////////////////////////////////////
 //
 // Function     : create_crude_opcode
-// Description  : This function can create a 64 bits opcode by shifting the bits and binding them.
+// Description  : This function can create a 64 bits opcode (packed by the codec in crud_request.h).
 //
 // Inputs       : OID    64bits object identifer, 
 //				  Req    64bits Request type,
@@ -73,24 +266,7 @@ file File[1024];
 
 uint64_t create_crude_opcode(uint64_t OID,uint64_t Req,uint64_t Length,uint64_t Flags,uint64_t R){
 
-	
-	uint64_t sum;
-
-	//Now start to shift the bits 
-
-	OID = (OID)<<32;
-
-	Req = (Req)<<28;
-
-	Length = (Length)<<4;
-
-	Flags = (Flags)<<1;
-
-	R= (R);
-
-	sum = OID | Req | Length| Flags| R ;
-
-	return sum;
+	return crud_request_encode(OID, Req, Length, Flags, R);
 
 }
 
@@ -98,7 +274,7 @@ uint64_t create_crude_opcode(uint64_t OID,uint64_t Req,uint64_t Length,uint64_t
 //
 // Function     : extract_crude_opcode
 // Description  : This function can extract the 64bits response into the five 64bits opcode which are OID, Req,
-//                Length, Flags, and R by shifting the bits 
+//                Length, Flags, and R (using the codec in crud_request.h)
 //
 // Inputs       : 64bits response opcode
 
@@ -111,399 +287,2494 @@ Cruid extract_crude_opcode(uint64_t response){
 	Cruid extractValue;
 
 	//extract the 64bis response into five values.
-	extractValue.OID = response;
-	extractValue.OID = (extractValue.OID )>>32;
+	extractValue.OID = crud_request_oid(response);
+	extractValue.Req = crud_request_type(response);
+	extractValue.Length = crud_request_length(response);
+	extractValue.Flags = crud_request_flags(response);
+	extractValue.R = crud_request_result(response);
+
+	return  extractValue;
+
+}
 
-	extractValue.Req = response;
-	extractValue.Req = (extractValue.Req)<<32;
-	extractValue.Req = (extractValue.Req)>>60;
 
-	extractValue.Length = response;
-	extractValue.Length = (extractValue.Length)<<36;
-	extractValue.Length = (extractValue.Length)>>40;
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : scratch_acquire
+// Description  : This function returns the scratch buffer with room for at least
+//                size bytes, growing it when the current one is too small.
+//
+// Inputs       : size - the number of bytes needed
+// Outputs      : pointer to the scratch buffer, NULL if failure
 
-	extractValue.Flags = response;
-	extractValue.Flags = (extractValue.Flags)<<60;
-	extractValue.Flags = (extractValue.Flags)>>61;
+char *scratch_acquire(uint32_t size) {
 
-	extractValue.R = response;
-	extractValue.R = (extractValue.R)<<63;
-	extractValue.R = (extractValue.R)>>63;
+	char *grown;
 
-	return  extractValue;
+	// the current buffer is big enough, just reuse it
+	if (size <= scratch_size)
+		return scratch_buff;
 
-}
+	// the old contents are not needed, so free before allocating the bigger one
+	free(scratch_buff);
+	grown = malloc(size);
+	if (grown == NULL) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO : scratch allocation of %u bytes failed.", size);
+		scratch_buff = NULL;
+		scratch_size = 0;
+		return NULL;
+	}
 
+	scratch_buff = grown;
+	scratch_size = size;
+	crud_metric_add(CRUD_METRIC_ALLOCATIONS, 1);
+	crud_metric_add(CRUD_METRIC_ALLOC_BYTES, size);
+	return scratch_buff;
+}
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : crud_open
-// Description  : This function opens the file
+// Function     : scratch_release
+// Description  : This function is called when an operation is done with the
+//                scratch buffer, it frees the buffer if it is over the limit.
 //
-// Inputs       : path 
-// Outputs      : file 
+// Inputs       : none
+// Outputs      : none
 
-int16_t crud_open(char *path) {
+void scratch_release(void) {
+
+	if (scratch_size > scratch_limit) {
+		free(scratch_buff);
+		scratch_buff = NULL;
+		scratch_size = 0;
+	}
+}
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_set_scratch_limit
+// Description  : This function sets the largest scratch buffer kept between
+//                read/write calls (0 frees it after every call)
+//
+// Inputs       : limit - the retention limit in bytes
+// Outputs      : none
 
-    uint64_t send;
+void crud_set_scratch_limit(uint32_t limit) {
 
-  
-    int fd = 0;
+	scratch_limit = limit;
+	scratch_release();
+}
 
-    //when the flag is 0 , it means the curd is not initialzed yet 
-    if (flag == 0)
-    {
-       
-        send= create_crude_opcode(0, CRUD_INIT, 0, 0, 0); 
-        crud_client_operation(send, NULL);
-        flag = 1;
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : verify_object
+// Description  : This function checks bytes read for a file against its
+//                checksum, when they are the whole object and it has one.
+//
+// Inputs       : fd - the file the bytes belong to
+//                data - the bytes
+//                start - the offset of the bytes in the object
+//                length - the number of bytes
+// Outputs      : 0 if they match (or cannot be checked), -1 if not
+
+int verify_object(int16_t fd, char *data, uint32_t start, uint32_t length) {
+
+    uint32_t crc;
+
+    if (!checksums || File[fd].checksum == 0 || start != 0 || length != File[fd].length)
+        return (0);
+    crc = crc32c(0, data, length);
+    if (crc != File[fd].checksum) {
+        logMessage(LOG_ERROR_LEVEL, "CRUD_IO : checksum mismatch on [%s] OID %u [%x != %x]",
+            Names[fd], File[fd].oid, crc, File[fd].checksum);
+        return (-1);
     }
+    return (0);
+}
 
-    if(fd < CRUD_MAX_TOTAL_FILES){
-        fd ++ ;
-    }
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : readahead_release
+// Description  : This function frees a handle's read-ahead buffer and forgets
+//                its access pattern.
+//
+// Inputs       : fd - the file descriptor
+// Outputs      : none
 
+void readahead_release(int16_t fd) {
 
-    if(fd == CRUD_MAX_TOTAL_FILES){
+	free(Ahead[fd].data);
+	memset(&Ahead[fd], 0, sizeof(readahead));
+}
 
-         while (strcmp(File[fd].filename, "") > 0)
-            fd++;
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : readahead_read
+// Description  : This function serves a read from the handle's read-ahead buffer,
+//                or, when the read continues a forward pattern, refills the buffer
+//                with a bigger window and serves it from there.
+//
+// Inputs       : fd - the file descriptor for the read
+//                buf - the buffer to place the bytes into
+//                count - the number of bytes to read
+// Outputs      : the number of bytes read, -1 if failure, or CRUD_READAHEAD_PASS
+//                when the read is random and should go to the bus as usual
+
+int32_t readahead_read(int16_t fd, void *buf, int32_t count) {
+
+	readahead *ra = &Ahead[fd];
+	uint32_t pos = File[fd].current_position;
+	uint32_t want, fetch, need;
+	int forward;
+	uint64_t send;
+	Cruid got;
+
+	// nothing to read, let the normal path sort out the return
+	if (readahead_max == 0 || count <= 0 || pos >= File[fd].length)
+		return CRUD_READAHEAD_PASS;
+	want = count;
+	if (pos + want > File[fd].length)
+		want = File[fd].length - pos;
+
+	// does this read continue the last one, or keep the same stride forward
+	forward = (pos == ra->last_end) || (pos > ra->last_start && pos - ra->last_start == ra->stride);
+	ra->stride = (pos > ra->last_start) ? pos - ra->last_start : 0;
+	ra->last_start = pos;
+	ra->last_end = pos + want;
+
+	// the whole range is already buffered
+	if (ra->oid == File[fd].oid && pos >= ra->start && pos + want <= ra->end) {
+		memcpy(buf, &ra->data[pos - ra->start], want);
+		File[fd].current_position += want;
+		readahead_stats.hits++;
+		crud_metric_add(CRUD_METRIC_READAHEAD_HITS, 1);
+		return (want);
+	}
+	readahead_stats.misses++;
+	crud_metric_add(CRUD_METRIC_READAHEAD_MISSES, 1);
 
-        strcpy(File[fd].filename, path);
-        File[fd].oid = 0;
-        File[fd].current_position = 0;
-        File[fd].length = 0;
-        File[fd].open = 1;
+	// random access, drop back to a plain read and start over
+	if (!forward) {
+		ra->window = 0;
+		return CRUD_READAHEAD_PASS;
+	}
 
+	// grow the window while the pattern holds
+	if (ra->window == 0)
+		ra->window = (want * 2 > CRUD_READAHEAD_MIN) ? want * 2 : CRUD_READAHEAD_MIN;
+	else if (ra->window * 2 <= readahead_max)
+		ra->window *= 2;
+	if (ra->window > readahead_max)
+		ra->window = readahead_max;
+
+	// servers without ranged reads send the whole object anyway, so keep all
+	// of it, but only when it fits the window (a plain read does the rest)
+	if (crud_network_capabilities & CRUD_RANGE_FLAG) {
+		fetch = (want > ra->window) ? want : ra->window;
+		if (pos + fetch > File[fd].length)
+			fetch = File[fd].length - pos;
+		need = fetch;
+	} else if (File[fd].length <= readahead_max) {
+		fetch = File[fd].length;
+		need = File[fd].length;
+	} else {
+		readahead_release(fd);
+		return CRUD_READAHEAD_PASS;
+	}
 
-  }
+	// make room for the window
+	if (ra->size < need) {
+		free(ra->data);
+		ra->data = malloc(need);
+		ra->size = (ra->data != NULL) ? need : 0;
+		if (ra->data == NULL) {
+			ra->oid = 0;
+			return CRUD_READAHEAD_PASS;
+		}
+	}
 
-        while (strcmp(File[fd].filename, "") > 0)
-            fd++;
-        
-            strcpy(File[fd].filename, path);
-            File[fd].oid = 0;
-            File[fd].current_position = 0;
-            File[fd].length = 0;
-            File[fd].open = 1;
-    
-    return fd; 
+	// fill the window from the bus
+	if (crud_network_capabilities & CRUD_RANGE_FLAG) {
+		send = create_crude_opcode(File[fd].oid, CRUD_READ, fetch, 0, 0);
+		got = extract_crude_opcode(crud_client_read_range(send, pos, ra->data));
+		ra->start = pos;
+	} else {
+		send = create_crude_opcode(File[fd].oid, CRUD_READ, fetch, 0, 0);
+		got = extract_crude_opcode(crud_client_operation(send, ra->data));
+		ra->start = 0;
+	}
+	if (got.R != 0 || ra->start + got.Length < pos + want ||
+		verify_object(fd, ra->data, ra->start, got.Length)) {
+		ra->oid = 0;
+		return (-1);
+	}
+	ra->oid = File[fd].oid;
+	ra->end = ra->start + got.Length;
+	readahead_stats.prefetched += ra->end - (pos + want);
+
+	// and serve the read from it
+	memcpy(buf, &ra->data[pos - ra->start], want);
+	File[fd].current_position += want;
+	return (want);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : crud_close
-// Description  : This function closes the file
+// Function     : readahead_invalidate
+// Description  : This function drops buffered read-ahead data for an object
+//                that is about to change.
 //
-// Inputs       : fd - the file handle of the object to close
-// Outputs      : 0 if successful, -1 if failure
+// Inputs       : oid - the object being written
+// Outputs      : none
 
-int16_t crud_close(int16_t fd) {
+void readahead_invalidate(CrudOID oid) {
 
-	uint64_t send; 
+	int i;
 
-    //when the flag is 0 , it means the curd is not initialzed yet 
-	
-	if (flag == 0){
-       
-        //first send the intial Request type to the crude by calling the bus 
-		send = create_crude_opcode(0,CRUD_INIT, 0,0,0);
+	for (i = 0; i < page_count * CRUD_FILE_TABLE_PAGE; i++) {
+		if (Ahead[i].oid == oid)
+			Ahead[i].oid = 0;
+	}
+}
 
-		crud_client_operation(send, NULL);
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_set_readahead
+// Description  : This function sets the largest read-ahead window (0 turns
+//                read-ahead off)
+//
+// Inputs       : max_window - the window limit in bytes
+// Outputs      : none
 
-		//now the flag is 1 , it means the crud is initialized
-		flag =1 ;
+void crud_set_readahead(uint32_t max_window) {
 
-		}
+	int i;
 
-		//set open to 0 to close the file
-		File[fd].open = 0 ;
+	readahead_max = max_window;
+	for (i = 0; i < page_count * CRUD_FILE_TABLE_PAGE; i++)
+		readahead_release(i);
+}
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_get_readahead_stats
+// Description  : This function copies out the read-ahead counters
+//
+// Inputs       : stats - the place to put the counters
+// Outputs      : none
 
-		return (0);
+void crud_get_readahead_stats(CrudReadAheadStats *stats) {
 
+	*stats = readahead_stats;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : crud_read
-// Description  : Reads up to "count" bytes from the file handle "fh" into the
-//                buffer  "buf".
+// Function     : name_hash
+// Description  : This function hashes a filename (64 bit FNV-1a), for the name
+//                index and the page filters.
 //
-// Inputs       : fd - the file descriptor for the read
-//                buf - the buffer to place the bytes into
-//                count - the number of bytes to read
-// Outputs      : the number of bytes read or -1 if failures
+// Inputs       : path - the filename
+// Outputs      : the hash
 
-int32_t crud_read(int16_t fd, void *buf, int32_t count) {
- 
-	
+uint64_t name_hash(char *path) {
 
- 	uint64_t send ;
+	uint64_t hash = 14695981039346656037ull;
+	char *c;
 
- 	//when the flag is 0 , it means the curd is not initialized yet 
-	if(flag == 0){
+	for (c = path; *c; c++)
+		hash = (hash ^ (uint8_t)*c) * 1099511628211ull;
 
-		send = create_crude_opcode(0,CRUD_INIT,0,0,0);
+	return hash;
+}
 
-		crud_client_operation(send, NULL);
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : page_filter
+// Description  : This function adds a filename to a page's filter, or checks
+//                whether the page may hold it.  The bits come from the two
+//                halves of the name hash (double hashing).
+//
+// Inputs       : page - the page
+//                path - the filename
+//                add - 1 to add the name, 0 to check for it
+// Outputs      : 1 if the name may be on the page, 0 if it is not
+
+int page_filter(uint32_t page, char *path, int add) {
+
+	uint64_t hash = name_hash(path);
+	uint32_t h1 = (uint32_t)hash, h2 = (uint32_t)(hash >> 32) | 1;
+	uint32_t i, bit;
+
+	for (i = 0; i < CRUD_PAGE_FILTER_HASHES; i++) {
+		bit = (h1 + i * h2) % (CRUD_PAGE_FILTER_BYTES * 8);
+		if (add)
+			PageFilter[page][bit / 8] |= 1 << (bit % 8);
+		else if (!(PageFilter[page][bit / 8] & (1 << (bit % 8))))
+			return (0);
+	}
+	return (1);
+}
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : name_slot
+// Description  : This function finds the name index slot for a filename, either
+//                the one holding it or the empty one it would go in.
+//
+// Inputs       : path - the filename
+// Outputs      : the index into NameIndex
 
-		// it is initialized now
-		flag = 1;
+uint32_t name_slot(char *path) {
 
-	}	
+	uint64_t full = name_hash(path);
+	uint32_t hash = (uint32_t)(full ^ (full >> 32));
 
+	// probe linearly from the hash
+	hash &= name_index_size - 1;
+	while (NameIndex[hash] != 0 && strcmp(Names[NameIndex[hash] - 1], path) != 0)
+		hash = (hash + 1) & (name_index_size - 1);
 
-	if(File[fd].oid == 0 )
-		return 0;
+	return hash;
+}
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : grow_file_table
+// Description  : This function makes room in the in-memory table for more pages
+//                of entries, the new entries are empty and count as loaded
+//                until the caller says otherwise.
+//
+// Inputs       : pages - the number of pages wanted
+// Outputs      : 0 if successful, -1 if failure
 
-	//aftering reading this amount of data, the current position is still less then total length
-	if(File[fd].current_position + count <= File[fd].length){
+int grow_file_table(uint32_t pages) {
 
-		//create a temporary buf
-		char *temp_buff = malloc(File[fd].length);
-		// send the READ request type and length
-		send = create_crude_opcode(File[fd].oid,CRUD_READ,File[fd].length,0,0);
-        //  read the previous data first 
-		crud_client_operation(send, temp_buff);
-		// keeping reading the counts bytes from the previous position by memory copying 
-		memcpy(buf, &temp_buff[File[fd].current_position], count);
-		//reset the current position 
-		File[fd].current_position = File[fd].current_position + count ;
+	uint32_t old = page_count * CRUD_FILE_TABLE_PAGE;
+	uint32_t entries = pages * CRUD_FILE_TABLE_PAGE;
+	uint32_t i;
+	void *f, *n, *a, *o, *l, *d, *b;
 
-		//printf("read successful!!!!!!!!!!!!!!!!!!!!!");
-		//free the memory 
-		free(temp_buff);
-		//return the count read
-		return (count) ; 
-		
+	if (pages <= page_count)
+		return (0);
+	if (entries > CRUD_MAX_TOTAL_FILES + CRUD_FILE_TABLE_PAGE) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO : file table cannot grow to %u entries", entries);
+		return (-1);
 	}
 
-	//aftering reading this amount of data, the current position become final position
-	else{
-
-		int actual_count;
-		//create a temporary buf
-		char *temp_buff = malloc(File[fd].length);
-		// send the READ request type and length
-		send = create_crude_opcode(File[fd].oid, CRUD_READ,File[fd].length,0,0);
-		//  read the previous data first 
-		crud_client_operation(send, temp_buff);
-		//This is the actual bytes read 
-		actual_count = File[fd].length - File[fd].current_position;
-		// keeping reading the counts bytes from the previous position by memory copying 
-		memcpy(buf, &temp_buff[File[fd].current_position], actual_count );
-        //reset the current position
-		File[fd].current_position = File[fd].length;
-
-		//printf("read successful!!!!!!!!!!!!!!!!!!!!!");
-        //free the memory
-		free(temp_buff);
-		//return the actual count read
-		return (actual_count);
-		
+	// grow each of the arrays, keeping what is there
+	f = realloc(File, entries * sizeof(file));
+	if (f != NULL) File = f;
+	n = realloc(Names, entries * CRUD_MAX_PATH_LENGTH);
+	if (n != NULL) Names = n;
+	a = realloc(Ahead, entries * sizeof(readahead));
+	if (a != NULL) Ahead = a;
+	o = realloc(PageOid, pages * sizeof(CrudOID));
+	if (o != NULL) PageOid = o;
+	l = realloc(PageLoaded, pages);
+	if (l != NULL) PageLoaded = l;
+	d = realloc(PageDirty, pages);
+	if (d != NULL) PageDirty = d;
+	b = realloc(PageFilter, pages * CRUD_PAGE_FILTER_BYTES);
+	if (b != NULL) PageFilter = b;
+	if (f == NULL || n == NULL || a == NULL || o == NULL || l == NULL || d == NULL || b == NULL) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO : file table allocation failed [%u entries]", entries);
+		return (-1);
+	}
+	memset(&File[old], 0, (entries - old) * sizeof(file));
+	memset(&Names[old], 0, (entries - old) * CRUD_MAX_PATH_LENGTH);
+	memset(&Ahead[old], 0, (entries - old) * sizeof(readahead));
+	memset(&PageOid[page_count], 0, (pages - page_count) * sizeof(CrudOID));
+	memset(&PageLoaded[page_count], 1, pages - page_count);
+	memset(&PageDirty[page_count], 0, pages - page_count);
+	memset(&PageFilter[page_count], 0, (pages - page_count) * CRUD_PAGE_FILTER_BYTES);
+	page_count = pages;
+
+	// keep the name index at most half full, re-adding the names when it grows
+	if (entries * 2 > name_index_size) {
+		free(NameIndex);
+		name_index_size = 1;
+		while (name_index_size < entries * 2)
+			name_index_size <<= 1;
+		NameIndex = calloc(name_index_size, sizeof(int16_t));
+		if (NameIndex == NULL) {
+			name_index_size = 0;
+			return (-1);
+		}
+		for (i = 0; i < old; i++) {
+			if (Names[i][0] != 0)
+				NameIndex[name_slot(Names[i])] = i + 1;
+		}
 	}
 
+	return (0);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : reset_file_table
+// Description  : This function throws away the in-memory file table
+//
+// Inputs       : none
+// Outputs      : none
+
+void reset_file_table(void) {
+
+	uint32_t i;
+
+	for (i = 0; i < page_count * CRUD_FILE_TABLE_PAGE; i++)
+		free(Ahead[i].data);
+	free(File);
+	free(Names);
+	free(Ahead);
+	free(PageOid);
+	free(PageLoaded);
+	free(PageDirty);
+	free(PageFilter);
+	free(NameIndex);
+	File = NULL;
+	Names = NULL;
+	Ahead = NULL;
+	PageOid = NULL;
+	PageLoaded = NULL;
+	PageDirty = NULL;
+	PageFilter = NULL;
+	NameIndex = NULL;
+	name_index_size = 0;
+	file_count = 0;
+	page_count = 0;
+	header_dirty = 0;
+}
 
-//////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : crud_write
-// Description  : Writes "count" bytes to the file handle "fh" from the
-//                buffer  "buf"
+// Function     : load_page
+// Description  : This function reads one page of the file table in from its
+//                object and indexes the names on it.
 //
-// Inputs       : fd - the file descriptor for the file to write to
-//                buf - the buffer to write
-//                count - the number of bytes to write
-// Outputs      : the number of bytes written or -1 if failure
+// Inputs       : page - the page to read
+// Outputs      : 0 if successful, -1 if failure
 
-int32_t crud_write(int16_t fd, void *buf, int32_t count) {
+int load_page(uint32_t page) {
 
-	uint64_t send, accept;
+	uint32_t first = page * CRUD_FILE_TABLE_PAGE;
+	uint32_t size = CRUD_PAGE_SIZE;
+	uint64_t send;
+	page_entry *entry;
+	char (*names)[CRUD_MAX_PATH_LENGTH];
+	uint8_t filter[CRUD_PAGE_FILTER_BYTES];
+	char *buf;
+	Cruid got;
+	uint32_t i;
 
- 
- 	//when the flag is 0 , it means the curd is not initialized yet 
-    if (flag == 0){
-        
-        uint64_t send = create_crude_opcode(0, CRUD_INIT, 0, 0, 0); 
+	if (PageLoaded[page])
+		return (0);
+	memcpy(filter, PageFilter[page], CRUD_PAGE_FILTER_BYTES);
+	memset(PageFilter[page], 0, CRUD_PAGE_FILTER_BYTES);
+
+	// read the page object
+	if ((buf = scratch_acquire(size)) == NULL)
+		return (-1);
+	send = create_crude_opcode(PageOid[page], CRUD_READ, size, 0, 0);
+	got = extract_crude_opcode(crud_client_operation(send, buf));
+	if (got.R != 0 || got.Length != size) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO : failed reading file table page %u [OID %u]", page, PageOid[page]);
+		return (-1);
+	}
 
-        crud_client_operation(send, NULL);
+	// copy the entries in and index their names
+	entry = (page_entry *)buf;
+	names = (void *)&entry[CRUD_FILE_TABLE_PAGE];
+	for (i = 0; i < CRUD_FILE_TABLE_PAGE; i++) {
+		File[first + i].oid = entry[i].oid;
+		File[first + i].length = entry[i].length;
+		File[first + i].checksum = entry[i].checksum;
+		memcpy(Names[first + i], names[i], CRUD_MAX_PATH_LENGTH);
+		Names[first + i][CRUD_MAX_PATH_LENGTH - 1] = 0;
+		if (Names[first + i][0] != 0) {
+			NameIndex[name_slot(Names[first + i])] = first + i + 1;
+			page_filter(page, Names[first + i], 1);
+		}
+	}
 
-        // it is initialized now
-      	flag = 1; 
+	// the filter is exact now, write it back if it was not
+	if (memcmp(filter, PageFilter[page], CRUD_PAGE_FILTER_BYTES) != 0)
+		header_dirty = 1;
 
+	PageLoaded[page] = 1;
+	scratch_release();
+	return (0);
+}
 
-    }
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : save_page
+// Description  : This function writes one page of the file table out to its
+//                object, creating the object the first time.
+//
+// Inputs       : page - the page to write
+// Outputs      : 0 if successful, -1 if failure
 
-     
-    // There are two cases , one is when object does not exist , and another one the object exist.
+int save_page(uint32_t page) {
+
+	uint32_t first = page * CRUD_FILE_TABLE_PAGE;
+	uint64_t send;
+	page_entry *entry;
+	char (*names)[CRUD_MAX_PATH_LENGTH];
+	char *buf;
+	Cruid got;
+	uint32_t i;
+
+	// lay the page out
+	if ((buf = scratch_acquire(CRUD_PAGE_SIZE)) == NULL)
+		return (-1);
+	entry = (page_entry *)buf;
+	names = (void *)&entry[CRUD_FILE_TABLE_PAGE];
+	for (i = 0; i < CRUD_FILE_TABLE_PAGE; i++) {
+		entry[i].oid = File[first + i].oid;
+		entry[i].length = File[first + i].length;
+		entry[i].checksum = File[first + i].checksum;
+		memcpy(names[i], Names[first + i], CRUD_MAX_PATH_LENGTH);
+	}
 
-    // When the object does not exist
+	// pages never change size, so after the first time it is an update
+	if (PageOid[page] == 0)
+		send = create_crude_opcode(0, CRUD_CREATE, CRUD_PAGE_SIZE, 0, 0);
+	else
+		send = create_crude_opcode(PageOid[page], CRUD_UPDATE, CRUD_PAGE_SIZE, 0, 0);
+	got = extract_crude_opcode(crud_client_operation(send, buf));
+	if (got.R != 0) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO : failed writing file table page %u", page);
+		return (-1);
+	}
+	if (PageOid[page] != got.OID) {
+		PageOid[page] = got.OID;
+		header_dirty = 1;
+	}
+	PageDirty[page] = 0;
 
-    if (File[fd].oid == 0){
-        //  create a new object by using sending CRUD_CREATE type request
-        uint64_t send = create_crude_opcode(0, CRUD_CREATE, count, 0, 0);
-        //  calling the bus 
-        uint64_t accept = crud_client_operation(send, buf);
+	scratch_release();
+	return (0);
+}
 
-        Cruid new = extract_crude_opcode(accept);
-        // reset the oid , length and current length 
-      	File[fd].oid = new.OID;
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : load_file_table
+// Description  : This function sets up the file table from the priority object.
+//                Version 2 tables only bring in the list of pages (and their
+//                filters), version 1 tables are read whole and are written
+//                back as pages at unmount.
+//
+// Inputs       : buf - the priority object
+//                size - the size of the priority object
+// Outputs      : 0 if successful, -1 if failure
 
-        File[fd].length = count;
+int load_file_table(char *buf, uint32_t size) {
+
+	table_header *header = (table_header *)buf;
+	page_summary *summary;
+	file_v1 *old;
+	uint32_t i, count;
+
+	reset_file_table();
+
+	// version 2: the header and the page list with the filters
+	if (size >= sizeof(table_header) && header->magic == CRUD_TABLE_MAGIC &&
+		header->version == CRUD_TABLE_VERSION && header->pages <= CRUD_TABLE_MAX_PAGES &&
+		size >= sizeof(table_header) + header->pages * sizeof(page_summary)) {
+		if (grow_file_table(header->pages))
+			return (-1);
+		summary = (page_summary *)&buf[sizeof(table_header)];
+		for (i = 0; i < header->pages; i++) {
+			PageOid[i] = summary[i].oid;
+			memcpy(PageFilter[i], summary[i].filter, CRUD_PAGE_FILTER_BYTES);
+		}
+		memset(PageLoaded, 0, header->pages);
+		file_count = header->count;
+		return (0);
+	}
 
-        File[fd].current_position = count; 
+	// version 1: the whole old table, no header
+	if (size == CRUD_V1_TABLE_FILES * sizeof(file_v1)) {
+		old = (file_v1 *)buf;
+		count = CRUD_V1_TABLE_FILES;
+		if (grow_file_table((count + CRUD_FILE_TABLE_PAGE - 1) / CRUD_FILE_TABLE_PAGE))
+			return (-1);
+		for (i = 0; i < count; i++) {
+			File[i].oid = old[i].oid;
+			File[i].length = old[i].length;
+			strncpy(Names[i], old[i].filename, CRUD_MAX_PATH_LENGTH - 1);
+		}
+	}
 
-        return count; 
+	else {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO : unrecognized file table [%u bytes]", size);
+		return (-1);
 	}
 
-    // When the obejct exist already
-    else {
-        
+	// index the names that are in use, everything gets written as pages
+	for (i = 0; i < count; i++) {
+		if (Names[i][0] != 0) {
+			NameIndex[name_slot(Names[i])] = i + 1;
+			page_filter(i / CRUD_FILE_TABLE_PAGE, Names[i], 1);
+			file_count = i + 1;
+		}
+	}
+	memset(PageDirty, 1, page_count);
+	header_dirty = 1;
 
+	return (0);
+}
 
-     
-        // when writing beyond the total length of the file
-        if (File[fd].current_position + count > File[fd].length)  {
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : save_file_table
+// Description  : This function writes out the dirty pages, then lays out the
+//                header and page list that go in the priority object (padded
+//                out to the object's size).
+//
+// Inputs       : size - the size of the priority object
+// Outputs      : the buffer holding it (the scratch buffer), NULL if failure
 
-        	// read the current data in the file frist 
-            send = create_crude_opcode(File[fd].oid, CRUD_READ, File[fd].length, 0, 0);
+char *save_file_table(uint32_t size) {
+
+	table_header *header;
+	page_summary *summary;
+	char *buf;
+	uint32_t page;
+
+	// only the pages that changed go out
+	for (page = 0; page < page_count; page++) {
+		if (PageDirty[page] && save_page(page))
+			return NULL;
+	}
+
+	// then the header and the page list with the filters
+	if (sizeof(table_header) + page_count * sizeof(page_summary) > size) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO : file table of %u pages does not fit the priority object", page_count);
+		return NULL;
+	}
+	if ((buf = scratch_acquire(size)) == NULL)
+		return NULL;
+	memset(buf, 0, size);
+	header = (table_header *)buf;
+	header->magic = CRUD_TABLE_MAGIC;
+	header->version = CRUD_TABLE_VERSION;
+	header->count = file_count;
+	header->pages = page_count;
+	summary = (page_summary *)&buf[sizeof(table_header)];
+	for (page = 0; page < page_count; page++) {
+		summary[page].oid = PageOid[page];
+		memcpy(summary[page].filter, PageFilter[page], CRUD_PAGE_FILTER_BYTES);
+	}
+
+	return buf;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : file_sync
+// Description  : This function writes the changed parts of the file table to
+//                the device: the dirty pages, then the priority object if the
+//                page list or file count changed.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+static int16_t file_sync(void) {
+
+    uint64_t send;
+    char *table;
+
+    // the pages first, writing a new one can change the header
+    table = save_file_table(table_size);
+    if (table == NULL) {
+        scratch_release();
+        return (-1);
+    }
+    last_sync = time(NULL);
+    if (!header_dirty) {
+        scratch_release();
+        return (0);
+    }
+
+    // Update priority object in place, it never changes size
+    send = create_crude_opcode(0, CRUD_UPDATE, table_size, CRUD_PRIORITY_OBJECT, 0);
+    if (extract_crude_opcode(crud_client_operation(send, table)).R != 0) {
+        scratch_release();
+        return (-1);
+    }
+    header_dirty = 0;
+
+    scratch_release();
+    return (0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : async_exclusive
+// Description  : This function is called at the top of the blocking calls, it
+//                waits until the I/O thread has nothing queued or running so
+//                the two never use the connection or the file table at once.
+//                The I/O thread itself (and the callbacks it runs) goes
+//                straight through.
+//
+// Inputs       : none
+// Outputs      : none
+
+static void async_exclusive(void) {
+
+    pthread_mutex_lock(&async.lock);
+    if (async.running && !pthread_equal(pthread_self(), async.thread)) {
+        while (async.outstanding > 0)
+            pthread_cond_wait(&async.finished, &async.lock);
+    }
+    pthread_mutex_unlock(&async.lock);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_sync
+// Description  : Traced entry point for file_sync (see crud_trace.h)
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int16_t crud_sync(void) {
+
+    int16_t result;
+
+    async_exclusive();
+    CRUD_PROBE3(file_entry, "sync", -1, 0);
+    result = file_sync();
+    CRUD_PROBE3(file_return, "sync", -1, result);
+    return (result);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_set_sync_interval
+// Description  : This function sets how often the file table is synced while
+//                files are being changed
+//
+// Inputs       : seconds - the time between syncs, 0 only syncs on unmount
+// Outputs      : none
+
+void crud_set_sync_interval(uint32_t seconds) {
+
+    sync_interval = seconds;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_set_mount_mode
+// Description  : This function sets whether crud_mount reads the whole file
+//                table, or only its header and reads pages as files are opened
+//
+// Inputs       : mode - CRUD_MOUNT_LAZY or CRUD_MOUNT_EAGER
+// Outputs      : none
+
+void crud_set_mount_mode(CRUD_MOUNT_MODE mode) {
+
+    mount_mode = mode;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sync_if_due
+// Description  : This function is called after the file table changes, and
+//                syncs it when the sync interval has passed.  It runs on the
+//                caller's thread since the bus connection is not shared.
+//
+// Inputs       : none
+// Outputs      : none
+
+void sync_if_due(void) {
+
+    if (sync_interval != 0 && time(NULL) - last_sync >= sync_interval) {
+        if (crud_sync())
+            logMessage(LOG_WARNING_LEVEL, "CRUD_IO : periodic file table sync failed.");
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_set_checksums
+// Description  : This function turns object checksums on or off.  When off,
+//                writes record no checksum and reads do not check them.
+//
+// Inputs       : enable - 1 to checksum objects, 0 not to
+// Outputs      : none
+
+void crud_set_checksums(uint8_t enable) {
+
+    checksums = enable;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : file_find
+// Description  : This function looks a name up in the file table, reading in
+//                only the pages whose filter says it may be there.  Unlike
+//                crud_open it never adds the file.
+//
+// Inputs       : path - the file name
+// Outputs      : the file handle, -1 if there is no such file (or a page
+//                could not be read)
+
+static int16_t file_find(char *path) {
+
+    uint32_t slot, page;
+
+    if (path == NULL || path[0] == 0 || strlen(path) >= CRUD_MAX_PATH_LENGTH)
+        return (-1);
+
+    slot = (name_index_size != 0) ? name_slot(path) : 0;
+    for (page = 0; page < page_count && NameIndex[slot] == 0; page++) {
+        if (!PageLoaded[page] && page_filter(page, path, 0)) {
+            if (load_page(page))
+                return (-1);
+            slot = name_slot(path);
+        }
+    }
+    if (name_index_size == 0 || NameIndex[slot] == 0)
+        return (-1);
+    return (NameIndex[slot] - 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_find
+// Description  : Traced entry point for file_find (see crud_trace.h)
+//
+// Inputs       : path - the file name
+// Outputs      : the file handle, -1 if there is no such file (or a page
+//                could not be read)
+
+int16_t crud_find(char *path) {
+
+    int16_t result;
+
+    async_exclusive();
+    CRUD_PROBE3(file_entry, "find", -1, 0);
+    result = file_find(path);
+    CRUD_PROBE3(file_return, "find", -1, result);
+    return (result);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_next_file
+// Description  : This function walks the file table, reading in the pages as
+//                it gets to them
+//
+// Inputs       : fd - the last file handle returned, -1 to start
+//                name - the place to put the file's name (CRUD_MAX_PATH_LENGTH)
+// Outputs      : the next file handle, -1 at the end (or if a page could not
+//                be read)
+
+int16_t crud_next_file(int16_t fd, char *name) {
+
+    uint32_t next;
+
+    async_exclusive();
+    for (next = fd + 1; next < file_count; next++) {
+        if (!PageLoaded[next / CRUD_FILE_TABLE_PAGE] && load_page(next / CRUD_FILE_TABLE_PAGE))
+            return (-1);
+        if (Names[next][0] != 0) {
+            strcpy(name, Names[next]);
+            return (next);
+        }
+    }
+    return (-1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : add_file
+// Description  : This function adds a new, empty file to the file table (the
+//                caller knows the name is not there yet)
+//
+// Inputs       : path - the file name
+// Outputs      : the new file handle, -1 if failure
+
+int16_t add_file(char *path) {
+
+    uint32_t slot, page;
+    int fd;
+
+    // take the first unused entry on a page we have, or the next one
+    for (fd = 0; fd < file_count; fd++) {
+        if (PageLoaded[fd / CRUD_FILE_TABLE_PAGE] && Names[fd][0] == 0)
+            break;
+    }
+    if (fd >= CRUD_MAX_TOTAL_FILES) {
+        logMessage(LOG_ERROR_LEVEL, "CRUD_IO : file table full opening [%s]", path);
+        return (-1);
+    }
+    if (fd >= page_count * CRUD_FILE_TABLE_PAGE) {
+        if (grow_file_table(page_count + 1))
+            return (-1);
+    }
+    page = fd / CRUD_FILE_TABLE_PAGE;
+    if (load_page(page))
+        return (-1);
+    if (fd >= file_count) {
+        file_count = fd + 1;
+        header_dirty = 1;
+    }
+    PageDirty[page] = 1;
+    page_filter(page, path, 1);
+    header_dirty = 1;
+    slot = name_slot(path);
+
+    strcpy(Names[fd], path);
+    NameIndex[slot] = fd + 1;
+    File[fd].oid = 0;
+    File[fd].current_position = 0;
+    File[fd].length = 0;
+    File[fd].checksum = 0;
+    File[fd].open = 0;
+
+    return (fd);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : remove_file
+// Description  : This function takes a file back out of the table (one that
+//                add_file made but whose object never got created).  The
+//                names probed past it in the index are put back so they can
+//                still be found, its page filter bits just stay set.
+//
+// Inputs       : fd - the file handle
+// Outputs      : none
+
+void remove_file(int16_t fd) {
+
+    uint32_t slot, next;
+    int16_t moved;
+
+    slot = name_slot(Names[fd]);
+    NameIndex[slot] = 0;
+    for (next = (slot + 1) & (name_index_size - 1); NameIndex[next] != 0;
+         next = (next + 1) & (name_index_size - 1)) {
+        moved = NameIndex[next];
+        NameIndex[next] = 0;
+        NameIndex[name_slot(Names[moved - 1])] = moved;
+    }
+
+    readahead_release(fd);
+    Names[fd][0] = 0;
+    memset(&File[fd], 0, sizeof(file));
+    PageDirty[fd / CRUD_FILE_TABLE_PAGE] = 1;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : file_open
+// Description  : This function opens the file
+//
+// Inputs       : path 
+// Outputs      : file 
+
+static int16_t file_open(char *path) {
+
+
+    uint64_t send;
+    int fd;
+
+    //when the flag is 0 , it means the curd is not initialzed yet 
+    if (flag == 0)
+    {
+       
+        send= create_crude_opcode(0, CRUD_INIT, 0, 0, 0); 
+        crud_client_operation(send, NULL);
+        flag = 1;
+    }
+
+    // the name has to fit in the table
+    if (path == NULL || path[0] == 0 || strlen(path) >= CRUD_MAX_PATH_LENGTH)
+        return (-1);
+
+    // a file we already know about, open it again from the start
+    if ((fd = crud_find(path)) != -1) {
+        File[fd].current_position = 0;
+        File[fd].open = 1;
+        return fd;
+    }
+
+    // otherwise add it
+    if ((fd = add_file(path)) == -1)
+        return (-1);
+    File[fd].open = 1;
+
+    sync_if_due();
+    
+    return fd; 
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_open
+// Description  : Traced entry point for file_open (see crud_trace.h)
+//
+// Inputs       : path - the name of the file
+// Outputs      : the file handle or -1 if failure
+
+int16_t crud_open(char *path) {
+
+    int16_t result;
+
+    async_exclusive();
+    CRUD_PROBE3(file_entry, "open", -1, 0);
+    result = file_open(path);
+    CRUD_PROBE3(file_return, "open", -1, result);
+    return (result);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_close
+// Description  : This function closes the file
+//
+// Inputs       : fd - the file handle of the object to close
+// Outputs      : 0 if successful, -1 if failure
 
-       		char *temp_read_buff = malloc(File[fd].length); 
+int16_t crud_close(int16_t fd) {
+
+	uint64_t send; 
+
+	async_exclusive();
+    //when the flag is 0 , it means the curd is not initialzed yet 
+	
+	if (flag == 0){
+       
+        //first send the intial Request type to the crude by calling the bus 
+		send = create_crude_opcode(0,CRUD_INIT, 0,0,0);
+
+		crud_client_operation(send, NULL);
+
+		//now the flag is 1 , it means the crud is initialized
+		flag =1 ;
+
+		}
+
+		//set open to 0 to close the file, and give back its read-ahead buffer
+		CRUD_PROBE3(file_entry, "close", fd, 0);
+		File[fd].open = 0 ;
+		readahead_release(fd);
+		CRUD_PROBE3(file_return, "close", fd, 0);
+
+
+		return (0);
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : file_read
+// Description  : Reads up to "count" bytes from the file handle "fh" into the
+//                buffer  "buf".
+//
+// Inputs       : fd - the file descriptor for the read
+//                buf - the buffer to place the bytes into
+//                count - the number of bytes to read
+// Outputs      : the number of bytes read or -1 if failures
+
+static int32_t file_read(int16_t fd, void *buf, int32_t count) {
+ 
+	
+
+ 	uint64_t send ;
+
+ 	//when the flag is 0 , it means the curd is not initialized yet 
+	if(flag == 0){
+
+		send = create_crude_opcode(0,CRUD_INIT,0,0,0);
+
+		if(extract_crude_opcode(crud_client_operation(send, NULL)).R != 0)
+			return (-1);
+
+
+		// it is initialized now
+		flag = 1;
+
+	}	
+
+
+	if(File[fd].oid == 0 )
+		return 0;
+
+	//sequential and strided reads are served through the read-ahead buffer
+	int32_t ahead = readahead_read(fd, buf, count);
+	if(ahead != CRUD_READAHEAD_PASS)
+		return (ahead);
+
+	//when the server can do ranged reads, only the wanted bytes come over the
+	//bus and they are received straight into the caller's buffer
+	if(crud_network_capabilities & CRUD_RANGE_FLAG){
+
+		int32_t actual_count = count;
+		Cruid got;
+
+		// nothing left to read at or past the end of the file
+		if(File[fd].current_position >= File[fd].length)
+			return 0;
+		if(File[fd].current_position + count > File[fd].length)
+			actual_count = File[fd].length - File[fd].current_position;
+		if(actual_count <= 0)
+			return 0;
+
+		send = create_crude_opcode(File[fd].oid, CRUD_READ, actual_count, 0, 0);
+		got = extract_crude_opcode(crud_client_read_range(send, File[fd].current_position, buf));
+		if(got.R != 0 || verify_object(fd, buf, File[fd].current_position, got.Length))
+			return (-1);
+
+		File[fd].current_position += got.Length;
+		return (got.Length);
+	}
+
+
+	//aftering reading this amount of data, the current position is still less then total length
+	if(File[fd].current_position + count <= File[fd].length){
 
-       	    crud_client_operation(send, temp_read_buff);
+		//get the scratch buffer to hold the whole object
+		char *temp_buff = scratch_acquire(File[fd].length);
+		if (temp_buff == NULL)
+			return (-1);
+		// send the READ request type and length
+		send = create_crude_opcode(File[fd].oid,CRUD_READ,File[fd].length,0,0);
+        //  read the previous data first, the scratch bytes are stale if it failed
+		if (extract_crude_opcode(crud_client_operation(send, temp_buff)).R != 0 ||
+			verify_object(fd, temp_buff, 0, File[fd].length)) {
+			scratch_release();
+			return (-1);
+		}
+		// keeping reading the counts bytes from the previous position by memory copying 
+		memcpy(buf, &temp_buff[File[fd].current_position], count);
+		//reset the current position 
+		File[fd].current_position = File[fd].current_position + count ;
+
+		//printf("read successful!!!!!!!!!!!!!!!!!!!!!");
+		//done with the scratch buffer
+		scratch_release();
+		//return the count read
+		return (count) ; 
+		
+	}
+
+	//aftering reading this amount of data, the current position become final position
+	else{
+
+		int actual_count;
+		//get the scratch buffer to hold the whole object
+		char *temp_buff = scratch_acquire(File[fd].length);
+		if (temp_buff == NULL)
+			return (-1);
+		// send the READ request type and length
+		send = create_crude_opcode(File[fd].oid, CRUD_READ,File[fd].length,0,0);
+		//  read the previous data first, the scratch bytes are stale if it failed
+		if (extract_crude_opcode(crud_client_operation(send, temp_buff)).R != 0 ||
+			verify_object(fd, temp_buff, 0, File[fd].length)) {
+			scratch_release();
+			return (-1);
+		}
+		//This is the actual bytes read 
+		actual_count = File[fd].length - File[fd].current_position;
+		// keeping reading the counts bytes from the previous position by memory copying 
+		memcpy(buf, &temp_buff[File[fd].current_position], actual_count );
+        //reset the current position
+		File[fd].current_position = File[fd].length;
+
+		//printf("read successful!!!!!!!!!!!!!!!!!!!!!");
+		//done with the scratch buffer
+		scratch_release();
+		//return the actual count read
+		return (actual_count);
+		
+	}
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_read
+// Description  : Traced entry point for file_read (see crud_trace.h)
+//
+// Inputs       : fd - the file descriptor for the read
+//                buf - the buffer to place the bytes into
+//                count - the number of bytes to read
+// Outputs      : the number of bytes read or -1 if failures
+
+int32_t crud_read(int16_t fd, void *buf, int32_t count) {
+
+    int32_t result;
+
+    async_exclusive();
+    CRUD_PROBE3(file_entry, "read", fd, count);
+    result = file_read(fd, buf, count);
+    CRUD_PROBE3(file_return, "read", fd, result);
+    return (result);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : file_write
+// Description  : Writes "count" bytes to the file handle "fh" from the
+//                buffer  "buf"
+//
+// Inputs       : fd - the file descriptor for the file to write to
+//                buf - the buffer to write
+//                count - the number of bytes to write
+// Outputs      : the number of bytes written or -1 if failure
+
+static int32_t file_write(int16_t fd, void *buf, int32_t count) {
+
+	uint64_t send, accept;
+
+ 
+ 	//when the flag is 0 , it means the curd is not initialized yet 
+    if (flag == 0){
+        
+        uint64_t send = create_crude_opcode(0, CRUD_INIT, 0, 0, 0); 
+
+        if (extract_crude_opcode(crud_client_operation(send, NULL)).R != 0)
+            return (-1);
+
+        // it is initialized now
+      	flag = 1; 
+
+
+    }
+
+     
+    // anything buffered ahead for this object is about to be stale
+    if (File[fd].oid != 0)
+        readahead_invalidate(File[fd].oid);
+
+    // There are two cases , one is when object does not exist , and another one the object exist.
+
+    // When the object does not exist
+
+    if (File[fd].oid == 0){
+        //  create a new object by using sending CRUD_CREATE type request
+        uint64_t send = create_crude_opcode(0, CRUD_CREATE, count, 0, 0);
+        //  calling the bus 
+        uint64_t accept = crud_client_operation(send, buf);
+
+        Cruid new = extract_crude_opcode(accept);
+        // nothing was stored, leave the file empty
+        if (new.R != 0)
+            return (-1);
+        // reset the oid , length and current length 
+      	File[fd].oid = new.OID;
+        File[fd].checksum = checksums ? crc32c(0, buf, count) : 0;
+        PageDirty[fd / CRUD_FILE_TABLE_PAGE] = 1;
+
+        File[fd].length = count;
+
+        File[fd].current_position = count; 
+
+        sync_if_due();
+
+        return count; 
+	}
+
+    // When the obejct exist already
+    else {
+        
+
+
+     
+        // when writing beyond the total length of the file
+        if (File[fd].current_position + count > File[fd].length)  {
+
+            // get one scratch buffer big enough for the grown object
+            char *temp_buff = scratch_acquire(File[fd].current_position + count);
+            if (temp_buff == NULL)
+                return (-1);
+
+        	// read the current data in the file frist, straight into the new buff
+            send = create_crude_opcode(File[fd].oid, CRUD_READ, File[fd].length, 0, 0);
+
+       	    if (extract_crude_opcode(crud_client_operation(send, temp_buff)).R != 0) {
+                scratch_release();
+                return (-1);
+            }
+
+            // zero any hole left by seeking past the end of the file
+            if (File[fd].current_position > File[fd].length)
+                memset(&temp_buff[File[fd].length], 0, File[fd].current_position - File[fd].length);
+
+            // Then copy new data into buw buff  
+            memcpy(&temp_buff[File[fd].current_position], buf, count);
+
+            // an append only has to checksum the new bytes
+            uint32_t checksum;
+            if (!checksums)
+                checksum = 0;
+            else if (File[fd].checksum != 0 && File[fd].current_position == File[fd].length)
+                checksum = crc32c(File[fd].checksum, buf, count);
+            else
+                checksum = crc32c(0, temp_buff, File[fd].current_position + count);
+
+            // Now Create new object
+            send = create_crude_opcode(0, CRUD_CREATE, File[fd].current_position + count, 0, 0);
+
+            //calling the bus 
+            accept = crud_client_operation(send, temp_buff);
+
+            // extract the accept 
+            Cruid new = extract_crude_opcode(accept);
+           
+            // done with the scratch buffer
+            scratch_release();
+
+            // the old object still holds the file until the new one is stored
+            if (new.R != 0)
+                return (-1);
+          
+
+            // Delete old object
+            send = create_crude_opcode(File[fd].oid, CRUD_DELETE, 0, 0, 0);
+            //calling the bus (the data is safe in the new object, so a failure only leaks the old one)
+            if (extract_crude_opcode(crud_client_operation(send, NULL)).R != 0)
+                logMessage(LOG_WARNING_LEVEL, "CRUD_IO : could not delete replaced object OID %u of [%s]",
+                    File[fd].oid, Names[fd]);
+            crud_metric_add(CRUD_METRIC_RECREATES, 1);
+           
+            
+            // reset the oid , length , and current position
+            File[fd].oid =  new.OID;
+            File[fd].checksum = checksum;
+            PageDirty[fd / CRUD_FILE_TABLE_PAGE] = 1;
+
+            File[fd].length = File[fd].current_position + count;
+
+            File[fd].current_position += count;
+
+            sync_if_due();
+            
+            return count;
+
+        }
+        
+        // aftering  writing counts  it still less than the length of the file
+        else {
+        	// read the current data in the file frist 
+        	send = create_crude_opcode(File[fd].oid, CRUD_READ, File[fd].length, 0, 0);
+
+       		char *temp_read_buff = scratch_acquire(File[fd].length); 
+       		if (temp_read_buff == NULL)
+       		    return (-1);
+       		//calling the bus 
+       	    accept = crud_client_operation(send, temp_read_buff);
+            if (extract_crude_opcode(accept).R != 0) {
+                scratch_release();
+                return (-1);
+            }
+
+            // Copy new data  into the buff
+            memcpy(&temp_read_buff[File[fd].current_position], buf, count);
+
+            // update the object 
+            send = create_crude_opcode(File[fd].oid, CRUD_UPDATE, File[fd].length, 0, 0);
+
+            accept = crud_client_operation(send, temp_read_buff);
+
+            if (extract_crude_opcode(accept).R != 0) {
+                scratch_release();
+                return (-1);
+            }
+            File[fd].checksum = checksums ? crc32c(0, temp_read_buff, File[fd].length) : 0;
+            PageDirty[fd / CRUD_FILE_TABLE_PAGE] = 1;
+
+            // done with the scratch buffer
+            scratch_release();
+            
+         
+         	File[fd].current_position += count;
+
+            sync_if_due();
+            
+            return (count);
+        }
+    }
+
+
+  }  
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_seek
+// Description  : Seek to specific point in the file
+//
+// Inputs       : fd - the file descriptor for the file to seek
+//                loc - offset from beginning of file to seek to
+// Outputs      : 0 if successful or -1 if failure
+
+int32_t crud_seek(int16_t fd, uint32_t loc) {
+
+	async_exclusive();
+	//when the flag is 0 , it means the curd is not initialized yet 
+
+	if(flag == 0){
+
+        uint64_t send;  
+
+        send = create_crude_opcode(0,CRUD_INIT, 0,0,0);
+
+        crud_client_operation(send, NULL);
+	
+		// it is initialized now
+		flag = 1;
+    }
+
+    	//after seek , the current position is local position
+    	CRUD_PROBE3(file_entry, "seek", fd, loc);
+    	File[fd].current_position = loc;
+    	CRUD_PROBE3(file_return, "seek", fd, 0);
+
+
+    	return (0);
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_write
+// Description  : Traced entry point for file_write (see crud_trace.h)
+//
+// Inputs       : fd - the file descriptor for the file to write to
+//                buf - the buffer to write
+//                count - the number of bytes to write
+// Outputs      : the number of bytes written or -1 if failure
+
+int32_t crud_write(int16_t fd, void *buf, int32_t count) {
+
+    int32_t result;
+
+    async_exclusive();
+    CRUD_PROBE3(file_entry, "write", fd, count);
+    result = file_write(fd, buf, count);
+    CRUD_PROBE3(file_return, "write", fd, result);
+    return (result);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : file_readv
+// Description  : Reads several ranges of a file with one bus read (the span
+//                covering them, or the whole object if the server has no
+//                ranged reads).  The file position does not move, and ranges
+//                running past the end of the file come back short.
+//
+// Inputs       : fd - the file descriptor for the read
+//                iov - the ranges and where to put them
+//                iovcnt - the number of ranges
+// Outputs      : the total number of bytes read or -1 if failure
+
+static int32_t file_readv(int16_t fd, CrudIoVec *iov, int iovcnt) {
+
+    uint32_t lo = UINT32_MAX, hi = 0, end;
+    int32_t total = 0;
+    uint64_t send;
+    char *span;
+    Cruid got;
+    int i;
+
+    //when the flag is 0 , it means the curd is not initialized yet
+    if (flag == 0) {
+        crud_client_operation(create_crude_opcode(0, CRUD_INIT, 0, 0, 0), NULL);
+        flag = 1;
+    }
+
+    // the bytes wanted, cut off at the end of the file
+    for (i = 0; i < iovcnt; i++) {
+        if (iov[i].length == 0 || iov[i].offset >= File[fd].length)
+            continue;
+        end = (iov[i].length > File[fd].length - iov[i].offset) ? File[fd].length : iov[i].offset + iov[i].length;
+        if (iov[i].offset < lo)
+            lo = iov[i].offset;
+        if (end > hi)
+            hi = end;
+    }
+    if (File[fd].oid == 0 || hi == 0)
+        return 0;
+
+    // one read covers them all
+    if (crud_network_capabilities & CRUD_RANGE_FLAG) {
+        if ((span = scratch_acquire(hi - lo)) == NULL)
+            return (-1);
+        send = create_crude_opcode(File[fd].oid, CRUD_READ, hi - lo, 0, 0);
+        got = extract_crude_opcode(crud_client_read_range(send, lo, span));
+    } else {
+        lo = 0;
+        if ((span = scratch_acquire(File[fd].length)) == NULL)
+            return (-1);
+        send = create_crude_opcode(File[fd].oid, CRUD_READ, File[fd].length, 0, 0);
+        got = extract_crude_opcode(crud_client_operation(send, span));
+    }
+    if (got.R != 0 || lo + got.Length < hi || verify_object(fd, span, lo, got.Length)) {
+        scratch_release();
+        return (-1);
+    }
+
+    // then hand out the pieces
+    for (i = 0; i < iovcnt; i++) {
+        if (iov[i].length == 0 || iov[i].offset >= File[fd].length)
+            continue;
+        end = (iov[i].length > File[fd].length - iov[i].offset) ? File[fd].length : iov[i].offset + iov[i].length;
+        memcpy(iov[i].base, &span[iov[i].offset - lo], end - iov[i].offset);
+        total += end - iov[i].offset;
+    }
+    scratch_release();
+
+    return (total);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_readv
+// Description  : Traced entry point for file_readv (see crud_trace.h)
+//
+// Inputs       : fd - the file descriptor for the read
+//                iov - the ranges and where to put them
+//                iovcnt - the number of ranges
+// Outputs      : the total number of bytes read or -1 if failure
+
+int32_t crud_readv(int16_t fd, CrudIoVec *iov, int iovcnt) {
+
+    int32_t result;
+
+    async_exclusive();
+    CRUD_PROBE3(file_entry, "readv", fd, iovcnt);
+    result = file_readv(fd, iov, iovcnt);
+    CRUD_PROBE3(file_return, "readv", fd, result);
+    return (result);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : file_writev
+// Description  : Writes several ranges of a file (in order, so later ones win
+//                where they overlap) with one object write: an UPDATE if the
+//                file keeps its size, otherwise a new object in place of the
+//                old one.  The file position does not move, and a hole left
+//                past the old end of the file reads as zeros.
+//
+// Inputs       : fd - the file descriptor for the write
+//                iov - the ranges and their bytes
+//                iovcnt - the number of ranges
+// Outputs      : the total number of bytes written or -1 if failure
+
+static int32_t file_writev(int16_t fd, CrudIoVec *iov, int iovcnt) {
+
+    uint32_t length = File[fd].length;
+    int32_t total = 0;
+    uint64_t send;
+    char *temp_buff;
+    Cruid got;
+    int i;
+
+    //when the flag is 0 , it means the curd is not initialized yet
+    if (flag == 0) {
+        crud_client_operation(create_crude_opcode(0, CRUD_INIT, 0, 0, 0), NULL);
+        flag = 1;
+    }
+
+    // how big the file ends up
+    for (i = 0; i < iovcnt; i++) {
+        if (iov[i].length == 0)
+            continue;
+        if (iov[i].offset > CRUD_MAX_OBJECT_SIZE || iov[i].length > CRUD_MAX_OBJECT_SIZE - iov[i].offset)
+            return (-1);
+        if (iov[i].offset + iov[i].length > length)
+            length = iov[i].offset + iov[i].length;
+        total += iov[i].length;
+    }
+    if (total == 0)
+        return 0;
+
+    // the old contents, then the new ranges over them
+    if (File[fd].oid != 0)
+        readahead_invalidate(File[fd].oid);
+    if ((temp_buff = scratch_acquire(length)) == NULL)
+        return (-1);
+    if (File[fd].oid != 0) {
+        send = create_crude_opcode(File[fd].oid, CRUD_READ, File[fd].length, 0, 0);
+        got = extract_crude_opcode(crud_client_operation(send, temp_buff));
+        if (got.R != 0 || verify_object(fd, temp_buff, 0, File[fd].length)) {
+            scratch_release();
+            return (-1);
+        }
+    }
+    memset(&temp_buff[File[fd].length], 0, length - File[fd].length);
+    for (i = 0; i < iovcnt; i++)
+        memcpy(&temp_buff[iov[i].offset], iov[i].base, iov[i].length);
+
+    // same size is an update, otherwise a new object replaces the old one
+    if (File[fd].oid != 0 && length == File[fd].length) {
+        send = create_crude_opcode(File[fd].oid, CRUD_UPDATE, length, 0, 0);
+        got = extract_crude_opcode(crud_client_operation(send, temp_buff));
+        got.OID = File[fd].oid;
+    } else {
+        send = create_crude_opcode(0, CRUD_CREATE, length, 0, 0);
+        got = extract_crude_opcode(crud_client_operation(send, temp_buff));
+        if (got.R == 0 && File[fd].oid != 0) {
+            crud_client_operation(create_crude_opcode(File[fd].oid, CRUD_DELETE, 0, 0, 0), NULL);
+            crud_metric_add(CRUD_METRIC_RECREATES, 1);
+        }
+    }
+    if (got.R != 0) {
+        scratch_release();
+        return (-1);
+    }
+    File[fd].oid = got.OID;
+    File[fd].length = length;
+    File[fd].checksum = checksums ? crc32c(0, temp_buff, length) : 0;
+    PageDirty[fd / CRUD_FILE_TABLE_PAGE] = 1;
+    scratch_release();
+
+    sync_if_due();
+
+    return (total);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_writev
+// Description  : Traced entry point for file_writev (see crud_trace.h)
+//
+// Inputs       : fd - the file descriptor for the write
+//                iov - the ranges and their bytes
+//                iovcnt - the number of ranges
+// Outputs      : the total number of bytes written or -1 if failure
+
+int32_t crud_writev(int16_t fd, CrudIoVec *iov, int iovcnt) {
+
+    int32_t result;
+
+    async_exclusive();
+    CRUD_PROBE3(file_entry, "writev", fd, iovcnt);
+    result = file_writev(fd, iov, iovcnt);
+    CRUD_PROBE3(file_return, "writev", fd, result);
+    return (result);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_pread
+// Description  : Reads up to "count" bytes at "offset" without moving the
+//                file position
+//
+// Inputs       : fd - the file descriptor for the read
+//                buf - the buffer to place the bytes into
+//                count - the number of bytes to read
+//                offset - where to read from in the file
+// Outputs      : the number of bytes read or -1 if failure
+
+int32_t crud_pread(int16_t fd, void *buf, int32_t count, uint32_t offset) {
+
+    CrudIoVec iov = { buf, offset, (count > 0) ? count : 0 };
+    int32_t result;
+
+    async_exclusive();
+    CRUD_PROBE3(file_entry, "pread", fd, count);
+    result = crud_readv(fd, &iov, 1);
+    CRUD_PROBE3(file_return, "pread", fd, result);
+    return (result);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_pwrite
+// Description  : Writes "count" bytes at "offset" without moving the file
+//                position
+//
+// Inputs       : fd - the file descriptor for the write
+//                buf - the bytes to write
+//                count - the number of bytes to write
+//                offset - where to write in the file
+// Outputs      : the number of bytes written or -1 if failure
+
+int32_t crud_pwrite(int16_t fd, void *buf, int32_t count, uint32_t offset) {
+
+    CrudIoVec iov = { buf, offset, (count > 0) ? count : 0 };
+    int32_t result;
+
+    async_exclusive();
+    CRUD_PROBE3(file_entry, "pwrite", fd, count);
+    result = crud_writev(fd, &iov, 1);
+    CRUD_PROBE3(file_return, "pwrite", fd, result);
+    return (result);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : file_clone
+// Description  : This function makes a new file with the contents of another.
+//                When the server serves CRUD_CLONE the two share storage
+//                until one is written and nothing but the request crosses the
+//                bus; otherwise the object is read and created again.
+//
+// Inputs       : src - the file to copy
+//                dst - the name of the new file (must not exist)
+// Outputs      : the new file's handle (open, at position 0), -1 if failure
+
+static int16_t file_clone(char *src, char *dst) {
+
+    uint64_t send, accept;
+    int16_t sfd, dfd;
+    char *temp_buff;
+    Cruid got;
+
+    //when the flag is 0 , it means the curd is not initialized yet
+    if (flag == 0) {
+        send = create_crude_opcode(0, CRUD_INIT, 0, 0, 0);
+        crud_client_operation(send, NULL);
+        flag = 1;
+    }
+
+    // the source has to be there and the new name free
+    if (src == NULL || dst == NULL || (sfd = crud_find(src)) == -1) {
+        logMessage(LOG_ERROR_LEVEL, "CRUD_IO : clone of unknown file [%s]", src ? src : "");
+        return (-1);
+    }
+    if (dst[0] == 0 || strlen(dst) >= CRUD_MAX_PATH_LENGTH || crud_find(dst) != -1) {
+        logMessage(LOG_ERROR_LEVEL, "CRUD_IO : bad or existing clone name [%s]", dst);
+        return (-1);
+    }
+
+    // copy the object, if the file has one yet
+    got.OID = 0;
+    if (File[sfd].oid != 0) {
+        if (crud_network_features & CRUD_FEATURE_CLONE) {
+            send = create_crude_opcode(File[sfd].oid, CRUD_CLONE, 0, 0, 0);
+            accept = crud_client_operation(send, NULL);
+        } else {
+            if ((temp_buff = scratch_acquire(File[sfd].length)) == NULL)
+                return (-1);
+            send = create_crude_opcode(File[sfd].oid, CRUD_READ, File[sfd].length, 0, 0);
+            accept = crud_client_operation(send, temp_buff);
+            if (crud_request_result(accept) == 0 && verify_object(sfd, temp_buff, 0, File[sfd].length) == 0) {
+                send = create_crude_opcode(0, CRUD_CREATE, File[sfd].length, 0, 0);
+                accept = crud_client_operation(send, temp_buff);
+            } else {
+                accept = -1;
+            }
+            scratch_release();
+        }
+        got = extract_crude_opcode(accept);
+        if (got.R != 0) {
+            logMessage(LOG_ERROR_LEVEL, "CRUD_IO : clone of [%s] OID %u failed", src, File[sfd].oid);
+            return (-1);
+        }
+    }
+
+    // then the new entry pointing at it (or the copy is dropped again)
+    if ((dfd = crud_open(dst)) == -1) {
+        if (got.OID != 0) {
+            send = create_crude_opcode(got.OID, CRUD_DELETE, 0, 0, 0);
+            if (crud_request_result(crud_client_operation(send, NULL)) != 0)
+                logMessage(LOG_WARNING_LEVEL, "CRUD_IO : clone OID %u left behind", got.OID);
+        }
+        return (-1);
+    }
+    File[dfd].oid = got.OID;
+    File[dfd].length = File[sfd].length;
+    File[dfd].checksum = File[sfd].checksum;
+    PageDirty[dfd / CRUD_FILE_TABLE_PAGE] = 1;
+
+    sync_if_due();
+
+    return (dfd);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_clone
+// Description  : Traced entry point for file_clone (see crud_trace.h)
+//
+// Inputs       : src - the file to copy
+//                dst - the name of the new file (must not exist)
+// Outputs      : the new file's handle (open, at position 0), -1 if failure
+
+int16_t crud_clone(char *src, char *dst) {
+
+    int16_t result;
+
+    async_exclusive();
+    CRUD_PROBE3(file_entry, "clone", -1, 0);
+    result = file_clone(src, dst);
+    CRUD_PROBE3(file_return, "clone", -1, result);
+    return (result);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : file_snapshot
+// Description  : This function clones every file in the table, naming each
+//                copy after its file with a suffix, for a point in time copy
+//                of the whole file system
+//
+// Inputs       : suffix - added to each file name (e.g. ".snap1")
+// Outputs      : the number of files copied, -1 if failure
+
+static int32_t file_snapshot(char *suffix) {
+
+    char name[CRUD_MAX_PATH_LENGTH];
+    uint32_t page, count, fd;
+    int32_t made = 0;
+    int16_t copy;
+
+    if (suffix == NULL || suffix[0] == 0)
+        return (-1);
+
+    // every name has to be in memory, and copies made here are not copied again
+    for (page = 0; page < page_count; page++) {
+        if (!PageLoaded[page] && load_page(page))
+            return (-1);
+    }
+    count = file_count;
+
+    for (fd = 0; fd < count; fd++) {
+        if (Names[fd][0] == 0)
+            continue;
+        if (strlen(Names[fd]) + strlen(suffix) >= CRUD_MAX_PATH_LENGTH) {
+            logMessage(LOG_ERROR_LEVEL, "CRUD_IO : snapshot name too long for [%s]", Names[fd]);
+            return (-1);
+        }
+        snprintf(name, sizeof(name), "%s%s", Names[fd], suffix);
+        if ((copy = crud_clone(Names[fd], name)) == -1)
+            return (-1);
+        File[copy].open = 0;
+        made++;
+    }
+
+    return (made);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_snapshot
+// Description  : Traced entry point for file_snapshot (see crud_trace.h)
+//
+// Inputs       : suffix - added to each file name (e.g. ".snap1")
+// Outputs      : the number of files copied, -1 if failure
+
+int32_t crud_snapshot(char *suffix) {
+
+    int32_t result;
+
+    async_exclusive();
+    CRUD_PROBE3(file_entry, "snapshot", -1, 0);
+    result = file_snapshot(suffix);
+    CRUD_PROBE3(file_return, "snapshot", -1, result);
+    return (result);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : file_create_files
+// Description  : This function adds many new files with their contents at
+//                once.  Their objects are created CRUD_CREATE_BATCH at a time
+//                with one round trip each (see crud_client_batch), and the
+//                file table is written once at the end.  Entries whose object
+//                could not be created are taken out again, so nothing in the
+//                table points at OID 0 with a length.
+//
+// Inputs       : count - the number of files
+//                paths - their names (files that already exist are skipped)
+//                bufs - their contents
+//                lengths - their sizes
+// Outputs      : the number of files created, -1 if failure
+
+static int32_t file_create_files(uint32_t count, char **paths, void **bufs, uint32_t *lengths) {
+
+    CrudRequest ops[CRUD_CREATE_BATCH];
+    CrudResponse responses[CRUD_CREATE_BATCH];
+    void *data[CRUD_CREATE_BATCH];
+    int16_t fds[CRUD_CREATE_BATCH], fd;
+    uint32_t i, next = 0, n;
+    int32_t created = 0;
+    int failed = 0;
+
+    //when the flag is 0 , it means the curd is not initialized yet
+    if (flag == 0) {
+        crud_client_operation(create_crude_opcode(0, CRUD_INIT, 0, 0, 0), NULL);
+        flag = 1;
+    }
+
+    while (next < count) {
+
+        // add the entries of the next batch, empty files need no object
+        for (n = 0; next < count && n < CRUD_CREATE_BATCH; next++) {
+            if (paths[next] == NULL || paths[next][0] == 0 || strlen(paths[next]) >= CRUD_MAX_PATH_LENGTH ||
+                lengths[next] > CRUD_MAX_OBJECT_SIZE || crud_find(paths[next]) != -1) {
+                logMessage(LOG_WARNING_LEVEL, "CRUD_IO : not creating [%s], bad name, too big or already there",
+                    paths[next] ? paths[next] : "");
+                continue;
+            }
+            if ((fd = add_file(paths[next])) == -1) {
+                failed = 1;
+                break;
+            }
+            File[fd].length = lengths[next];
+            File[fd].checksum = (checksums && lengths[next]) ? crc32c(0, bufs[next], lengths[next]) : 0;
+            if (lengths[next] == 0) {
+                created++;
+                continue;
+            }
+            fds[n] = fd;
+            data[n] = bufs[next];
+            ops[n++] = create_crude_opcode(0, CRUD_CREATE, lengths[next], 0, 0);
+        }
+
+        // then create their objects in one go
+        if (!failed && n > 0 && crud_client_batch(ops, data, responses, n) == -1) {
+            logMessage(LOG_ERROR_LEVEL, "CRUD_IO : batch create failed on the bus");
+            failed = 1;
+        }
+        if (failed) {
+            // drop this batch's entries, but keep the files already made
+            for (i = 0; i < n; i++)
+                remove_file(fds[i]);
+            crud_sync();
+            return (-1);
+        }
+        for (i = 0; i < n; i++) {
+            if (crud_request_result(responses[i]) != 0) {
+                logMessage(LOG_ERROR_LEVEL, "CRUD_IO : create failed for [%s]", Names[fds[i]]);
+                remove_file(fds[i]);
+                continue;
+            }
+            File[fds[i]].oid = crud_request_oid(responses[i]);
+            created++;
+        }
+    }
+
+    // one table update for the lot
+    if (crud_sync())
+        return (-1);
+
+    return (created);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_create_files
+// Description  : Traced entry point for file_create_files (see crud_trace.h)
+//
+// Inputs       : count - the number of files
+//                paths - their names (files that already exist are skipped)
+//                bufs - their contents
+//                lengths - their sizes
+// Outputs      : the number of files created, -1 if failure
+
+int32_t crud_create_files(uint32_t count, char **paths, void **bufs, uint32_t *lengths) {
+
+    int32_t result;
+
+    async_exclusive();
+    CRUD_PROBE3(file_entry, "create_files", -1, count);
+    result = file_create_files(count, paths, bufs, lengths);
+    CRUD_PROBE3(file_return, "create_files", -1, result);
+    return (result);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : async_blocked
+// Description  : Whether a read (or write) has to wait for an earlier write
+//                (or read) of the same file that is still queued
+//
+// Inputs       : op - the operation
+// Outputs      : 1 if it has to wait, 0 if not
+
+static int async_blocked(int32_t op) {
+
+    int c = (async.ops[op].kind == CRUD_ASYNC_READ) ? CRUD_SCHED_BULK : CRUD_SCHED_READ;
+    int32_t o;
+
+    if (async.ops[op].kind >= CRUD_ASYNC_OPEN)
+        return (0);
+    for (o = async.head[c]; (o != -1) && (async.ops[o].seq < async.ops[op].seq); o = async.ops[o].next) {
+        if (async.ops[o].fd == async.ops[op].fd)
+            return (1);
+    }
+
+    return (0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : async_next_batch
+// Description  : Pick the next operations to run (with the lock held).  The
+//                first class with queued work and turns left this round takes
+//                a turn: one metadata operation, or a run of reads or writes
+//                of one file from the head of the queue, writes stopping at
+//                the bulk byte cap.  When no class can go, they all get their
+//                weight of turns back.
+//
+// Inputs       : batch - where to put the operations
+// Outputs      : the number of operations taken, 0 if the queues are empty
+
+static int async_next_batch(int32_t *batch) {
+
+    uint32_t bytes;
+    int32_t op;
+    int pass, c, n;
+
+    for (pass = 0; pass < 2; pass++) {
+        for (c = 0; c < CRUD_SCHED_CLASSES; c++) {
+            op = async.head[c];
+            if ((op == -1) || (async.credit[c] == 0) || async_blocked(op))
+                continue;
+            n = 0;
+            bytes = 0;
+            do {
+                batch[n++] = op;
+                bytes += async.ops[op].iov.length;
+                op = async.ops[op].next;
+            } while ((c != CRUD_SCHED_META) && (op != -1) && (async.ops[op].fd == async.ops[batch[0]].fd) &&
+                ((c != CRUD_SCHED_BULK) || (bytes + async.ops[op].iov.length <= async.bulk_bytes)) &&
+                !async_blocked(op));
+            async.head[c] = op;
+            if (op == -1)
+                async.tail[c] = -1;
+            async.credit[c]--;
+            return (n);
+        }
+        memcpy(async.credit, async.weight, sizeof(async.credit));
+    }
+
+    return (0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : async_worker
+// Description  : The I/O thread: run what async_next_batch picks until asked
+//                to stop
+//
+// Inputs       : arg - unused
+// Outputs      : NULL
+
+static void *async_worker(void *arg) {
+
+    CrudIoVec iov[CRUD_ASYNC_MAX_OPS];
+    int32_t batch[CRUD_ASYNC_MAX_OPS];
+    CRUD_ASYNC_KIND kind;
+    CRUD_SCHED_CLASS c;
+    struct timeval now;
+    uint64_t wait;
+    int32_t total;
+    uint32_t length;
+    int16_t fd;
+    int n, i;
+    async_op *op;
+
+    pthread_mutex_lock(&async.lock);
+    while (1) {
+        n = 0;
+        while (async.held || ((n = async_next_batch(batch)) == 0)) {
+            if (!async.held && async.stopping)
+                break;
+            pthread_cond_wait(&async.queued, &async.lock);
+        }
+        if (n == 0)
+            break;
+        kind = async.ops[batch[0]].kind;
+        fd = async.ops[batch[0]].fd;
+        for (i = 0; i < n; i++)
+            iov[i] = async.ops[batch[i]].iov;
+        pthread_mutex_unlock(&async.lock);
+
+        // one bus operation for all of them, then work out each one's share
+        switch (kind) {
+        case CRUD_ASYNC_READ:
+            total = crud_readv(fd, iov, n);
+            break;
+        case CRUD_ASYNC_WRITE:
+            total = crud_writev(fd, iov, n);
+            break;
+        case CRUD_ASYNC_OPEN:
+            total = crud_open(async.ops[batch[0]].path);
+            break;
+        default:
+            total = crud_sync();
+            break;
+        }
+        length = (kind == CRUD_ASYNC_READ) ? File[fd].length : 0;
+        for (i = 0; i < n; i++) {
+            op = &async.ops[batch[i]];
+            if ((total == -1) || (kind >= CRUD_ASYNC_OPEN))
+                op->result = total;
+            else if (kind == CRUD_ASYNC_WRITE)
+                op->result = op->iov.length;
+            else
+                op->result = (op->iov.offset >= length) ? 0 :
+                    ((op->iov.length > length - op->iov.offset) ? length - op->iov.offset : op->iov.length);
+            if (op->callback != NULL)
+                op->callback(batch[i], op->result, op->arg);
+        }
+
+        // callback operations are over, the rest wait to be collected
+        gettimeofday(&now, NULL);
+        c = async_class[kind];
+        pthread_mutex_lock(&async.lock);
+        for (i = 0; i < n; i++) {
+            op = &async.ops[batch[i]];
+            wait = compareTimes(&op->queued, &now);
+            async.stats.wait_usec[c] += wait;
+            if (wait > async.stats.max_usec[c])
+                async.stats.max_usec[c] = wait;
+            op->state = (op->callback != NULL) ? CRUD_ASYNC_FREE : CRUD_ASYNC_DONE;
+        }
+        async.stats.operations[c] += n;
+        async.stats.batches[c]++;
+        async.outstanding -= n;
+        pthread_cond_broadcast(&async.finished);
+    }
+    pthread_mutex_unlock(&async.lock);
+
+    return (NULL);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : async_submit
+// Description  : Queue an operation for the I/O thread (starting it the first
+//                time), waiting for a free slot if they are all in use
+//
+// Inputs       : kind - what to do
+//                fd, buf, count, offset - the read or write
+//                path - the file to open
+//                callback, arg - what to call when it is done (or NULL)
+// Outputs      : the handle or -1 if failure
+
+static int32_t async_submit(CRUD_ASYNC_KIND kind, int16_t fd, void *buf, int32_t count, uint32_t offset,
+        char *path, CrudAsyncCallback callback, void *arg) {
+
+    CRUD_SCHED_CLASS c = async_class[kind];
+    int32_t handle;
+    async_op *op;
+
+    // file_count only changes on the I/O thread (opens) or when nothing is
+    // queued, so it is checked with the lock held
+    pthread_mutex_lock(&async.lock);
+    if (((kind <= CRUD_ASYNC_WRITE) && ((fd < 0) || ((uint32_t)fd >= file_count) || (count < 0))) ||
+        ((kind == CRUD_ASYNC_OPEN) && ((path == NULL) || (strlen(path) >= CRUD_MAX_PATH_LENGTH)))) {
+        pthread_mutex_unlock(&async.lock);
+        logMessage(LOG_ERROR_LEVEL, "CRUD_IO : bad asynchronous %s [fd %d, %d bytes]",
+            async_class_labels[c], fd, count);
+        return (-1);
+    }
+    if (!async.running) {
+        for (handle = 0; handle < CRUD_SCHED_CLASSES; handle++)
+            async.head[handle] = async.tail[handle] = -1;
+        if (pthread_create(&async.thread, NULL, async_worker, NULL) != 0) {
+            pthread_mutex_unlock(&async.lock);
+            logMessage(LOG_ERROR_LEVEL, "CRUD_IO : failed to start the I/O thread.");
+            return (-1);
+        }
+        async.running = 1;
+    }
+    while (1) {
+        for (handle = 0; (handle < CRUD_ASYNC_MAX_OPS) && (async.ops[handle].state != CRUD_ASYNC_FREE); handle++);
+        if (handle < CRUD_ASYNC_MAX_OPS)
+            break;
+        pthread_cond_wait(&async.finished, &async.lock);
+    }
+
+    op = &async.ops[handle];
+    op->state = CRUD_ASYNC_QUEUED;
+    op->kind = kind;
+    op->fd = fd;
+    op->iov.base = buf;
+    op->iov.offset = offset;
+    op->iov.length = count;
+    if (path != NULL)
+        strcpy(op->path, path);
+    op->callback = callback;
+    op->arg = arg;
+    op->result = 0;
+    op->next = -1;
+    op->seq = async.seq++;
+    gettimeofday(&op->queued, NULL);
+    if (async.tail[c] == -1)
+        async.head[c] = handle;
+    else
+        async.ops[async.tail[c]].next = handle;
+    async.tail[c] = handle;
+    async.outstanding++;
+    pthread_cond_signal(&async.queued);
+    pthread_mutex_unlock(&async.lock);
+
+    return (handle);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_read_async
+// Description  : Queue a read of "count" bytes at "offset".  It runs after
+//                every write to the file queued before it; the callback (if
+//                any) is called on the I/O thread, otherwise the result is
+//                collected with crud_async_poll or crud_async_wait.
+//
+// Inputs       : fd - the file descriptor for the read
+//                buf - the buffer to place the bytes into
+//                count - the number of bytes to read
+//                offset - where to read from in the file
+//                callback - called with the result when done, or NULL
+//                arg - passed to the callback
+// Outputs      : the handle or -1 if failure
 
+int32_t crud_read_async(int16_t fd, void *buf, int32_t count, uint32_t offset,
+        CrudAsyncCallback callback, void *arg) {
 
-			// create a temp buff
-            char *temp_buff = malloc(File[fd].current_position + count);
+    int32_t handle;
 
-            // First copy old data into new  buff first 
-            memcpy(temp_buff, temp_read_buff, File[fd].length);
+    CRUD_PROBE3(file_entry, "read_async", fd, count);
+    handle = async_submit(CRUD_ASYNC_READ, fd, buf, count, offset, NULL, callback, arg);
+    CRUD_PROBE3(file_return, "read_async", fd, handle);
+    return (handle);
+}
 
-            // Then copy new data into buw buff  
-            memcpy(&temp_buff[File[fd].current_position], buf, count);
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_write_async
+// Description  : Queue a write of "count" bytes at "offset" (see
+//                crud_read_async); buf must be left alone until it is done
+//
+// Inputs       : fd - the file descriptor for the write
+//                buf - the bytes to write
+//                count - the number of bytes to write
+//                offset - where to write in the file
+//                callback - called with the result when done, or NULL
+//                arg - passed to the callback
+// Outputs      : the handle or -1 if failure
 
-            // Now Create new object
-            send = create_crude_opcode(0, CRUD_CREATE, File[fd].current_position + count, 0, 0);
+int32_t crud_write_async(int16_t fd, void *buf, int32_t count, uint32_t offset,
+        CrudAsyncCallback callback, void *arg) {
 
-            //calling the bus 
-            accept = crud_client_operation(send, temp_buff);
+    int32_t handle;
 
-            // extract the accept 
-            Cruid new = extract_crude_opcode(accept);
-           
-            // Free memory
-			free(temp_read_buff);
+    CRUD_PROBE3(file_entry, "write_async", fd, count);
+    handle = async_submit(CRUD_ASYNC_WRITE, fd, buf, count, offset, NULL, callback, arg);
+    CRUD_PROBE3(file_return, "write_async", fd, handle);
+    return (handle);
+}
 
-            free(temp_buff);
-          
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_open_async
+// Description  : Queue an open (see crud_open) as metadata work, the result
+//                is the file descriptor
+//
+// Inputs       : path - the file to open (copied)
+//                callback - called with the result when done, or NULL
+//                arg - passed to the callback
+// Outputs      : the handle or -1 if failure
 
-            // Delete old object
-            send = create_crude_opcode(File[fd].oid, CRUD_DELETE, 0, 0, 0);
-            //calling the bus 
-            crud_client_operation(send, NULL);
-           
-            
-            // reset the oid , length , and current position
-            File[fd].oid =  new.OID;
+int32_t crud_open_async(char *path, CrudAsyncCallback callback, void *arg) {
 
-            File[fd].length = File[fd].current_position + count;
+    int32_t handle;
 
-            File[fd].current_position += count;
+    CRUD_PROBE3(file_entry, "open_async", -1, 0);
+    handle = async_submit(CRUD_ASYNC_OPEN, -1, NULL, 0, 0, path, callback, arg);
+    CRUD_PROBE3(file_return, "open_async", -1, handle);
+    return (handle);
+}
 
-            
-            return count;
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_sync_async
+// Description  : Queue a sync of the file table (see crud_sync) as metadata
+//                work, the result is 0 or -1
+//
+// Inputs       : callback - called with the result when done, or NULL
+//                arg - passed to the callback
+// Outputs      : the handle or -1 if failure
 
-        }
-        
-        // aftering  writing counts  it still less than the length of the file
-        else {
-        	// read the current data in the file frist 
-        	send = create_crude_opcode(File[fd].oid, CRUD_READ, File[fd].length, 0, 0);
+int32_t crud_sync_async(CrudAsyncCallback callback, void *arg) {
 
-       		char *temp_read_buff = malloc(File[fd].length); 
-       		//calling the bus 
-       	    accept = crud_client_operation(send, temp_read_buff);
+    int32_t handle;
 
-            // Copy new data  into the buff
-            memcpy(&temp_read_buff[File[fd].current_position], buf, count);
+    CRUD_PROBE3(file_entry, "sync_async", -1, 0);
+    handle = async_submit(CRUD_ASYNC_SYNC, -1, NULL, 0, 0, NULL, callback, arg);
+    CRUD_PROBE3(file_return, "sync_async", -1, handle);
+    return (handle);
+}
 
-            // update the object 
-            send = create_crude_opcode(File[fd].oid, CRUD_UPDATE, File[fd].length, 0, 0);
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_set_schedule
+// Description  : Set how the I/O thread shares its turns: each round the
+//                metadata, read and bulk write queues get up to their weight
+//                of turns, in that order, and one turn writes at most
+//                bulk_bytes (unless a single write is bigger)
+//
+// Inputs       : meta_weight, read_weight, bulk_weight - turns per round (at
+//                least 1)
+//                bulk_bytes - most write bytes per turn, 0 for no cap
+// Outputs      : none
+
+void crud_set_schedule(uint32_t meta_weight, uint32_t read_weight, uint32_t bulk_weight, uint32_t bulk_bytes) {
+
+    pthread_mutex_lock(&async.lock);
+    async.weight[CRUD_SCHED_META] = meta_weight ? meta_weight : 1;
+    async.weight[CRUD_SCHED_READ] = read_weight ? read_weight : 1;
+    async.weight[CRUD_SCHED_BULK] = bulk_weight ? bulk_weight : 1;
+    memcpy(async.credit, async.weight, sizeof(async.credit));
+    async.bulk_bytes = bulk_bytes ? bulk_bytes : UINT32_MAX;
+    pthread_mutex_unlock(&async.lock);
+}
 
-            accept = crud_client_operation(send, temp_read_buff);
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_get_schedule_stats
+// Description  : Get the scheduler's per class counters
+//
+// Inputs       : stats - where to put them
+// Outputs      : none
 
-            extract_crude_opcode(accept);
+void crud_get_schedule_stats(CrudScheduleStats *stats) {
 
-            // Free memory
-            free(temp_read_buff);
-            
-         
-         	File[fd].current_position += count;
+    pthread_mutex_lock(&async.lock);
+    *stats = async.stats;
+    pthread_mutex_unlock(&async.lock);
+}
 
-            
-            return (count);
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_async_poll
+// Description  : Check whether an operation (without a callback) is done; if
+//                it is, its result is returned and the handle is released
+//
+// Inputs       : handle - the operation
+//                result - where to put its result
+// Outputs      : 1 if done, 0 if not yet, -1 if the handle is bad
+
+int crud_async_poll(int32_t handle, int32_t *result) {
+
+    int done = -1;
+
+    if ((handle < 0) || (handle >= CRUD_ASYNC_MAX_OPS))
+        return (-1);
+    pthread_mutex_lock(&async.lock);
+    if ((async.ops[handle].state != CRUD_ASYNC_FREE) && (async.ops[handle].callback == NULL)) {
+        done = (async.ops[handle].state == CRUD_ASYNC_DONE);
+        if (done) {
+            *result = async.ops[handle].result;
+            async.ops[handle].state = CRUD_ASYNC_FREE;
+            pthread_cond_broadcast(&async.finished);
         }
     }
+    pthread_mutex_unlock(&async.lock);
 
-
-  }  
+    return (done);
+}
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : crud_seek
-// Description  : Seek to specific point in the file
+// Function     : crud_async_wait
+// Description  : Wait for an operation (without a callback) and release its
+//                handle
 //
-// Inputs       : fd - the file descriptor for the file to seek
-//                loc - offset from beginning of file to seek to
-// Outputs      : 0 if successful or -1 if failure
-
-int32_t crud_seek(int16_t fd, uint32_t loc) {
-
-	
-	//when the flag is 0 , it means the curd is not initialized yet 
+// Inputs       : handle - the operation
+// Outputs      : its result, -1 if it failed or the handle is bad
+
+int32_t crud_async_wait(int32_t handle) {
+
+    int32_t result = -1;
+
+    if ((handle < 0) || (handle >= CRUD_ASYNC_MAX_OPS))
+        return (-1);
+    pthread_mutex_lock(&async.lock);
+    if ((async.ops[handle].state != CRUD_ASYNC_FREE) && (async.ops[handle].callback == NULL)) {
+        while (async.ops[handle].state != CRUD_ASYNC_DONE)
+            pthread_cond_wait(&async.finished, &async.lock);
+        result = async.ops[handle].result;
+        async.ops[handle].state = CRUD_ASYNC_FREE;
+        pthread_cond_broadcast(&async.finished);
+    }
+    pthread_mutex_unlock(&async.lock);
 
-	if(flag == 0){
+    return (result);
+}
 
-        uint64_t send;  
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_async_drain
+// Description  : Wait until every queued operation has run (results that are
+//                not collected yet stay available)
+//
+// Inputs       : none
+// Outputs      : none
 
-        send = create_crude_opcode(0,CRUD_INIT, 0,0,0);
+void crud_async_drain(void) {
 
-        crud_client_operation(send, NULL);
-	
-		// it is initialized now
-		flag = 1;
-    }
+    pthread_mutex_lock(&async.lock);
+    while (async.outstanding > 0)
+        pthread_cond_wait(&async.finished, &async.lock);
+    pthread_mutex_unlock(&async.lock);
+}
 
-    	//after seek , the current position is local position
-    	File[fd].current_position = loc;
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : async_stop
+// Description  : Drain the queue and stop the I/O thread (at unmount)
+//
+// Inputs       : none
+// Outputs      : none
 
+static void async_stop(void) {
 
-    	return (0);
+    int c;
 
+    pthread_mutex_lock(&async.lock);
+    if (!async.running) {
+        pthread_mutex_unlock(&async.lock);
+        return;
+    }
+    async.stopping = 1;
+    pthread_cond_signal(&async.queued);
+    pthread_mutex_unlock(&async.lock);
+    pthread_join(async.thread, NULL);
+
+    for (c = 0; c < CRUD_SCHED_CLASSES; c++) {
+        if (async.stats.operations[c] == 0)
+            continue;
+        logMessage(LOG_INFO_LEVEL, "CRUD_IO : asynchronous %s: %lu operations in %lu turns, wait mean %lu usec, max %lu usec",
+            async_class_labels[c], async.stats.operations[c], async.stats.batches[c],
+            async.stats.wait_usec[c] / async.stats.operations[c], async.stats.max_usec[c]);
+    }
+    async.running = async.stopping = 0;
 }
 
-
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : crud_format
+// Function     : file_format
 // Description  : This function formats the crud drive, and adds the file
 //                allocation table.
 //
 // Inputs       : none
 // Outputs      : 0 if successful, -1 if failure
 
-uint16_t crud_format(void) {
+static uint16_t file_format(void) {
     
   
     uint64_t send;
 
     //when the flag is 0 , it means the curd is not initialized yet 
-    if (flag == 0){
+    // (or again, after a lost connection ended the session)
+    if (flag == 0 || !crud_client_session()){
         
         send = create_crude_opcode(0, CRUD_INIT, 0, 0, 0); 
         crud_client_operation(send, NULL);
@@ -513,17 +2784,46 @@ uint16_t crud_format(void) {
     // Format
     send = create_crude_opcode(0, CRUD_FORMAT, 0, CRUD_NULL_FLAG, 0);
     crud_client_operation(send, NULL);
-    // Create priority object 
-    send = create_crude_opcode(0, CRUD_CREATE, CRUD_MAX_TOTAL_FILES*sizeof(file), CRUD_PRIORITY_OBJECT, 0);
-    crud_client_operation(send, File);
+
+    // Create priority object holding an empty file table, with room for the largest
+    reset_file_table();
+    table_size = CRUD_TABLE_SIZE;
+    char *table = save_file_table(table_size);
+    if (table == NULL)
+        return (-1);
+    send = create_crude_opcode(0, CRUD_CREATE, table_size, CRUD_PRIORITY_OBJECT, 0);
+    if (extract_crude_opcode(crud_client_operation(send, table)).R != 0)
+        return (-1);
+    header_dirty = 0;
+    last_sync = time(NULL);
+    scratch_release();
     return(0);
     
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_format
+// Description  : Traced entry point for file_format (see crud_trace.h)
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+uint16_t crud_format(void) {
+
+    uint16_t result;
+
+    async_exclusive();
+    CRUD_PROBE3(file_entry, "format", -1, 0);
+    result = file_format();
+    CRUD_PROBE3(file_return, "format", -1, (int16_t)result);
+    return (result);
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : crud_mount
+// Function     : file_mount
 // Description  : This function mount the current crud file system and loads
 //                the file allocation table.
 //
@@ -531,57 +2831,156 @@ uint16_t crud_format(void) {
 // Outputs      : 0 if successful, -1 if failure
 
 
-uint16_t crud_mount(void) {
+static uint16_t file_mount(void) {
 
     uint64_t send;
 
    //when the flag is 0 , it means the curd is not initialized yet 
-    if (flag == 0){
+   // (or again, after a lost connection ended the session)
+    if (flag == 0 || !crud_client_session()){
        
         send = create_crude_opcode(0, CRUD_INIT, 0, 0, 0); 
         crud_client_operation(send, NULL);
         flag = 1;
     }
 
-    // Now, read priority object, then load file table
-    send = create_crude_opcode(0, CRUD_READ, CRUD_MAX_TOTAL_FILES*sizeof(file), CRUD_PRIORITY_OBJECT, 0);
-    crud_client_operation(send, File);
+    // Now, read priority object (the server says how big it is), then load file table
+    char *table = scratch_acquire(CRUD_MAX_OBJECT_SIZE);
+    if (table == NULL)
+        return (-1);
+    send = create_crude_opcode(0, CRUD_READ, CRUD_MAX_OBJECT_SIZE, CRUD_PRIORITY_OBJECT, 0);
+    Cruid got = extract_crude_opcode(crud_client_operation(send, table));
+    if (got.R != 0 || load_file_table(table, got.Length) != 0)
+        return (-1);
+    table_size = got.Length;
+    last_sync = time(NULL);
+    scratch_release();
+
+    // a lazy mount leaves the pages until crud_open needs them
+    if (mount_mode == CRUD_MOUNT_EAGER) {
+        for (uint32_t page = 0; page < page_count; page++) {
+            if (load_page(page))
+                return (-1);
+        }
+    }
   
 
     return(0);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_mount
+// Description  : Traced entry point for file_mount (see crud_trace.h)
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+uint16_t crud_mount(void) {
+
+    uint16_t result;
+
+    async_exclusive();
+    CRUD_PROBE3(file_entry, "mount", -1, 0);
+    result = file_mount();
+    CRUD_PROBE3(file_return, "mount", -1, (int16_t)result);
+    return (result);
+}
+
 
 
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : crud_unmount
+// Function     : file_unmount
 // Description  : This function unmounts the current crud file system and
 //                saves the file allocation table.
 //
 // Inputs       : none
 // Outputs      : 0 if successful, -1 if failure
 
-uint16_t crud_unmount(void) {
+static uint16_t file_unmount(void) {
 
     uint64_t send;
 
-    // Update priority object 
-    send = create_crude_opcode(0, CRUD_UPDATE, CRUD_MAX_TOTAL_FILES*sizeof(file), CRUD_PRIORITY_OBJECT, 0);
-    crud_client_operation(send, File);
+    // Finish the asynchronous operations first, they may still write
+    async_stop();
+
+    // Write out whatever part of the file table changed
+    if (crud_sync())
+        return (-1);
     
     //  call the close comand
     send= create_crude_opcode(0, CRUD_CLOSE, 0, CRUD_NULL_FLAG, 0);
     crud_client_operation(send, NULL);
+    flag = 0;
+
+    // give back the scratch buffer, nothing else will use it
+    free(scratch_buff);
+    scratch_buff = NULL;
+    scratch_size = 0;
+
+    // and the file table with its read-ahead buffers
+    logMessage(LOG_INFO_LEVEL, "CRUD_IO : read-ahead hits %lu, misses %lu, prefetched %lu bytes",
+        readahead_stats.hits, readahead_stats.misses, readahead_stats.prefetched);
+    reset_file_table();
    
     return (0);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_unmount
+// Description  : Traced entry point for file_unmount (see crud_trace.h)
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+uint16_t crud_unmount(void) {
+
+    uint16_t result;
+
+    CRUD_PROBE3(file_entry, "unmount", -1, 0);
+    result = file_unmount();
+    CRUD_PROBE3(file_return, "unmount", -1, (int16_t)result);
+    return (result);
+}
+
 
 
 // Module local methods
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : async_unit_callback
+// Description  : Record the result of an asynchronous unit test operation
+//
+// Inputs       : handle - the operation
+//                result - its result
+//                arg - where to record it
+// Outputs      : none
+
+static void async_unit_callback(int32_t handle, int32_t result, void *arg) {
+	*(int32_t *)arg = result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : async_order_callback
+// Description  : Record when an asynchronous unit test operation finished,
+//                relative to the others
+//
+// Inputs       : handle - the operation
+//                result - its result
+//                arg - where to record it
+// Outputs      : none
+
+static int32_t async_unit_finished = 0;
+
+static void async_order_callback(int32_t handle, int32_t result, void *arg) {
+	*(int32_t *)arg = (result == -1) ? -1 : async_unit_finished++;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // Function     : crudIOUnitTest
@@ -599,6 +2998,17 @@ int crudIOUnitTest(void) {
 	char *cio_utest_buffer, *tbuf;
 	CRUD_UNIT_TEST_TYPE cmd;
 	char lstr[1024];
+	char *bulk_names[CRUD_IO_UNIT_TEST_BULK_FILES];
+	void *bulk_bufs[CRUD_IO_UNIT_TEST_BULK_FILES];
+	uint32_t bulk_lengths[CRUD_IO_UNIT_TEST_BULK_FILES];
+	CrudIoVec vec[CRUD_IO_UNIT_TEST_MAX_VECTORS];
+	int k, nvec;
+	uint32_t position;
+	int32_t handles[CRUD_IO_UNIT_TEST_ASYNC_OPS], results[CRUD_IO_UNIT_TEST_ASYNC_OPS];
+	int32_t wanted[CRUD_IO_UNIT_TEST_ASYNC_OPS];
+	uint32_t offset;
+	char *abuf, *ebuf;
+	int16_t fh2;
 
 	// Setup some operating buffers, zero out the mirrored file contents
 	cio_utest_buffer = malloc(CRUD_MAX_OBJECT_SIZE);
@@ -763,13 +3173,156 @@ int crudIOUnitTest(void) {
 
 	}
 
-	// Close the files and cleanup buffers, assert on failure
+	// Positional and vectored reads and writes, none of them may move the position
+	position = File[fh].current_position;
+	for (i=0; i<CRUD_IO_UNIT_TEST_VECTOR_ROUNDS; i++) {
+		nvec = getRandomValue(1, CRUD_IO_UNIT_TEST_MAX_VECTORS);
+		for (k=0; k<nvec; k++) {
+			vec[k].offset = getRandomValue(0, cio_utest_length + 64);
+			vec[k].length = getRandomValue(0, 256);
+			vec[k].base = &tbuf[k * 256];
+		}
+		if (getRandomValue(0, 1)) {
+			for (k=0; k<nvec; k++) {
+				memset(vec[k].base, getRandomValue(0, 0xff), vec[k].length);
+			}
+			bytes = (nvec == 1) ? crud_pwrite(fh, vec[0].base, vec[0].length, vec[0].offset) : crud_writev(fh, vec, nvec);
+			for (k=0, expected=0; k<nvec; k++) {
+				memcpy(&cio_utest_buffer[vec[k].offset], vec[k].base, vec[k].length);
+				if (vec[k].length && (vec[k].offset + vec[k].length > cio_utest_length)) {
+					cio_utest_length = vec[k].offset + vec[k].length;
+				}
+				expected += vec[k].length;
+			}
+			if (bytes != expected) {
+				logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : vectored write failed [%d!=%d].", bytes, expected);
+				return(-1);
+			}
+		} else {
+			bytes = (nvec == 1) ? crud_pread(fh, vec[0].base, vec[0].length, vec[0].offset) : crud_readv(fh, vec, nvec);
+			for (k=0, expected=0; k<nvec; k++) {
+				count = (vec[k].offset >= cio_utest_length) ? 0 :
+					((vec[k].offset + vec[k].length > cio_utest_length) ? cio_utest_length - vec[k].offset : vec[k].length);
+				if (memcmp(&cio_utest_buffer[vec[k].offset], vec[k].base, count)) {
+					logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : vectored read mismatch in range %d.", k);
+					return(-1);
+				}
+				expected += count;
+			}
+			if (bytes != expected) {
+				logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : vectored read short/long [%d!=%d].", bytes, expected);
+				return(-1);
+			}
+		}
+		if (File[fh].current_position != position) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : positional I/O moved the position.");
+			return(-1);
+		}
+	}
+
+	// Asynchronous reads and writes run in the order they are queued, so each
+	// read has to see the writes queued before it
+	for (i=0; i<CRUD_IO_UNIT_TEST_ASYNC_ROUNDS; i++) {
+		nvec = getRandomValue(1, CRUD_IO_UNIT_TEST_ASYNC_OPS);
+		for (k=0; k<nvec; k++) {
+			offset = getRandomValue(0, cio_utest_length + 64);
+			count = getRandomValue(1, 256);
+			abuf = &tbuf[k * 256];
+			ebuf = &tbuf[(CRUD_IO_UNIT_TEST_ASYNC_OPS + k) * 256];
+			results[k] = -2;
+			if (getRandomValue(0, 1)) {
+				memset(abuf, getRandomValue(0, 0xff), count);
+				memcpy(&cio_utest_buffer[offset], abuf, count);
+				if (offset + count > cio_utest_length) {
+					cio_utest_length = offset + count;
+				}
+				wanted[k] = -count;
+				handles[k] = crud_write_async(fh, abuf, count, offset, NULL, NULL);
+			} else {
+				wanted[k] = (offset >= cio_utest_length) ? 0 :
+					((offset + count > cio_utest_length) ? cio_utest_length - offset : count);
+				memcpy(ebuf, &cio_utest_buffer[offset], wanted[k]);
+				handles[k] = crud_read_async(fh, abuf, count, offset, (k % 2) ? async_unit_callback : NULL, &results[k]);
+			}
+			if (handles[k] == -1) {
+				logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : asynchronous submit failed.");
+				return(-1);
+			}
+		}
+		crud_async_drain();
+		for (k=0; k<nvec; k++) {
+			if ((wanted[k] < 0) || !(k % 2)) {
+				if (crud_async_poll(handles[k], &results[k]) != 1) {
+					logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : drained operation not done.");
+					return(-1);
+				}
+			}
+			if ((wanted[k] < 0) ? (results[k] != -wanted[k]) : ((results[k] != wanted[k]) ||
+				memcmp(&tbuf[k * 256], &tbuf[(CRUD_IO_UNIT_TEST_ASYNC_OPS + k) * 256], wanted[k]))) {
+				logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : asynchronous operation %d wrong [%d, wanted %d].",
+					k, results[k], wanted[k]);
+				return(-1);
+			}
+		}
+	}
+
+	// Reads of one file go ahead of a backlog of writes to another, but not
+	// ahead of earlier writes to their own file.  The I/O thread is held
+	// while they are queued so it sees them all at once.
+	if (((handles[0] = crud_open_async("temp_sched.txt", NULL, NULL)) == -1) ||
+		((fh2 = crud_async_wait(handles[0])) == -1) || (crud_pwrite(fh2, tbuf, 4096, 0) != 4096)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : asynchronous open failed.");
+		return(-1);
+	}
+	crud_set_schedule(CRUD_SCHED_META_WEIGHT, 4, 1, 1024);
+	pthread_mutex_lock(&async.lock);
+	async.held = 1;
+	pthread_mutex_unlock(&async.lock);
+	for (k=0; k<16; k++) {
+		offset = getRandomValue(0, cio_utest_length);
+		memset(&tbuf[k * 256], getRandomValue(0, 0xff), 256);
+		memcpy(&cio_utest_buffer[offset], &tbuf[k * 256], 256);
+		if (offset + 256 > cio_utest_length) {
+			cio_utest_length = offset + 256;
+		}
+		handles[k] = crud_write_async(fh, &tbuf[k * 256], 256, offset, async_order_callback, &results[k]);
+	}
+	for (k=16; k<20; k++) {
+		handles[k] = crud_read_async(fh2, &tbuf[k * 256], 256, (k - 16) * 256, async_order_callback, &results[k]);
+	}
+	handles[20] = crud_read_async(fh, &tbuf[8192], CRUD_MAX_OBJECT_SIZE - 8192, 0, async_order_callback, &results[20]);
+	handles[21] = crud_sync_async(async_order_callback, &results[21]);
+	async_unit_finished = 0;
+	pthread_mutex_lock(&async.lock);
+	async.held = 0;
+	pthread_cond_signal(&async.queued);
+	pthread_mutex_unlock(&async.lock);
+	crud_async_drain();
+	crud_set_schedule(CRUD_SCHED_META_WEIGHT, CRUD_SCHED_READ_WEIGHT, CRUD_SCHED_BULK_WEIGHT, CRUD_SCHED_BULK_BYTES);
+	for (k=0; k<22; k++) {
+		if ((handles[k] == -1) || (results[k] == -1)) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : scheduled operation %d failed.", k);
+			return(-1);
+		}
+	}
+	if ((results[21] != 0) || (results[16] != 1) || (results[19] != 4) || (results[20] != 21) ||
+		memcmp(&tbuf[8192], cio_utest_buffer, cio_utest_length) || crud_close(fh2)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : scheduled operations out of order [%d %d %d %d].",
+			results[21], results[16], results[19], results[20]);
+		return(-1);
+	}
+
+	if ((handles[0] = crud_read_async(fh, tbuf, CRUD_MAX_OBJECT_SIZE, 0, NULL, NULL)) == -1 ||
+		(crud_async_wait(handles[0]) != cio_utest_length) || memcmp(tbuf, cio_utest_buffer, cio_utest_length)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : asynchronous whole file read failed.");
+		return(-1);
+	}
+
+	// Close the files, assert on failure
 	if (crud_close(fh)) {
 		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure read comparison block.", fh);
 		return(-1);
 	}
-	free(cio_utest_buffer);
-	free(tbuf);
 
 	// Format and mount the file system
 	if (crud_unmount()) {
@@ -777,6 +3330,110 @@ int crudIOUnitTest(void) {
 		return(-1);
 	}
 
+	// Mount again both ways, the file has to come back from the table
+	for (i = CRUD_MOUNT_LAZY; i <= CRUD_MOUNT_EAGER; i++) {
+		crud_set_mount_mode(i);
+		if (crud_mount() || ((fh = crud_open("temp_file.txt")) == -1)) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on remount (mode %d).", i);
+			return(-1);
+		}
+		bytes = crud_read(fh, tbuf, CRUD_MAX_OBJECT_SIZE);
+		if ((bytes != cio_utest_length) || memcmp(cio_utest_buffer, tbuf, bytes) || crud_close(fh) || crud_unmount()) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : remounted file mismatch [%d!=%d]", bytes, cio_utest_length);
+			return(-1);
+		}
+	}
+	crud_set_mount_mode(CRUD_MOUNT_LAZY);
+
+	// Change a byte of the object behind the file's back, the read has to catch it
+	if (crud_mount() || ((fh = crud_open("temp_file.txt")) == -1)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on remount for checksum test.");
+		return(-1);
+	}
+	memcpy(tbuf, cio_utest_buffer, cio_utest_length);
+	tbuf[cio_utest_length / 2] ^= 0x1;
+	crud_client_operation(create_crude_opcode(File[fh].oid, CRUD_UPDATE, cio_utest_length, 0, 0), tbuf);
+	if (crud_read(fh, tbuf, CRUD_MAX_OBJECT_SIZE) != -1) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : corrupted object read without a checksum error.");
+		return(-1);
+	}
+	crud_client_operation(create_crude_opcode(File[fh].oid, CRUD_UPDATE, cio_utest_length, 0, 0), cio_utest_buffer);
+	if (crud_seek(fh, 0) || (crud_read(fh, tbuf, CRUD_MAX_OBJECT_SIZE) != cio_utest_length) ||
+		crud_close(fh) || crud_unmount()) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : read after restoring the object failed.");
+		return(-1);
+	}
+
+	// A clone reads back the same, and writing it leaves the original alone
+	if (crud_mount() || ((fh = crud_clone("temp_file.txt", "temp_clone.txt")) == -1) ||
+		(crud_read(fh, tbuf, CRUD_MAX_OBJECT_SIZE) != cio_utest_length) ||
+		memcmp(cio_utest_buffer, tbuf, cio_utest_length)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : clone does not match its file.");
+		return(-1);
+	}
+	memset(tbuf, 0x5a, cio_utest_length);
+	if (crud_seek(fh, 0) || (crud_write(fh, tbuf, cio_utest_length) != cio_utest_length) || crud_close(fh) ||
+		((fh = crud_open("temp_file.txt")) == -1) ||
+		(crud_read(fh, tbuf, CRUD_MAX_OBJECT_SIZE) != cio_utest_length) ||
+		memcmp(cio_utest_buffer, tbuf, cio_utest_length) || crud_close(fh)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : writing a clone changed its file.");
+		return(-1);
+	}
+
+	// A snapshot copies all three files, and survives a remount
+	if ((crud_snapshot(".snap") != 3) || crud_unmount() || crud_mount() ||
+		((fh = crud_open("temp_file.txt.snap")) == -1) ||
+		(crud_read(fh, tbuf, CRUD_MAX_OBJECT_SIZE) != cio_utest_length) ||
+		memcmp(cio_utest_buffer, tbuf, cio_utest_length) || crud_close(fh) || crud_unmount()) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : snapshot failed.");
+		return(-1);
+	}
+
+	// Create a batch of files in one go (one of them is already there), they
+	// have to read back after a remount
+	for (i = 0; i < CRUD_IO_UNIT_TEST_BULK_FILES; i++) {
+		bulk_names[i] = malloc(CRUD_MAX_PATH_LENGTH);
+		snprintf(bulk_names[i], CRUD_MAX_PATH_LENGTH, "bulk_%d.txt", i);
+		bulk_lengths[i] = getRandomValue(0, CIO_UNIT_TEST_MAX_WRITE_SIZE);
+		bulk_bufs[i] = &cio_utest_buffer[i];
+	}
+	strcpy(bulk_names[1], "temp_file.txt");
+	if (crud_mount() || (crud_create_files(CRUD_IO_UNIT_TEST_BULK_FILES, bulk_names, bulk_bufs, bulk_lengths) !=
+		CRUD_IO_UNIT_TEST_BULK_FILES - 1) || crud_unmount() || crud_mount()) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : bulk create failed.");
+		return(-1);
+	}
+	for (i = 0; i < CRUD_IO_UNIT_TEST_BULK_FILES; i += 7) {
+		if (((fh = crud_open(bulk_names[i])) == -1) ||
+			(crud_read(fh, tbuf, CRUD_MAX_OBJECT_SIZE) != (int32_t)bulk_lengths[i]) ||
+			memcmp(bulk_bufs[i], tbuf, bulk_lengths[i]) || crud_close(fh)) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : bulk created file [%s] mismatch.", bulk_names[i]);
+			return(-1);
+		}
+	}
+
+	// An entry taken back out must leave every other name findable
+	if (((fh = add_file("removed.txt")) == -1) || (remove_file(fh), crud_find("removed.txt") != -1)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : removed entry still there.");
+		return(-1);
+	}
+	for (i = 0; i < CRUD_IO_UNIT_TEST_BULK_FILES; i++) {
+		if (crud_find(bulk_names[i]) == -1) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : [%s] lost after a removal.", bulk_names[i]);
+			return(-1);
+		}
+	}
+	if (crud_unmount()) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on unmount after bulk create.");
+		return(-1);
+	}
+	for (i = 0; i < CRUD_IO_UNIT_TEST_BULK_FILES; i++) {
+		free(bulk_names[i]);
+	}
+
+	free(cio_utest_buffer);
+	free(tbuf);
+
 	// Return successfully
 	return(0);
 }
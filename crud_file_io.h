@@ -18,7 +18,8 @@
 #include <crud_driver.h>
 
 // Defines
-#define CRUD_MAX_TOTAL_FILES 1024
+#define CRUD_MAX_TOTAL_FILES 32767 // Largest file table (a file handle is an int16_t)
+#define CRUD_FILE_TABLE_PAGE 256   // File table entries per on-device page object
 #define CRUD_MAX_PATH_LENGTH 128
 
 // Type definitions
@@ -32,6 +33,45 @@ typedef struct {
 	uint8_t   open;                           // Flag indicating the file is currently open
 } CrudFileAllocationType;
 
+// How much of the file table crud_mount reads (see crud_set_mount_mode)
+typedef enum {
+	CRUD_MOUNT_LAZY  = 0,                     // Header only, pages are read by crud_open
+	CRUD_MOUNT_EAGER = 1,                     // Every page of the table
+} CRUD_MOUNT_MODE;
+
+// One range of a file for crud_readv/crud_writev
+typedef struct {
+	void     *base;                           // The bytes to read into or write from
+	uint32_t  offset;                         // Where the range starts in the file
+	uint32_t  length;                         // The number of bytes
+} CrudIoVec;
+
+// Called on the I/O thread when an asynchronous operation finishes
+typedef void (*CrudAsyncCallback)(int32_t handle, int32_t result, void *arg);
+
+// The queues the I/O thread shares its turns between (see crud_set_schedule)
+typedef enum {
+	CRUD_SCHED_META    = 0,                   // File table work (crud_open_async, crud_sync_async)
+	CRUD_SCHED_READ    = 1,                   // Reads
+	CRUD_SCHED_BULK    = 2,                   // Writes
+	CRUD_SCHED_CLASSES = 3,
+} CRUD_SCHED_CLASS;
+
+// These are the scheduler's counters (see crud_get_schedule_stats)
+typedef struct {
+	uint64_t  operations[CRUD_SCHED_CLASSES]; // Operations completed
+	uint64_t  batches[CRUD_SCHED_CLASSES];    // Turns (bus operations) that served them
+	uint64_t  wait_usec[CRUD_SCHED_CLASSES];  // Total time from submit to done
+	uint64_t  max_usec[CRUD_SCHED_CLASSES];   // Longest time from submit to done
+} CrudScheduleStats;
+
+// These are the read-ahead counters (see crud_get_readahead_stats)
+typedef struct {
+	uint64_t  hits;                           // Reads served from the read-ahead buffer
+	uint64_t  misses;                         // Reads that had to go to the bus
+	uint64_t  prefetched;                     // Bytes fetched ahead of being asked for
+} CrudReadAheadStats;
+
 //
 // Management operations
 
@@ -44,12 +84,27 @@ uint16_t crud_mount(void);
 uint16_t crud_unmount(void);
 	// This function unmounts the current crud file system and saves the file allocation table.
 
+int16_t crud_sync(void);
+	// This function writes the changed parts of the file allocation table to the device.
+
+void crud_set_sync_interval(uint32_t seconds);
+	// Set how often the file allocation table is synced while files change (0 = unmount only)
+
+void crud_set_mount_mode(CRUD_MOUNT_MODE mode);
+	// Set whether mount reads the whole file allocation table or only its header
+
 //
 // Interface functions
 
 int16_t crud_open(char *path);
 	// This function opens the file and returns a file handle
 
+int16_t crud_find(char *path);
+	// Get the handle of an existing file without adding it, -1 if there is none
+
+int16_t crud_next_file(int16_t fd, char *name);
+	// Walk the file table: the file after fd (-1 to start) and its name, -1 at the end
+
 int16_t crud_close(int16_t fd);
 	// This function closes the file
 
@@ -62,6 +117,68 @@ int32_t crud_write(int16_t fd, void *buf, int32_t count);
 int32_t crud_seek(int16_t fd, uint32_t loc);
 	// Seek to specific point in the file
 
+int32_t crud_pread(int16_t fd, void *buf, int32_t count, uint32_t offset);
+	// Read "count" bytes at "offset" without moving the file position
+
+int32_t crud_pwrite(int16_t fd, void *buf, int32_t count, uint32_t offset);
+	// Write "count" bytes at "offset" without moving the file position
+
+int32_t crud_readv(int16_t fd, CrudIoVec *iov, int iovcnt);
+	// Read several ranges with one bus read, returns the total bytes read
+
+int32_t crud_writev(int16_t fd, CrudIoVec *iov, int iovcnt);
+	// Write several ranges (applied in order) with one object write
+
+int32_t crud_read_async(int16_t fd, void *buf, int32_t count, uint32_t offset,
+		CrudAsyncCallback callback, void *arg);
+	// Queue a positional read, returns a handle (or -1), see crud_async_wait
+
+int32_t crud_write_async(int16_t fd, void *buf, int32_t count, uint32_t offset,
+		CrudAsyncCallback callback, void *arg);
+	// Queue a positional write, buf must stay untouched until it completes
+
+int32_t crud_open_async(char *path, CrudAsyncCallback callback, void *arg);
+	// Queue an open as metadata work, the result is the file descriptor
+
+int32_t crud_sync_async(CrudAsyncCallback callback, void *arg);
+	// Queue a sync of the file table as metadata work
+
+void crud_set_schedule(uint32_t meta_weight, uint32_t read_weight, uint32_t bulk_weight, uint32_t bulk_bytes);
+	// Set the turns per round of each queue and the most write bytes per turn
+
+void crud_get_schedule_stats(CrudScheduleStats *stats);
+	// Get the per queue operation and wait time counters
+
+int crud_async_poll(int32_t handle, int32_t *result);
+	// 1 (and the result) if the operation is done, 0 if not yet, -1 if bad handle
+
+int32_t crud_async_wait(int32_t handle);
+	// Wait for an operation without a callback, returns its result
+
+void crud_async_drain(void);
+	// Wait for every queued operation (the blocking calls do this themselves)
+
+int16_t crud_clone(char *src, char *dst);
+	// Make a new file sharing the contents of src until either is written
+
+int32_t crud_snapshot(char *suffix);
+	// Clone every file as its name plus suffix, returns the number copied
+
+int32_t crud_create_files(uint32_t count, char **paths, void **bufs, uint32_t *lengths);
+	// Add many new files with their contents in batches, returns the number created
+
+void crud_set_scratch_limit(uint32_t limit);
+	// Set the largest read/write scratch buffer kept between calls (0 = none)
+
+void crud_set_readahead(uint32_t max_window);
+	// Set the largest read-ahead window for sequential reads (0 = off)
+
+void crud_get_readahead_stats(CrudReadAheadStats *stats);
+	// Get the read-ahead hit/miss counters
+
+void crud_set_checksums(uint8_t enable);
+	// Turn CRC32C checksums of file objects on or off (on by default)
+
 //
 // Unit testing for the module
 
@@ -0,0 +1,256 @@
+#ifndef CRUD_FILE_IO_HPP_INCLUDED
+#define CRUD_FILE_IO_HPP_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_file_io.hpp
+//  Description    : This is a header only C++20 front end for the CRUD file
+//                   API: files are RAII handles, and opens, reads and writes
+//                   are awaitables built on crud_open_async and
+//                   crud_read_async/crud_write_async (every one of them is
+//                   queued to the I/O thread and suspends the coroutine).
+//                   The I/O thread's completions are posted to an EventLoop,
+//                   and the coroutines resume on whichever thread runs it, so
+//                   any number of coroutines can have operations outstanding
+//                   without callbacks.
+//
+//                     crud::EventLoop loop;
+//                     crud::Task copy(crud::EventLoop &loop) {
+//                         crud::File f = co_await crud::open(loop, "a.txt");
+//                         int32_t n = co_await f.read(std::as_writable_bytes(std::span(buf)), 0);
+//                         ...
+//                     }
+//                     copy(loop); loop.run();
+//
+//                   Link with the same objects as crud_client (crud_file_io.o
+//                   and crud_client.o) and -lpthread, crud_cpp_test.cpp is
+//                   a small example ("make crud_cpp_test").
+//
+//  Author         : Xuejian Zhou
+//  Last Modified  : Mon Oct 19 2026
+//
+
+// Includes
+#include <coroutine>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <span>
+#include <utility>
+
+// Project includes
+extern "C" {
+#include <crud_file_io.h>
+}
+
+namespace crud {
+
+//
+// EventLoop: the coroutines waiting on operations, and the ones ready to go on
+
+class EventLoop {
+public:
+	EventLoop() = default;
+	EventLoop(const EventLoop &) = delete;
+	EventLoop &operator=(const EventLoop &) = delete;
+
+	// Resume coroutines as their operations finish, until none are waiting
+	void run() {
+		std::unique_lock<std::mutex> lock(mutex_);
+		while (waiting_ > 0 || !ready_.empty()) {
+			changed_.wait(lock, [this] { return !ready_.empty(); });
+			std::coroutine_handle<> next = ready_.front();
+			ready_.pop_front();
+			waiting_--;
+			lock.unlock();
+			next.resume();
+			lock.lock();
+		}
+	}
+
+	// Operations waiting for the I/O thread
+	std::size_t waiting() {
+		std::lock_guard<std::mutex> lock(mutex_);
+		return waiting_;
+	}
+
+private:
+	friend class IoAwaitable;
+	friend class OpenAwaitable;
+
+	void started() {
+		std::lock_guard<std::mutex> lock(mutex_);
+		waiting_++;
+	}
+
+	void cancelled() {
+		std::lock_guard<std::mutex> lock(mutex_);
+		waiting_--;
+	}
+
+	// Called on the I/O thread
+	void post(std::coroutine_handle<> handle) {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			ready_.push_back(handle);
+		}
+		changed_.notify_one();
+	}
+
+	std::mutex mutex_;
+	std::condition_variable changed_;
+	std::deque<std::coroutine_handle<>> ready_;
+	std::size_t waiting_ = 0;
+};
+
+//
+// Task: a coroutine that starts straight away and cleans up after itself
+
+struct Task {
+	struct promise_type {
+		Task get_return_object() noexcept { return {}; }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() noexcept {}
+		void unhandled_exception() noexcept { std::terminate(); }
+	};
+};
+
+//
+// IoAwaitable: one positional read or write, co_await gives the bytes moved
+// (or -1 if it failed)
+
+class IoAwaitable {
+public:
+	IoAwaitable(EventLoop &loop, bool write, int16_t fd, std::span<std::byte> buf, uint32_t offset) :
+		loop_(loop), write_(write), fd_(fd), buf_(buf), offset_(offset) {}
+
+	bool await_ready() const noexcept { return false; }
+
+	bool await_suspend(std::coroutine_handle<> handle) {
+		handle_ = handle;
+		loop_.started();
+		int32_t queued = write_ ?
+			crud_write_async(fd_, buf_.data(), (int32_t)buf_.size(), offset_, &IoAwaitable::done, this) :
+			crud_read_async(fd_, buf_.data(), (int32_t)buf_.size(), offset_, &IoAwaitable::done, this);
+		if (queued == -1) {
+			loop_.cancelled();
+			result_ = -1;
+			return false;
+		}
+		return true;
+	}
+
+	int32_t await_resume() const noexcept { return result_; }
+
+private:
+	static void done(int32_t, int32_t result, void *arg) {
+		IoAwaitable *self = static_cast<IoAwaitable *>(arg);
+		self->result_ = result;
+		self->loop_.post(self->handle_);
+	}
+
+	EventLoop &loop_;
+	bool write_;
+	int16_t fd_;
+	std::span<std::byte> buf_;
+	uint32_t offset_;
+	int32_t result_ = -1;
+	std::coroutine_handle<> handle_;
+};
+
+//
+// File: an open CRUD file, closed when it goes out of scope
+
+class File {
+public:
+	File() = default;
+	File(EventLoop &loop, int16_t fd) : loop_(&loop), fd_(fd) {}
+	~File() { close(); }
+
+	File(const File &) = delete;
+	File &operator=(const File &) = delete;
+	File(File &&other) noexcept : loop_(other.loop_), fd_(std::exchange(other.fd_, -1)) {}
+	File &operator=(File &&other) noexcept {
+		if (this != &other) {
+			close();
+			loop_ = other.loop_;
+			fd_ = std::exchange(other.fd_, -1);
+		}
+		return *this;
+	}
+
+	explicit operator bool() const noexcept { return fd_ != -1; }
+	int16_t fd() const noexcept { return fd_; }
+
+	// Read into buf from offset, the buffer must outlive the co_await
+	IoAwaitable read(std::span<std::byte> buf, uint32_t offset) {
+		return IoAwaitable(*loop_, false, fd_, buf, offset);
+	}
+
+	// Write buf at offset, the buffer must outlive the co_await
+	IoAwaitable write(std::span<const std::byte> buf, uint32_t offset) {
+		return IoAwaitable(*loop_, true, fd_,
+			std::span<std::byte>(const_cast<std::byte *>(buf.data()), buf.size()), offset);
+	}
+
+	// Close the file once the operations already queued have run
+	void close() {
+		if (fd_ != -1) {
+			crud_async_drain();
+			crud_close(fd_);
+			fd_ = -1;
+		}
+	}
+
+private:
+	EventLoop *loop_ = nullptr;
+	int16_t fd_ = -1;
+};
+
+//
+// open: opening (or creating) a file is queued as metadata work, so it goes
+// ahead of bulk writes (see crud_set_schedule)
+
+class OpenAwaitable {
+public:
+	OpenAwaitable(EventLoop &loop, const char *path) : loop_(loop), path_(path) {}
+
+	bool await_ready() const noexcept { return false; }
+
+	bool await_suspend(std::coroutine_handle<> handle) {
+		handle_ = handle;
+		loop_.started();
+		if (crud_open_async(const_cast<char *>(path_), &OpenAwaitable::done, this) == -1) {
+			loop_.cancelled();
+			fd_ = -1;
+			return false;
+		}
+		return true;
+	}
+
+	File await_resume() { return (fd_ == -1) ? File() : File(loop_, (int16_t)fd_); }
+
+private:
+	static void done(int32_t, int32_t result, void *arg) {
+		OpenAwaitable *self = static_cast<OpenAwaitable *>(arg);
+		self->fd_ = result;
+		self->loop_.post(self->handle_);
+	}
+
+	EventLoop &loop_;
+	const char *path_;
+	int32_t fd_ = -1;
+	std::coroutine_handle<> handle_;
+};
+
+inline OpenAwaitable open(EventLoop &loop, const char *path) {
+	return OpenAwaitable(loop, path);
+}
+
+} // namespace crud
+
+#endif
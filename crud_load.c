@@ -0,0 +1,771 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File          : crud_load.c
+//  Description   : This is the end-to-end load test.  It starts a local
+//                  server for each client (crud_local_server serves one
+//                  connection at a time and the workloads format the store,
+//                  so clients cannot share one), then runs the clients as
+//                  separate crud_client processes replaying workload files
+//                  or generated traces, and reports:
+//
+//                    - throughput (workload lines, bus operations, bytes)
+//                    - bus latency percentiles by request type (from the
+//                      clients' crud_metrics dumps, put together)
+//                    - run times, and failed runs
+//                    - server CPU time and peak memory (from wait4) and
+//                      the store's own latency (from the servers' dumps)
+//
+//                  Everything runs on the one box; the servers, logs and
+//                  dumps are left in the work directory for a closer look.
+//
+//  Author        : Xuejian Zhou
+//  Last Modified : Mon Oct 19 2026
+//
+
+// Include Files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// Project Includes
+#include <crud_driver.h>
+#include <crud_network.h>
+#include <crud_metrics.h>
+#include <cmpsc311_log.h>
+#include <cmpsc311_util.h>
+
+// Defines
+#define CRUD_LOAD_ARGUMENTS "hvn:r:g:p:S:C:Pd:o:s:"
+#define CRUD_LOAD_MAX_CLIENTS 64
+#define CRUD_LOAD_MAX_WORKLOADS 16
+#define CRUD_LOAD_MAX_RUNS 4096
+#define CRUD_LOAD_START_WAIT_MS 5000    // How long a server gets to start listening
+#define CRUD_LOAD_GEN_FILES 8           // Files in a generated trace
+#define CRUD_LOAD_GEN_MAX_WRITE 1000    // The simulator takes less than 1024
+#define CRUD_LOAD_GEN_MAX_FILE 262144   // Generated files wrap around at this size
+#define USAGE \
+	"USAGE: crud_load [-h] [-v] [-n <clients>] [-r <rounds>] [-g <ops>] [-p <port>] [-S <server>] [-C <client>]\n" \
+	"                 [-P] [-d <dir>] [-o <json-file>] [-s <seed>] [<workload-file> ...]\n" \
+	"\n" \
+	"where:\n" \
+	"    -h - help mode (display this message)\n" \
+	"    -v - verbose output\n" \
+	"    -n - number of clients, each with its own server (default 4)\n" \
+	"    -r - times each client replays its workloads (default 1)\n" \
+	"    -g - replay a generated trace of <ops> operations per client instead of workload files\n" \
+	"    -p - port of the first server, the others follow it (default 19877)\n" \
+	"    -S - server program (default ./crud_local_server)\n" \
+	"    -C - client program (default ./crud_client)\n" \
+	"    -P - the server only takes -p and -l (e.g. the reference crud_server)\n" \
+	"    -d - work directory for the stores, logs and dumps (default a new /tmp/crud_load.XXXXXX)\n" \
+	"    -o - also write the report to <json-file>\n" \
+	"    -s - seed for the generated traces, to repeat a run\n" \
+	"\n" \
+	"    <workload-file> - workloads each client replays in order (default workload-one.txt)\n" \
+	"\n" \
+
+// One client and the server it talks to
+typedef struct {
+	pid_t          server;       // The server process, 0 once it has exited
+	pid_t          client;       // The running client process, 0 if none
+	uint16_t       port;         // The server port
+	char           dir[PATH_MAX+16]; // The server's directory (its store and log)
+	uint32_t       run;          // The next run (round * workloads + workload)
+	struct timeval started;      // When the running client was started
+	struct rusage  usage;        // The server's usage once it has exited
+} CrudLoadClient;
+
+// The load test
+typedef struct {
+	uint32_t        clients, rounds, nworkloads, runs, failed, lines;
+	char           *workloads[CRUD_LOAD_MAX_WORKLOADS];   // Absolute paths
+	uint32_t        wlines[CRUD_LOAD_MAX_WORKLOADS];      // Lines in each
+	char           *server, *client, dir[PATH_MAX];
+	int             plain;                                // Server has no -M
+	int             generated;                            // One trace per client
+	CrudLoadClient  c[CRUD_LOAD_MAX_CLIENTS];
+	double          run_ms[CRUD_LOAD_MAX_RUNS];           // Every run's wall time
+	double          wall;                                 // Seconds, start to finish
+	struct rusage   client_usage;                         // All client processes
+} CrudLoadTest;
+
+//
+// Global Data
+int            crud_network_shutdown = 0;    // Set by SIGINT, stops the test
+unsigned char *crud_network_address = NULL;  // Unused
+unsigned short crud_network_port = 0;        // Unused
+CrudLoadTest   load;
+
+//
+// Functional Prototypes
+
+int load_generate(char *path, uint32_t ops);
+int load_start_server(CrudLoadClient *c);
+int load_start_client(CrudLoadClient *c, int idx);
+int load_run(void);
+void load_stop_servers(void);
+void load_report(char *json);
+void load_add_usage(struct rusage *total, struct rusage *usage);
+uint32_t load_count_lines(char *path);
+double load_percentile(double *values, uint32_t count, double fraction);
+void load_signal_handler(int sig);
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : main
+// Description  : The main function for the CRUD load test
+//
+// Inputs       : argc - the number of command line parameters
+//                argv - the parameters
+// Outputs      : 0 if every run succeeded, -1 if failure
+
+int main( int argc, char *argv[] ) {
+
+	// Local variables
+	char path[PATH_MAX+32], *server = "./crud_local_server", *client = "./crud_client", *dir = NULL, *json = NULL;
+	uint32_t generate = 0, port = CRUD_DEFAULT_PORT + 1, i;
+	struct sigaction action;
+	uint64_t seed;
+	int ch;
+
+	// Process the command line parameters
+	memset(&load, 0x0, sizeof(load));
+	load.clients = 4;
+	load.rounds = 1;
+	initializeLogWithFilehandle( CMPSC311_LOG_STDERR );
+	while ((ch = getopt(argc, argv, CRUD_LOAD_ARGUMENTS)) != -1) {
+
+		switch (ch) {
+		case 'h': // Help, print usage
+			fprintf( stderr, USAGE );
+			return( -1 );
+
+		case 'v': // Verbose Flag
+			enableLogLevels( LOG_INFO_LEVEL );
+			break;
+
+		case 'n': // Number of clients
+			if ( (sscanf(optarg, "%u", &load.clients) != 1) || (load.clients < 1) ||
+				(load.clients > CRUD_LOAD_MAX_CLIENTS) ) {
+				logMessage( LOG_ERROR_LEVEL, "Bad  client count [%s], 1 to %d", optarg, CRUD_LOAD_MAX_CLIENTS );
+				return( -1 );
+			}
+			break;
+
+		case 'r': // Rounds per client
+			if ( (sscanf(optarg, "%u", &load.rounds) != 1) || (load.rounds < 1) ) {
+				logMessage( LOG_ERROR_LEVEL, "Bad  round count [%s]", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'g': // Generated traces
+			if ( (sscanf(optarg, "%u", &generate) != 1) || (generate < 1) ) {
+				logMessage( LOG_ERROR_LEVEL, "Bad  trace length [%s]", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'p': // First server port
+			if ( (sscanf(optarg, "%u", &port) != 1) || (port < 1) || (port > 65535) ) {
+				logMessage( LOG_ERROR_LEVEL, "Bad  port number [%s]", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'S': // Server program
+			server = optarg;
+			break;
+
+		case 'C': // Client program
+			client = optarg;
+			break;
+
+		case 'P': // Server without the metrics flag
+			load.plain = 1;
+			break;
+
+		case 'd': // Work directory
+			dir = optarg;
+			break;
+
+		case 'o': // JSON report
+			json = optarg;
+			break;
+
+		case 's': // Seed the generated traces
+			if ( sscanf(optarg, "%lu", &seed) != 1 ) {
+				logMessage( LOG_ERROR_LEVEL, "Bad  random seed [%s]", optarg );
+				return( -1 );
+			}
+			setRandomSeed( seed );
+			break;
+
+		default:  // Default (unknown)
+			fprintf( stderr, "Unknown command line option (%c), aborting.\n", ch );
+			return( -1 );
+		}
+	}
+	if ( (port + load.clients - 1) > 65535 ) {
+		logMessage( LOG_ERROR_LEVEL, "Not enough ports after [%u] for %u clients", port, load.clients );
+		return( -1 );
+	}
+
+	// The programs and the workloads have to be found from the other directories
+	if ( ((load.server = realpath(server, NULL)) == NULL) || ((load.client = realpath(client, NULL)) == NULL) ) {
+		logMessage( LOG_ERROR_LEVEL, "Cannot find the server [%s] or client [%s] program", server, client );
+		return( -1 );
+	}
+	if ( dir == NULL ) {
+		strcpy( load.dir, "/tmp/crud_load.XXXXXX" );
+		if ( mkdtemp(load.dir) == NULL ) {
+			logMessage( LOG_ERROR_LEVEL, "Cannot make a work directory : [%s]", strerror(errno) );
+			return( -1 );
+		}
+	} else if ( ((mkdir(dir, 0755) != 0) && (errno != EEXIST)) || (realpath(dir, load.dir) == NULL) ) {
+		logMessage( LOG_ERROR_LEVEL, "Cannot use work directory [%s] : [%s]", dir, strerror(errno) );
+		return( -1 );
+	}
+	if ( generate ) {
+		for (i = 0; i < load.clients; i++) {
+			snprintf( path, sizeof(path), "%s/trace%u.txt", load.dir, i );
+			if ( load_generate(path, generate) ) {
+				return( -1 );
+			}
+			load.workloads[load.nworkloads++] = strdup( path );
+		}
+		load.generated = 1;
+	} else {
+		for (i = optind; i < argc || (load.nworkloads == 0); i++) {
+			if ( load.nworkloads == CRUD_LOAD_MAX_WORKLOADS ) {
+				logMessage( LOG_ERROR_LEVEL, "Too many workload files, at most %d", CRUD_LOAD_MAX_WORKLOADS );
+				return( -1 );
+			}
+			if ( (load.workloads[load.nworkloads] = realpath((i < argc) ? argv[i] : "workload-one.txt", NULL)) == NULL ) {
+				logMessage( LOG_ERROR_LEVEL, "Cannot find workload [%s]", (i < argc) ? argv[i] : "workload-one.txt" );
+				return( -1 );
+			}
+			load.nworkloads++;
+		}
+	}
+	for (i = 0; i < load.nworkloads; i++) {
+		load.wlines[i] = load_count_lines( load.workloads[i] );
+	}
+
+	// Stop cleanly on SIGINT, the servers are still shut down
+	memset( &action, 0x0, sizeof(action) );
+	action.sa_handler = load_signal_handler;
+	sigaction( SIGINT, &action, NULL );
+	sigaction( SIGTERM, &action, NULL );
+
+	// Start the servers, run the clients, stop the servers and report
+	for (i = 0; i < load.clients; i++) {
+		load.c[i].port = port + i;
+		snprintf( load.c[i].dir, sizeof(load.c[i].dir), "%s/s%u", load.dir, i );
+		if ( load_start_server(&load.c[i]) ) {
+			load_stop_servers();
+			return( -1 );
+		}
+	}
+	if ( load_run() ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD load test interrupted." );
+	}
+	load_stop_servers();
+	load_report( json );
+	return( (load.failed || crud_network_shutdown) ? -1 : 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : load_generate
+// Description  : Write a random trace in the workload format: writes, reads
+//                and seeks over a few files, keeping every read inside the
+//                file so the simulator accepts it
+//
+// Inputs       : path - the file to write
+//                ops - the number of operations
+// Outputs      : 0 if successful, -1 if failure
+
+int load_generate(char *path, uint32_t ops) {
+
+	uint32_t size[CRUD_LOAD_GEN_FILES], pos[CRUD_LOAD_GEN_FILES], i, f, len, kind;
+	char text[CRUD_LOAD_GEN_MAX_WRITE + 1];
+	FILE *out;
+
+	if ((out = fopen(path, "w")) == NULL) {
+		logMessage(LOG_ERROR_LEVEL, "Cannot write trace [%s] : [%s]", path, strerror(errno));
+		return (-1);
+	}
+	memset(size, 0x0, sizeof(size));
+	memset(pos, 0x0, sizeof(pos));
+	fprintf(out, "x FORMAT 0 0:\nx MOUNT 0 0:\n");
+	for (i = 0; i < ops; i++) {
+		f = getRandomValue(0, CRUD_LOAD_GEN_FILES - 1);
+		kind = getRandomValue(0, 9);
+
+		// Seek back to the start when there is nothing to read or no room to write
+		if (((kind < 4) && (pos[f] == size[f])) ||
+			((kind >= 4) && (kind < 8) && (pos[f] + CRUD_LOAD_GEN_MAX_WRITE > CRUD_LOAD_GEN_MAX_FILE))) {
+			fprintf(out, "gen%u.txt SEEK 0 0 :\n", f);
+			pos[f] = 0;
+		}
+		if ((kind < 4) && (size[f] > 0)) {
+			len = getRandomValue(1, (size[f] - pos[f] < CRUD_LOAD_GEN_MAX_WRITE) ? size[f] - pos[f] : CRUD_LOAD_GEN_MAX_WRITE);
+			fprintf(out, "gen%u.txt READ %u 0 :\n", f, len);
+			pos[f] += len;
+		} else if (kind < 8 || size[f] == 0) {
+			len = getRandomValue(1, CRUD_LOAD_GEN_MAX_WRITE);
+			memset(text, 'a' + getRandomValue(0, 25), len);
+			text[len] = 0x0;
+			fprintf(out, "gen%u.txt WRITE %u 0 :%s\n", f, len, text);
+			pos[f] += len;
+			size[f] = (pos[f] > size[f]) ? pos[f] : size[f];
+		} else {
+			pos[f] = getRandomValue(0, size[f]);
+			fprintf(out, "gen%u.txt SEEK 0 %u :\n", f, pos[f]);
+		}
+	}
+	fprintf(out, "x UNMOUNT 0 0:\n");
+	if (fclose(out) != 0) {
+		logMessage(LOG_ERROR_LEVEL, "Cannot write trace [%s] : [%s]", path, strerror(errno));
+		return (-1);
+	}
+	return (0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : load_start_server
+// Description  : Start a server in its own directory and wait until it
+//                accepts connections
+//
+// Inputs       : c - the client the server is for
+// Outputs      : 0 if successful, -1 if failure
+
+int load_start_server(CrudLoadClient *c) {
+
+	struct sockaddr_in addr;
+	char port[16];
+	int sock, waited, status, up = 0;
+
+	// Someone else listening there would take our clients
+	memset(&addr, 0x0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(c->port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if ((sock = socket(PF_INET, SOCK_STREAM, 0)) == -1) {
+		return (-1);
+	}
+	if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+		logMessage(LOG_ERROR_LEVEL, "Port [%u] is already in use, pick another with -p", c->port);
+		close(sock);
+		return (-1);
+	}
+	close(sock);
+
+	if ((mkdir(c->dir, 0755) != 0) && (errno != EEXIST)) {
+		logMessage(LOG_ERROR_LEVEL, "Cannot make server directory [%s] : [%s]", c->dir, strerror(errno));
+		return (-1);
+	}
+	snprintf(port, sizeof(port), "%u", c->port);
+	if ((c->server = fork()) == -1) {
+		logMessage(LOG_ERROR_LEVEL, "Cannot fork the server : [%s]", strerror(errno));
+		return (-1);
+	}
+	if (c->server == 0) {
+		if (chdir(c->dir) == 0) {
+			if (load.plain) {
+				execl(load.server, load.server, "-p", port, "-l", "server.log", (char *)NULL);
+			} else {
+				execl(load.server, load.server, "-p", port, "-l", "server.log", "-M", "server.prom", (char *)NULL);
+			}
+		}
+		_exit(127);
+	}
+
+	// Wait for it to listen (or die)
+	for (waited = 0; !up && (waited < CRUD_LOAD_START_WAIT_MS); waited += 10) {
+		if (waitpid(c->server, &status, WNOHANG) == c->server) {
+			logMessage(LOG_ERROR_LEVEL, "Server [%s] on port %u exited on start, see %s/server.log",
+					load.server, c->port, c->dir);
+			c->server = 0;
+			return (-1);
+		}
+		if ((sock = socket(PF_INET, SOCK_STREAM, 0)) == -1) {
+			return (-1);
+		}
+		up = (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+		close(sock);
+		if (!up) {
+			usleep(10000);
+		}
+	}
+	if (!up) {
+		logMessage(LOG_ERROR_LEVEL, "Server on port %u did not start listening", c->port);
+		return (-1);
+	}
+	logMessage(LOG_INFO_LEVEL, "CRUD load: server %d listening on port %u in [%s]", c->server, c->port, c->dir);
+	return (0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : load_start_client
+// Description  : Start a client process on its next run
+//
+// Inputs       : c - the client
+//                idx - its index
+// Outputs      : 0 if successful, -1 if failure
+
+int load_start_client(CrudLoadClient *c, int idx) {
+
+	char port[16], prom[PATH_MAX+48], log[PATH_MAX+48];
+
+	// A generated trace belongs to one client, workload files are replayed by all
+	char *workload = load.workloads[load.generated ? idx : c->run % load.nworkloads];
+
+	snprintf(port, sizeof(port), "%u", c->port);
+	snprintf(prom, sizeof(prom), "%s/client%u.prom", c->dir, c->run);
+	snprintf(log, sizeof(log), "%s/client.log", c->dir);
+	gettimeofday(&c->started, NULL);
+	if ((c->client = fork()) == -1) {
+		logMessage(LOG_ERROR_LEVEL, "Cannot fork a client : [%s]", strerror(errno));
+		c->client = 0;
+		return (-1);
+	}
+	if (c->client == 0) {
+		if (chdir(c->dir) == 0) {
+			execl(load.client, load.client, "-a", "127.0.0.1", "-p", port, "-l", log, "-M", prom, workload, (char *)NULL);
+		}
+		_exit(127);
+	}
+	logMessage(LOG_INFO_LEVEL, "CRUD load: client %d run %u [%s] on port %u", c->client, c->run, workload, c->port);
+	return (0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : load_run
+// Description  : Run every client through its rounds, starting each run as
+//                the last one finishes
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if interrupted
+
+int load_run(void) {
+
+	struct timeval start, stop;
+	struct rusage usage;
+	uint32_t i, total = load.rounds * (load.generated ? 1 : load.nworkloads);
+	int status, running = 0;
+	pid_t pid;
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < load.clients; i++) {
+		if (load_start_client(&load.c[i], i) == 0) {
+			running++;
+		}
+	}
+	while (running > 0) {
+		if ((pid = wait4(-1, &status, 0, &usage)) == -1) {
+			if ((errno == EINTR) && crud_network_shutdown) {
+				for (i = 0; i < load.clients; i++) {
+					if (load.c[i].client) {
+						kill(load.c[i].client, SIGTERM);
+					}
+				}
+			}
+			if (errno == ECHILD) {
+				break;
+			}
+			continue;
+		}
+
+		// Which client was it (a server going away early is a failure too)
+		for (i = 0; (i < load.clients) && (load.c[i].client != pid) && (load.c[i].server != pid); i++);
+		if (i == load.clients) {
+			continue;
+		}
+		if (load.c[i].server == pid) {
+			logMessage(LOG_ERROR_LEVEL, "Server on port %u exited during the test, see %s/server.log",
+					load.c[i].port, load.c[i].dir);
+			load.c[i].server = 0;
+			load.c[i].usage = usage;
+			continue;
+		}
+		gettimeofday(&stop, NULL);
+		load_add_usage(&load.client_usage, &usage);
+		if (load.runs < CRUD_LOAD_MAX_RUNS) {
+			load.run_ms[load.runs] = compareTimes(&load.c[i].started, &stop) / 1000.0;
+		}
+		load.runs++;
+		load.lines += load.wlines[load.generated ? i : load.c[i].run % load.nworkloads];
+		if (!WIFEXITED(status) || (WEXITSTATUS(status) != 0)) {
+			logMessage(LOG_ERROR_LEVEL, "Client run %u on port %u failed, see %s/client.log",
+					load.c[i].run, load.c[i].port, load.c[i].dir);
+			load.failed++;
+		}
+		load.c[i].client = 0;
+		running--;
+
+		// Next run for this client
+		if ((++load.c[i].run < total) && !crud_network_shutdown && load.c[i].server &&
+			(load_start_client(&load.c[i], i) == 0)) {
+			running++;
+		}
+	}
+	gettimeofday(&stop, NULL);
+	load.wall = compareTimes(&start, &stop) / 1e6;
+	return (crud_network_shutdown ? -1 : 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : load_stop_servers
+// Description  : Ask the servers to shut down (they save their stores and
+//                dump their counters) and collect their resource usage
+//
+// Inputs       : none
+// Outputs      : none
+
+void load_stop_servers(void) {
+
+	struct rusage usage;
+	uint32_t i;
+	int status;
+
+	for (i = 0; i < load.clients; i++) {
+		if (load.c[i].server) {
+			kill(load.c[i].server, SIGINT);
+		}
+	}
+	for (i = 0; i < load.clients; i++) {
+		if (load.c[i].server) {
+			while ((wait4(load.c[i].server, &status, 0, &usage) == -1) && (errno == EINTR));
+			load.c[i].usage = usage;
+			load.c[i].server = 0;
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : load_report
+// Description  : Put the clients' and servers' dumps together and print the
+//                throughput, latency and resource usage (also as JSON)
+//
+// Inputs       : json - the JSON file, NULL for none
+// Outputs      : none
+
+void load_report(char *json) {
+
+	CrudStats clients, servers;
+	struct rusage server_usage;
+	uint64_t ops = 0, errors = 0, usec = 0, all[CRUD_METRIC_BUCKETS];
+	char path[PATH_MAX+48];
+	double fractions[] = { 0.5, 0.9, 0.99, 0.999 };
+	long maxrss = 0;
+	uint32_t i, r, b, f, t;
+	FILE *out = NULL;
+
+	// The clients' bus counts, and the servers' store counts
+	memset(&clients, 0x0, sizeof(clients));
+	memset(&servers, 0x0, sizeof(servers));
+	memset(&server_usage, 0x0, sizeof(server_usage));
+	memset(all, 0x0, sizeof(all));
+	for (i = 0; i < load.clients; i++) {
+		for (r = 0; r < load.c[i].run; r++) {
+			snprintf(path, sizeof(path), "%s/client%u.prom", load.c[i].dir, r);
+			if (access(path, F_OK) == 0) {
+				crud_stats_load(path, &clients);
+			}
+		}
+		snprintf(path, sizeof(path), "%s/server.prom", load.c[i].dir);
+		if (!load.plain && (access(path, F_OK) == 0)) {
+			crud_stats_load(path, &servers);
+		}
+		load_add_usage(&server_usage, &load.c[i].usage);
+		maxrss = (load.c[i].usage.ru_maxrss > maxrss) ? load.c[i].usage.ru_maxrss : maxrss;
+	}
+	for (t = 0; t < CRUD_MAXVAL; t++) {
+		ops += clients.ops[t];
+		errors += clients.errors[t];
+		usec += clients.usec[t];
+		for (b = 0; b < CRUD_METRIC_BUCKETS; b++) {
+			all[b] += clients.latency[t][b];
+		}
+	}
+
+	if ((json != NULL) && ((out = fopen(json, "w")) == NULL)) {
+		logMessage(LOG_ERROR_LEVEL, "Cannot write the report [%s] : [%s]", json, strerror(errno));
+	}
+	if (out != NULL) {
+		fprintf(out, "{\n  \"clients\": %u,\n  \"rounds\": %u,\n  \"runs\": %u,\n  \"failed_runs\": %u,\n",
+				load.clients, load.rounds, load.runs, load.failed);
+		fprintf(out, "  \"wall_seconds\": %.3f,\n  \"lines_per_second\": %.1f,\n  \"ops_per_second\": %.1f,\n",
+				load.wall, load.lines / load.wall, ops / load.wall);
+		fprintf(out, "  \"bytes_sent\": %lu,\n  \"bytes_received\": %lu,\n",
+				clients.counters[CRUD_METRIC_BYTES_SENT], clients.counters[CRUD_METRIC_BYTES_RECEIVED]);
+	}
+
+	// Throughput
+	printf("CRUD load test: %u clients x %u rounds, work directory %s\n", load.clients, load.rounds, load.dir);
+	printf("  %u runs (%u failed) in %.3f s: %.1f workload lines/s, %.1f bus ops/s, %.2f MB/s sent, %.2f MB/s received\n",
+			load.runs, load.failed, load.wall, load.lines / load.wall, ops / load.wall,
+			clients.counters[CRUD_METRIC_BYTES_SENT] / load.wall / 1e6,
+			clients.counters[CRUD_METRIC_BYTES_RECEIVED] / load.wall / 1e6);
+
+	// Bus latency by request type, then over all of them
+	printf("\n  %-14s %10s %8s %10s %10s %10s %10s %10s\n", "Bus (usec)", "ops", "errors", "mean",
+			"p50<=", "p90<=", "p99<=", "p99.9<=");
+	if (out != NULL) {
+		fprintf(out, "  \"latency_usec\": {\n");
+	}
+	for (t = 0; t <= CRUD_MAXVAL; t++) {
+		uint64_t *hist = (t < CRUD_MAXVAL) ? clients.latency[t] : all;
+		uint64_t n = (t < CRUD_MAXVAL) ? clients.ops[t] : ops;
+		uint64_t e = (t < CRUD_MAXVAL) ? clients.errors[t] : errors;
+		uint64_t s = (t < CRUD_MAXVAL) ? clients.usec[t] : usec;
+		const char *name = (t < CRUD_MAXVAL) ? CRUD_REQUEST_TYPE_LABLES[t] : "ALL";
+		if (n == 0) {
+			continue;
+		}
+		printf("  %-14s %10lu %8lu %10.1f", name, n, e, (double)s / n);
+		if (out != NULL) {
+			fprintf(out, "    \"%s\": { \"ops\": %lu, \"errors\": %lu, \"mean\": %.1f", name, n, e, (double)s / n);
+		}
+		for (f = 0; f < sizeof(fractions) / sizeof(double); f++) {
+			printf(" %10lu", crud_stats_percentile(hist, n, fractions[f]));
+			if (out != NULL) {
+				fprintf(out, ", \"p%g\": %lu", fractions[f] * 100, crud_stats_percentile(hist, n, fractions[f]));
+			}
+		}
+		printf("\n");
+		if (out != NULL) {
+			fprintf(out, " }%s\n", (t < CRUD_MAXVAL) ? "," : "");
+		}
+	}
+
+	// Run times
+	r = (load.runs < CRUD_LOAD_MAX_RUNS) ? load.runs : CRUD_LOAD_MAX_RUNS;
+	if (r > 0) {
+		printf("\n  Run time (ms): p50 %.1f, p90 %.1f, p99 %.1f, max %.1f\n",
+				load_percentile(load.run_ms, r, 0.5), load_percentile(load.run_ms, r, 0.9),
+				load_percentile(load.run_ms, r, 0.99), load_percentile(load.run_ms, r, 1.0));
+	}
+
+	// The servers
+	printf("  Servers: %.3f s user, %.3f s system CPU (%.1f%% of one core), largest %.1f MB resident\n",
+			server_usage.ru_utime.tv_sec + server_usage.ru_utime.tv_usec / 1e6,
+			server_usage.ru_stime.tv_sec + server_usage.ru_stime.tv_usec / 1e6,
+			100.0 * (server_usage.ru_utime.tv_sec + server_usage.ru_utime.tv_usec / 1e6 +
+			server_usage.ru_stime.tv_sec + server_usage.ru_stime.tv_usec / 1e6) / load.wall,
+			maxrss / 1024.0);
+	printf("  Clients: %.3f s user, %.3f s system CPU\n",
+			load.client_usage.ru_utime.tv_sec + load.client_usage.ru_utime.tv_usec / 1e6,
+			load.client_usage.ru_stime.tv_sec + load.client_usage.ru_stime.tv_usec / 1e6);
+	for (t = 0, ops = 0, usec = 0; t < CRUD_MAXVAL; t++) {
+		ops += servers.ops[t];
+		usec += servers.usec[t];
+	}
+	if (ops > 0) {
+		printf("  Store: %lu ops, mean %.1f usec, chunks %lu/%lu (hits/misses), %lu allocations (%.1f MB)\n",
+				ops, (double)usec / ops, servers.counters[CRUD_METRIC_CHUNK_HITS],
+				servers.counters[CRUD_METRIC_CHUNK_MISSES], servers.counters[CRUD_METRIC_ALLOCATIONS],
+				servers.counters[CRUD_METRIC_ALLOC_BYTES] / 1e6);
+	}
+
+	if (out != NULL) {
+		fprintf(out, "  },\n  \"server_user_seconds\": %.3f,\n  \"server_system_seconds\": %.3f,\n"
+				"  \"server_max_rss_kb\": %ld,\n  \"store_ops\": %lu,\n  \"store_mean_usec\": %.1f\n}\n",
+				server_usage.ru_utime.tv_sec + server_usage.ru_utime.tv_usec / 1e6,
+				server_usage.ru_stime.tv_sec + server_usage.ru_stime.tv_usec / 1e6,
+				maxrss, ops, ops ? (double)usec / ops : 0.0);
+		fclose(out);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : load_add_usage
+// Description  : Add one process's CPU time to a total
+//
+// Inputs       : total - the total
+//                usage - the process's usage
+// Outputs      : none
+
+void load_add_usage(struct rusage *total, struct rusage *usage) {
+	timeradd(&total->ru_utime, &usage->ru_utime, &total->ru_utime);
+	timeradd(&total->ru_stime, &usage->ru_stime, &total->ru_stime);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : load_count_lines
+// Description  : Count the lines of a workload file
+//
+// Inputs       : path - the file
+// Outputs      : the number of lines
+
+uint32_t load_count_lines(char *path) {
+
+	uint32_t lines = 0;
+	FILE *in;
+	int ch;
+
+	if ((in = fopen(path, "r")) == NULL) {
+		return (0);
+	}
+	while ((ch = fgetc(in)) != EOF) {
+		lines += (ch == '\n');
+	}
+	fclose(in);
+	return (lines);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : load_percentile
+// Description  : Find a percentile of some values (sorting them)
+//
+// Inputs       : values - the values
+//                count - the number of values
+//                fraction - the percentile, 0.5 for the median
+// Outputs      : the value
+
+static int load_compare(const void *a, const void *b) {
+	return ((*(double *)a > *(double *)b) - (*(double *)a < *(double *)b));
+}
+
+double load_percentile(double *values, uint32_t count, double fraction) {
+
+	uint32_t idx = (uint32_t)(fraction * count);
+
+	qsort(values, count, sizeof(double), load_compare);
+	return (values[(idx < count) ? idx : count - 1]);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : load_signal_handler
+// Description  : Stop the test on SIGINT, the servers are still shut down
+//
+// Inputs       : sig - the signal
+// Outputs      : none
+
+void load_signal_handler(int sig) {
+	crud_network_shutdown = 1;
+}
@@ -0,0 +1,522 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_metrics.c
+//  Description    : This is the implementation of the runtime counters.  A
+//                   thread's first count allocates its block and pushes it
+//                   on a list with a compare-and-swap; after that it only
+//                   ever touches its own block, with relaxed atomic stores.
+//                   Blocks are never freed, so the counts of threads that
+//                   have exited stay in the totals.
+//
+//  Author         : Xuejian Zhou
+//  Last Modified  : Mon Oct 19 2026
+//
+
+// Includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+// Project includes
+#include <crud_metrics.h>
+#include <cmpsc311_log.h>
+#include <cmpsc311_util.h>
+
+// Defines
+#define CRUD_METRICS_TEST_THREADS 4
+#define CRUD_METRICS_TEST_COUNTS 100000
+#define CRUD_METRICS_TEST_FILE "crud_metrics_test.prom"
+
+// One thread's counters
+typedef struct crud_metric_block {
+	CrudStats                  stats; // The counts
+	struct crud_metric_block  *next;  // The next thread's block
+} CrudMetricBlock;
+
+// The periodic dump
+typedef struct {
+	pthread_mutex_t  lock;            // Protects stop
+	pthread_cond_t   wake;            // Signalled to stop
+	pthread_t        thread;
+	uint8_t          running;         // The dump thread is up
+	uint8_t          stop;            // The dump thread should exit
+	uint32_t         seconds;         // Between dumps, 0 = only at the end
+	char            *path;            // The Prometheus file, NULL for the log
+} CrudMetricDumper;
+
+//
+// Global data
+
+static __thread CrudMetricBlock *metric_block = NULL;  // This thread's counters
+static CrudMetricBlock *metric_blocks = NULL;          // Every thread's counters
+static CrudMetricDumper dumper = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+static const char *metric_names[CRUD_METRIC_COUNTERS] = {
+	"crud_bytes_sent_total",
+	"crud_bytes_received_total",
+	"crud_readahead_hits_total",
+	"crud_readahead_misses_total",
+	"crud_chunk_hits_total",
+	"crud_chunk_misses_total",
+	"crud_allocations_total",
+	"crud_allocated_bytes_total",
+	"crud_object_recreates_total",
+};
+
+//
+// Functional prototypes
+
+static CrudMetricBlock *get_metric_block(void);
+static int metric_bucket(uint64_t usec);
+static void *metric_dumper(void *arg);
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_metric_add
+// Description  : Add to one of this thread's counters
+//
+// Inputs       : metric - the counter
+//                n - the amount
+// Outputs      : none
+
+void crud_metric_add(CRUD_METRIC metric, uint64_t n) {
+
+	CrudMetricBlock *block = get_metric_block();
+	uint64_t *counter;
+
+	if (block != NULL) {
+		counter = &block->stats.counters[metric];
+		__atomic_store_n(counter, *counter + n, __ATOMIC_RELAXED);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_metric_op
+// Description  : Count a bus operation in this thread's counters
+//
+// Inputs       : type - the request type
+//                usec - how long it took
+//                failed - whether it failed
+// Outputs      : none
+
+void crud_metric_op(CRUD_REQUEST_TYPES type, uint64_t usec, int failed) {
+
+	CrudMetricBlock *block = get_metric_block();
+	uint64_t *bucket;
+
+	if ((block == NULL) || (type >= CRUD_MAXVAL)) {
+		return;
+	}
+	bucket = &block->stats.latency[type][metric_bucket(usec)];
+	__atomic_store_n(&block->stats.ops[type], block->stats.ops[type] + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&block->stats.usec[type], block->stats.usec[type] + usec, __ATOMIC_RELAXED);
+	__atomic_store_n(bucket, *bucket + 1, __ATOMIC_RELAXED);
+	if (failed) {
+		__atomic_store_n(&block->stats.errors[type], block->stats.errors[type] + 1, __ATOMIC_RELAXED);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_get_stats
+// Description  : Add up the counters of every thread (each count is read
+//                atomically, the total is not a snapshot of one instant)
+//
+// Inputs       : stats - where to put the totals
+// Outputs      : none
+
+void crud_get_stats(CrudStats *stats) {
+
+	CrudMetricBlock *block;
+	uint64_t *from, *to;
+	size_t i;
+
+	memset(stats, 0x0, sizeof(CrudStats));
+	for (block = __atomic_load_n(&metric_blocks, __ATOMIC_ACQUIRE); block != NULL; block = block->next) {
+		from = (uint64_t *)&block->stats;
+		to = (uint64_t *)stats;
+		for (i = 0; i < sizeof(CrudStats) / sizeof(uint64_t); i++) {
+			to[i] += __atomic_load_n(&from[i], __ATOMIC_RELAXED);
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_stats_dump
+// Description  : Write the counters out: to the log as one line per request
+//                type seen plus one line of counters, or to a file in the
+//                Prometheus text format (written next to it and renamed, so a
+//                scraper never sees half a file)
+//
+// Inputs       : path - the file, NULL for the log
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_stats_dump(char *path) {
+
+	CrudStats stats;
+	char tmp[1024];
+	uint64_t total;
+	FILE *out;
+	int t, b, m;
+
+	crud_get_stats(&stats);
+
+	if (path == NULL) {
+		for (t = 0; t < CRUD_MAXVAL; t++) {
+			if (stats.ops[t] == 0) {
+				continue;
+			}
+			logMessage(LOG_INFO_LEVEL, "CRUD stats: %s %lu ops, %lu errors, mean %lu usec, p50 <= %lu, p99 <= %lu",
+					CRUD_REQUEST_TYPE_LABLES[t], stats.ops[t], stats.errors[t], stats.usec[t] / stats.ops[t],
+					crud_stats_percentile(stats.latency[t], stats.ops[t], 0.5),
+					crud_stats_percentile(stats.latency[t], stats.ops[t], 0.99));
+		}
+		logMessage(LOG_INFO_LEVEL, "CRUD stats: sent %lu, received %lu bytes, read-ahead %lu/%lu, chunks %lu/%lu "
+				"(hits/misses), %lu allocations (%lu bytes), %lu re-creates",
+				stats.counters[CRUD_METRIC_BYTES_SENT], stats.counters[CRUD_METRIC_BYTES_RECEIVED],
+				stats.counters[CRUD_METRIC_READAHEAD_HITS], stats.counters[CRUD_METRIC_READAHEAD_MISSES],
+				stats.counters[CRUD_METRIC_CHUNK_HITS], stats.counters[CRUD_METRIC_CHUNK_MISSES],
+				stats.counters[CRUD_METRIC_ALLOCATIONS], stats.counters[CRUD_METRIC_ALLOC_BYTES],
+				stats.counters[CRUD_METRIC_RECREATES]);
+		return(0);
+	}
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	if ((out = fopen(tmp, "w")) == NULL) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD stats: cannot write [%s] : %s", tmp, strerror(errno));
+		return(-1);
+	}
+	fprintf(out, "# HELP crud_bus_operations_total Bus operations by request type.\n"
+			"# TYPE crud_bus_operations_total counter\n");
+	for (t = 0; t < CRUD_MAXVAL; t++) {
+		fprintf(out, "crud_bus_operations_total{type=\"%s\"} %lu\n", CRUD_REQUEST_TYPE_LABLES[t], stats.ops[t]);
+	}
+	fprintf(out, "# HELP crud_bus_errors_total Failed bus operations by request type.\n"
+			"# TYPE crud_bus_errors_total counter\n");
+	for (t = 0; t < CRUD_MAXVAL; t++) {
+		fprintf(out, "crud_bus_errors_total{type=\"%s\"} %lu\n", CRUD_REQUEST_TYPE_LABLES[t], stats.errors[t]);
+	}
+	fprintf(out, "# HELP crud_bus_latency_usec Bus operation latency in microseconds.\n"
+			"# TYPE crud_bus_latency_usec histogram\n");
+	for (t = 0; t < CRUD_MAXVAL; t++) {
+		if (stats.ops[t] == 0) {
+			continue;
+		}
+		for (b = 0, total = 0; b < CRUD_METRIC_BUCKETS - 1; b++) {
+			total += stats.latency[t][b];
+			fprintf(out, "crud_bus_latency_usec_bucket{type=\"%s\",le=\"%lu\"} %lu\n",
+					CRUD_REQUEST_TYPE_LABLES[t], (uint64_t)1 << b, total);
+		}
+		fprintf(out, "crud_bus_latency_usec_bucket{type=\"%s\",le=\"+Inf\"} %lu\n"
+				"crud_bus_latency_usec_sum{type=\"%s\"} %lu\n"
+				"crud_bus_latency_usec_count{type=\"%s\"} %lu\n",
+				CRUD_REQUEST_TYPE_LABLES[t], stats.ops[t], CRUD_REQUEST_TYPE_LABLES[t], stats.usec[t],
+				CRUD_REQUEST_TYPE_LABLES[t], stats.ops[t]);
+	}
+	for (m = 0; m < CRUD_METRIC_COUNTERS; m++) {
+		fprintf(out, "# TYPE %s counter\n%s %lu\n", metric_names[m], metric_names[m], stats.counters[m]);
+	}
+	if ((fclose(out) != 0) || (rename(tmp, path) != 0)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD stats: cannot write [%s] : %s", path, strerror(errno));
+		return(-1);
+	}
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_stats_load
+// Description  : Read a Prometheus file written by crud_stats_dump and add
+//                its counts to stats, so the dumps of several processes can
+//                be put together
+//
+// Inputs       : path - the file
+//                stats - the counts to add to
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_stats_load(char *path, CrudStats *stats) {
+
+	char line[256], name[64], type[32], le[32];
+	uint64_t value, seen[CRUD_MAXVAL];
+	int t, b, m;
+	FILE *in;
+
+	if ((in = fopen(path, "r")) == NULL) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD stats: cannot read [%s] : %s", path, strerror(errno));
+		return(-1);
+	}
+	memset(seen, 0x0, sizeof(seen));
+	while (fgets(line, sizeof(line), in) != NULL) {
+		if (line[0] == '#') {
+			continue;
+		}
+
+		// Per request type: the counts, then the cumulative histogram buckets
+		if (sscanf(line, "%63[a-z_]{type=\"%31[A-Z_]\",le=\"%31[^\"]\"} %lu", name, type, le, &value) == 4) {
+			for (t = 0; (t < CRUD_MAXVAL) && strcmp(type, CRUD_REQUEST_TYPE_LABLES[t]); t++);
+			if ((t == CRUD_MAXVAL) || strcmp(name, "crud_bus_latency_usec_bucket")) {
+				continue;
+			}
+			for (b = 0; (b < CRUD_METRIC_BUCKETS - 1) && strtoull(le, NULL, 10) != ((uint64_t)1 << b); b++);
+			stats->latency[t][b] += value - seen[t];
+			seen[t] = value;
+		} else if (sscanf(line, "%63[a-z_]{type=\"%31[A-Z_]\"} %lu", name, type, &value) == 3) {
+			for (t = 0; (t < CRUD_MAXVAL) && strcmp(type, CRUD_REQUEST_TYPE_LABLES[t]); t++);
+			if (t == CRUD_MAXVAL) {
+				continue;
+			}
+			if (!strcmp(name, "crud_bus_operations_total")) {
+				stats->ops[t] += value;
+			} else if (!strcmp(name, "crud_bus_errors_total")) {
+				stats->errors[t] += value;
+			} else if (!strcmp(name, "crud_bus_latency_usec_sum")) {
+				stats->usec[t] += value;
+			}
+		} else if (sscanf(line, "%63[a-z_] %lu", name, &value) == 2) {
+			for (m = 0; m < CRUD_METRIC_COUNTERS; m++) {
+				if (!strcmp(name, metric_names[m])) {
+					stats->counters[m] += value;
+				}
+			}
+		}
+	}
+	fclose(in);
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_stats_start
+// Description  : Start a thread dumping the counters every so many seconds
+//
+// Inputs       : seconds - between dumps, 0 to dump only when stopped
+//                path - the Prometheus file, NULL for the log
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_stats_start(uint32_t seconds, char *path) {
+
+	if (dumper.running) {
+		return(-1);
+	}
+	dumper.seconds = seconds;
+	dumper.path = path;
+	dumper.stop = 0;
+	if (pthread_create(&dumper.thread, NULL, metric_dumper, NULL) != 0) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD stats: failed to start the dump thread.");
+		return(-1);
+	}
+	dumper.running = 1;
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_stats_stop
+// Description  : Stop the periodic dump (if it was started) and dump once more
+//
+// Inputs       : none
+// Outputs      : none
+
+void crud_stats_stop(void) {
+
+	if (!dumper.running) {
+		return;
+	}
+	pthread_mutex_lock(&dumper.lock);
+	dumper.stop = 1;
+	pthread_cond_signal(&dumper.wake);
+	pthread_mutex_unlock(&dumper.lock);
+	pthread_join(dumper.thread, NULL);
+	dumper.running = 0;
+	crud_stats_dump(dumper.path);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : get_metric_block
+// Description  : Get this thread's counters, adding them to the list the
+//                first time
+//
+// Inputs       : none
+// Outputs      : the block, NULL if it could not be allocated
+
+static CrudMetricBlock *get_metric_block(void) {
+
+	CrudMetricBlock *block = metric_block;
+
+	if (block != NULL) {
+		return(block);
+	}
+	if ((block = calloc(1, sizeof(CrudMetricBlock))) == NULL) {
+		return(NULL);
+	}
+	block->next = __atomic_load_n(&metric_blocks, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&metric_blocks, &block->next, block, 0,
+			__ATOMIC_RELEASE, __ATOMIC_RELAXED));
+	metric_block = block;
+	return(block);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : metric_bucket
+// Description  : Find the latency bucket: the first power of two at least as
+//                big as usec, or the last bucket
+//
+// Inputs       : usec - the latency
+// Outputs      : the bucket index
+
+static int metric_bucket(uint64_t usec) {
+
+	int bucket = (usec <= 1) ? 0 : 64 - __builtin_clzll(usec - 1);
+
+	return((bucket < CRUD_METRIC_BUCKETS) ? bucket : CRUD_METRIC_BUCKETS - 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_stats_percentile
+// Description  : Estimate a percentile from a histogram (as the upper bound of
+//                the bucket it falls in)
+//
+// Inputs       : latency - the histogram
+//                count - the number of values in it
+//                fraction - the percentile, 0.5 for the median
+// Outputs      : the bound in usec
+
+uint64_t crud_stats_percentile(uint64_t *latency, uint64_t count, double fraction) {
+
+	uint64_t seen = 0;
+	int b;
+
+	for (b = 0; b < CRUD_METRIC_BUCKETS - 1; b++) {
+		seen += latency[b];
+		if (seen >= fraction * count) {
+			break;
+		}
+	}
+	return((uint64_t)1 << b);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : metric_dumper
+// Description  : The dump thread, dumps the counters every dumper.seconds
+//                until asked to stop
+//
+// Inputs       : arg - unused
+// Outputs      : NULL
+
+static void *metric_dumper(void *arg) {
+
+	struct timespec when;
+
+	pthread_mutex_lock(&dumper.lock);
+	while (!dumper.stop) {
+		if (dumper.seconds == 0) {
+			pthread_cond_wait(&dumper.wake, &dumper.lock);
+			continue;
+		}
+		clock_gettime(CLOCK_REALTIME, &when);
+		when.tv_sec += dumper.seconds;
+		if ((pthread_cond_timedwait(&dumper.wake, &dumper.lock, &when) == ETIMEDOUT) && !dumper.stop) {
+			pthread_mutex_unlock(&dumper.lock);
+			crud_stats_dump(dumper.path);
+			pthread_mutex_lock(&dumper.lock);
+		}
+	}
+	pthread_mutex_unlock(&dumper.lock);
+	return(NULL);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : metrics_test_thread
+// Description  : Count a known amount from a unit test thread
+//
+// Inputs       : arg - unused
+// Outputs      : NULL
+
+static void *metrics_test_thread(void *arg) {
+
+	int i;
+
+	for (i = 0; i < CRUD_METRICS_TEST_COUNTS; i++) {
+		crud_metric_add(CRUD_METRIC_RECREATES, 1);
+		crud_metric_op(CRUD_UNKNOWN, i % 1000, (i % 10) == 0);
+	}
+	return(NULL);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_metrics_unit_test
+// Description  : Count from several threads at once (including ones that
+//                have exited before the totals are read), check the totals,
+//                and check the Prometheus dump reads back the same
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_metrics_unit_test(void) {
+
+	pthread_t threads[CRUD_METRICS_TEST_THREADS];
+	CrudStats before, after, loaded;
+	uint64_t total, in_buckets = 0, usec = 0;
+	int i;
+
+	crud_get_stats(&before);
+	for (i = 0; i < CRUD_METRICS_TEST_THREADS; i++) {
+		if (pthread_create(&threads[i], NULL, metrics_test_thread, NULL) != 0) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD metrics unit test failed, no thread");
+			return(-1);
+		}
+	}
+	for (i = 0; i < CRUD_METRICS_TEST_THREADS; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	crud_get_stats(&after);
+
+	// Every count is there, in the right bucket
+	total = (uint64_t)CRUD_METRICS_TEST_THREADS * CRUD_METRICS_TEST_COUNTS;
+	for (i = 0; i < CRUD_METRIC_BUCKETS; i++) {
+		in_buckets += after.latency[CRUD_UNKNOWN][i] - before.latency[CRUD_UNKNOWN][i];
+	}
+	for (i = 0; i < CRUD_METRICS_TEST_COUNTS; i++) {
+		usec += i % 1000;
+	}
+	if ((after.counters[CRUD_METRIC_RECREATES] - before.counters[CRUD_METRIC_RECREATES] != total) ||
+		(after.ops[CRUD_UNKNOWN] - before.ops[CRUD_UNKNOWN] != total) ||
+		(after.errors[CRUD_UNKNOWN] - before.errors[CRUD_UNKNOWN] != total / 10) ||
+		(after.usec[CRUD_UNKNOWN] - before.usec[CRUD_UNKNOWN] != usec * CRUD_METRICS_TEST_THREADS) ||
+		(in_buckets != total) || (metric_bucket(0) != 0) || (metric_bucket(2) != 1) ||
+		(metric_bucket(3) != 2) || (metric_bucket(UINT64_MAX) != CRUD_METRIC_BUCKETS - 1)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD metrics unit test failed, totals do not add up");
+		return(-1);
+	}
+
+	// The dump reads back the same
+	memset(&loaded, 0x0, sizeof(loaded));
+	if (crud_stats_dump(CRUD_METRICS_TEST_FILE) || crud_stats_load(CRUD_METRICS_TEST_FILE, &loaded)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD metrics unit test failed, no dump");
+		return(-1);
+	}
+	unlink(CRUD_METRICS_TEST_FILE);
+	if (memcmp(&loaded, &after, sizeof(CrudStats)) ||
+		(crud_stats_percentile(after.latency[CRUD_UNKNOWN], after.ops[CRUD_UNKNOWN], 0.5) != 512)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD metrics unit test failed, dump does not read back");
+		return(-1);
+	}
+
+	logMessage(LOG_INFO_LEVEL, "CRUD metrics unit test successful.");
+	return(0);
+}
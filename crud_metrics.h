@@ -0,0 +1,79 @@
+#ifndef CRUD_METRICS_INCLUDED
+#define CRUD_METRICS_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_metrics.h
+//  Description    : This is the header file for the runtime counters kept by
+//                   the client (transport, file I/O) and the local server
+//                   (store, transport).  Each thread counts into its own
+//                   block without locks, and the blocks are added up when
+//                   the counters are read.
+//
+//  Author         : Xuejian Zhou
+//  Last Modified  : Mon Oct 19 2026
+//
+
+// Includes
+#include <stdint.h>
+
+// Project includes
+#include <crud_driver.h>
+
+// Defines
+#define CRUD_METRIC_BUCKETS 24         // Latency buckets: <= 1, 2, 4 ... usec, the last one is the rest
+
+// The counters
+typedef enum {
+	CRUD_METRIC_BYTES_SENT      = 0,   // Bytes written to the socket
+	CRUD_METRIC_BYTES_RECEIVED  = 1,   // Bytes read from the socket
+	CRUD_METRIC_READAHEAD_HITS  = 2,   // Client reads served from the read-ahead buffer
+	CRUD_METRIC_READAHEAD_MISSES = 3,  // Client reads that had to go to the bus
+	CRUD_METRIC_CHUNK_HITS      = 4,   // Store chunks that were already held (deduplicated)
+	CRUD_METRIC_CHUNK_MISSES    = 5,   // Store chunks that had to be added
+	CRUD_METRIC_ALLOCATIONS     = 6,   // Buffers, objects and chunks allocated
+	CRUD_METRIC_ALLOC_BYTES     = 7,   // Their size
+	CRUD_METRIC_RECREATES       = 8,   // Objects re-created because a write changed their size
+	CRUD_METRIC_COUNTERS        = 9,
+} CRUD_METRIC;
+
+// The counters added up over every thread (see crud_get_stats)
+typedef struct {
+	uint64_t  counters[CRUD_METRIC_COUNTERS];             // CRUD_METRIC values
+	uint64_t  ops[CRUD_MAXVAL];                           // Bus operations by request type
+	uint64_t  errors[CRUD_MAXVAL];                        // The ones that failed
+	uint64_t  usec[CRUD_MAXVAL];                          // Their total latency
+	uint64_t  latency[CRUD_MAXVAL][CRUD_METRIC_BUCKETS];  // Their latency histogram
+} CrudStats;
+
+//
+// Functional prototypes
+
+void crud_metric_add(CRUD_METRIC metric, uint64_t n);
+	// Add n to a counter
+
+void crud_metric_op(CRUD_REQUEST_TYPES type, uint64_t usec, int failed);
+	// Count a bus operation and its latency
+
+void crud_get_stats(CrudStats *stats);
+	// Add up every thread's counters
+
+int crud_stats_dump(char *path);
+	// Write the counters to the log (path NULL) or a Prometheus text file
+
+int crud_stats_load(char *path, CrudStats *stats);
+	// Add the counts in a file written by crud_stats_dump to stats
+
+uint64_t crud_stats_percentile(uint64_t *latency, uint64_t count, double fraction);
+	// Estimate a percentile (0.5, 0.99 ...) from a latency histogram, in usec
+
+int crud_stats_start(uint32_t seconds, char *path);
+	// Dump the counters every so many seconds (0 = only when stopped)
+
+void crud_stats_stop(void);
+	// Stop the periodic dump and dump one last time
+
+int crud_metrics_unit_test(void);
+	// Count from several threads and check the totals and the dump
+
+#endif
@@ -14,6 +14,7 @@
 
 // Project Include Files
 #include <crud_driver.h>
+#include <crud_compress.h>
 
 // Defines
 #define CRUD_MAX_BACKLOG 5
@@ -21,14 +22,46 @@
 #define CRUD_DEFAULT_IP "127.0.0.1"
 #define CRUD_DEFAULT_PORT 19876
 
+// Transport counters (see crud_client_get_transport_stats)
+typedef struct {
+	uint64_t  timeouts;                // Waits on the server that passed the deadline
+	uint64_t  retries;                 // Attempts made again after a failure
+	uint64_t  reconnects;              // Connections reopened after one was lost
+	uint64_t  failures;                // Operations given up on
+} CrudTransportStats;
+
 //
 // Functional Prototypes
 
 CrudResponse crud_client_operation(CrudRequest op, void *buf);
     // This is the implementation of the client operation (crud_client.c)
 
+CrudResponse crud_client_read_range(CrudRequest op, uint32_t offset, void *buf);
+    // Ranged READ received directly into buf (crud_client.c)
+
+int crud_client_batch(CrudRequest *ops, void **bufs, CrudResponse *responses, int count);
+    // Send CREATE/UPDATE/DELETE requests back to back, then read the responses (crud_client.c)
+
+void crud_client_set_compression(uint32_t threshold);
+    // Smallest payload to compress, 0 turns compression off (crud_client.c)
+
+void crud_client_get_compression_stats(CrudCompressionStats *stats);
+    // Compression counters for the connection (crud_client.c)
+
+void crud_client_set_timeout(uint32_t msec, uint32_t retries);
+    // Deadline per operation (0 = none) and attempts after the first (crud_client.c)
+
+void crud_client_get_transport_stats(CrudTransportStats *stats);
+    // Timeout, retry and reconnect counters (crud_client.c)
+
+int crud_client_session( void );
+    // Whether INIT was done and the session has not ended (crud_client.c)
+
+int crud_client_unit_test( void );
+    // Check reconnects, retries and timeouts against a live server (crud_client.c)
+
 int crud_server( void );
-    // This is the implementation of the server application (crud_server.c)
+    // This is the implementation of the server application (crud_store_server.c)
 
 //
 // Network Global Data
@@ -36,5 +69,7 @@ int crud_server( void );
 extern int            crud_network_shutdown; // Flag indicating shutdown
 extern unsigned char *crud_network_address;  // Address of CRUD server 
 extern unsigned short crud_network_port;     // Port of CRUD server
+extern uint8_t        crud_network_capabilities; // Flags the server sent on INIT
+extern uint32_t       crud_network_features;     // CRUD_FEATURE_* bits the server sent on INIT
 
 #endif
@@ -0,0 +1,111 @@
+#ifndef CRUD_REQUEST_INCLUDED
+#define CRUD_REQUEST_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_request.h
+//  Description    : This is the codec for the 64-bit CRUD request/response
+//                   word (see the specification in crud_driver.h).  The field
+//                   layout is fixed at compile time, so each accessor is a
+//                   single shift and mask; everything here is inline.
+//
+//  Author         : Xuejian Zhou
+//  Last Modified  : Mon Oct 19 2026
+//
+
+// Includes
+#include <stddef.h>
+#include <stdint.h>
+
+// Project includes
+#include <crud_driver.h>
+
+// Defines (where each field sits in the request word)
+#define CRUD_OID_SHIFT    32
+#define CRUD_OID_BITS     32
+#define CRUD_REQ_SHIFT    28
+#define CRUD_REQ_BITS     4
+#define CRUD_LENGTH_SHIFT 4
+#define CRUD_LENGTH_BITS  24
+#define CRUD_FLAGS_SHIFT  1
+#define CRUD_FLAGS_BITS   3
+#define CRUD_RES_SHIFT    0
+#define CRUD_RES_BITS     1
+
+// Get, build and replace one field, e.g. CRUD_GET_FIELD(request, LENGTH)
+#define CRUD_FIELD_MASK(f) ((UINT64_C(1) << CRUD_##f##_BITS) - 1)
+#define CRUD_GET_FIELD(r, f) ((uint32_t)(((uint64_t)(r) >> CRUD_##f##_SHIFT) & CRUD_FIELD_MASK(f)))
+#define CRUD_PUT_FIELD(v, f) (((uint64_t)(v) & CRUD_FIELD_MASK(f)) << CRUD_##f##_SHIFT)
+#define CRUD_SET_FIELD(r, f, v) (((uint64_t)(r) & ~(CRUD_FIELD_MASK(f) << CRUD_##f##_SHIFT)) | CRUD_PUT_FIELD(v, f))
+
+// The fields of a request pulled apart (for the batch functions)
+typedef struct {
+	CrudOID   oid;    // The object ID
+	uint32_t  length; // The length in bytes
+	uint8_t   req;    // The request type (CRUD_REQUEST_TYPES)
+	uint8_t   flags;  // The flags (CRUD_FLAG_TYPES bits)
+	uint8_t   res;    // The result bit
+} CrudRequestFields;
+
+//
+// Single request functions
+
+static inline CrudRequest crud_request_encode(CrudOID oid, CRUD_REQUEST_TYPES req,
+		uint32_t length, uint8_t flags, uint8_t res) {
+	return (CRUD_PUT_FIELD(oid, OID) | CRUD_PUT_FIELD(req, REQ) | CRUD_PUT_FIELD(length, LENGTH) |
+			CRUD_PUT_FIELD(flags, FLAGS) | CRUD_PUT_FIELD(res, RES));
+}
+
+static inline CrudOID crud_request_oid(CrudRequest request) {
+	return (CRUD_GET_FIELD(request, OID));
+}
+
+static inline CRUD_REQUEST_TYPES crud_request_type(CrudRequest request) {
+	return ((CRUD_REQUEST_TYPES)CRUD_GET_FIELD(request, REQ));
+}
+
+static inline uint32_t crud_request_length(CrudRequest request) {
+	return (CRUD_GET_FIELD(request, LENGTH));
+}
+
+static inline uint8_t crud_request_flags(CrudRequest request) {
+	return ((uint8_t)CRUD_GET_FIELD(request, FLAGS));
+}
+
+static inline uint8_t crud_request_result(CrudRequest request) {
+	return ((uint8_t)CRUD_GET_FIELD(request, RES));
+}
+
+//
+// Batch functions, written as flat loops over the arrays so the compiler can
+// vectorize them
+
+static inline void crud_request_encode_batch(const CrudRequestFields *restrict in,
+		CrudRequest *restrict out, size_t count) {
+	size_t i;
+	for (i = 0; i < count; i++) {
+		out[i] = CRUD_PUT_FIELD(in[i].oid, OID) | CRUD_PUT_FIELD(in[i].req, REQ) |
+				CRUD_PUT_FIELD(in[i].length, LENGTH) | CRUD_PUT_FIELD(in[i].flags, FLAGS) |
+				CRUD_PUT_FIELD(in[i].res, RES);
+	}
+}
+
+static inline void crud_request_decode_batch(const CrudRequest *restrict in,
+		CrudRequestFields *restrict out, size_t count) {
+	size_t i;
+	for (i = 0; i < count; i++) {
+		out[i].oid = CRUD_GET_FIELD(in[i], OID);
+		out[i].req = (uint8_t)CRUD_GET_FIELD(in[i], REQ);
+		out[i].length = CRUD_GET_FIELD(in[i], LENGTH);
+		out[i].flags = (uint8_t)CRUD_GET_FIELD(in[i], FLAGS);
+		out[i].res = (uint8_t)CRUD_GET_FIELD(in[i], RES);
+	}
+}
+
+//
+// Unit testing for the module
+
+int crud_request_unit_test(void);
+	// Check the codec against the bit layout and time it against the old code
+
+#endif
@@ -20,19 +20,29 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <limits.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/time.h>
 
 // Project Includes
 #include <crud_driver.h>
 #include <crud_network.h>
+#include <crud_request.h>
 #include <crud_file_io.h>
+#include <crud_metrics.h>
 #include <cmpsc311_log.h>
 #include <cmpsc311_util.h>
 
 // Defines
 #define CRUD_SIM_MAX_OPEN_FILES 128
-#define CRUD_ARGUMENTS "hvul:x:a:p:"
+#define CRUD_SIM_STREAM_CHUNK 65536
+#define CRUD_SIM_MAX_WRITERS 16
+#define CRUD_SIM_IMPORT_GROUP 256
+#define CRUD_ARGUMENTS "hvul:x:X:j:I:a:p:s:m:M:"
 #define USAGE \
-	"USAGE: crud [-h] [-v] [-l <logfile>] [-c <sz>] [-x <file>] [-a <ip addr>] [-p <port>] <workload-file>\n" \
+	"USAGE: crud [-h] [-v] [-l <logfile>] [-c <sz>] [-x <file>] [-X <dir>] [-j <n>] [-I <dir>] [-a <ip addr>] [-p <port>] [-s <seed>] [-m <sec>] [-M <file>] <workload-file>\n" \
 	"\n" \
 	"where:\n" \
 	"    -h - help mode (display this message)\n" \
@@ -40,8 +50,14 @@
 	"    -v - verbose output\n" \
 	"    -l - write log messages to the filename <logfile>\n" \
 	"    -x - extract a file <file> from the crud filesystem\n" \
+	"    -X - extract every file in the crud filesystem into directory <dir>\n" \
+	"    -j - number of threads writing extracted files (default 1)\n" \
+	"    -I - load every file in directory <dir> into the crud filesystem\n" \
 	"    -a - IP address of server to connect to.\n" \
 	"    -p - port number of server to connect to.\n" \
+	"    -s - seed for the random values (unit tests), to repeat a run\n" \
+	"    -m - log the runtime counters every <sec> seconds (and at exit)\n" \
+	"    -M - write the runtime counters to <file> in Prometheus text format\n" \
 	"\n" \
 	"    <workload-file> - file contain the workload to simulate\n" \
 	"\n" \
@@ -52,15 +68,55 @@ typedef struct {
 	int16_t   fhandle;   // This is a file handle for the opened file
 } CrudSimulationTable;
 
+// This is a host file being extracted to
+typedef struct {
+	int       fhandle;   // The host file
+	uint32_t  pending;   // Chunks read from CRUD but not written yet
+	int       reading;   // Still being read from CRUD
+	int       failed;    // A write to it failed
+} CrudExportFile;
+
+// This is a chunk on its way from CRUD to a host file
+typedef struct {
+	CrudExportFile *file;    // The file it belongs in
+	off_t           offset;  // Where it goes in the file
+	int32_t         length;  // The number of bytes
+	char           *data;    // The bytes
+} CrudExportChunk;
+
+// This is the extraction pipeline: the main thread reads chunks from CRUD
+// and queues them, the writer threads write them to the host files
+typedef struct {
+	pthread_mutex_t  lock;                            // Protects everything below
+	pthread_cond_t   changed;                         // A chunk was queued or a buffer freed
+	pthread_t        threads[CRUD_SIM_MAX_WRITERS];   // The writers
+	int              writers;                         // The number of writers
+	CrudExportChunk *queue;                           // Ring of chunks waiting to be written
+	int              head, count, nbufs;              // Ring start, chunks in it, its size
+	char           **free_bufs;                       // Buffers free to read into
+	int              nfree;                           // The number of free buffers
+	int              stopping;                        // No more chunks are coming
+	int              failed;                          // Some write failed
+} CrudExporter;
+
 //
 // Global Data
 int verbose;
+CrudExporter exporter;
 
 //
 // Functional Prototypes
 
 int simulate_CRUD( char *wload );
 int extract_file_from_crud(char *ex_file);
+int export_crud(char *dir, int writers);
+void *export_writer(void *arg);
+void export_file_done( CrudExportFile *file );
+int export_start( int writers );
+int export_file( char *crud_name, char *host_name );
+int export_finish( void );
+int import_crud(char *dir);
+int import_group(char **names, void **maps, uint32_t *lengths, int count);
 
 //
 // Functions
@@ -76,9 +132,12 @@ int extract_file_from_crud(char *ex_file);
 
 int main( int argc, char *argv[] ) {
 	// Local variables
-	int ch, verbose = 0, unit_tests = 0, log_initialized = 0, extract_file = 0;
+	int ch, verbose = 0, unit_tests = 0, log_initialized = 0, extract_file = 0, writers = 1;
 	uint32_t cache_size = 1024; // Defaults to 1024 cache lines
-	char *ex_file = NULL;
+	uint32_t stats_period = 0;
+	uint64_t seed;
+	char *ex_file = NULL, *ex_dir = NULL, *im_dir = NULL, *stats_file = NULL;
+	int stats = 0, ret = 0;
 
 	// Process the command line parameters
 	while ((ch = getopt(argc, argv, CRUD_ARGUMENTS)) != -1) {
@@ -106,6 +165,21 @@ int main( int argc, char *argv[] ) {
 			extract_file = 1;
 			break;
 
+		case 'X': // Extract everything into a directory
+			ex_dir = optarg;
+			break;
+
+		case 'I': // Load a directory into CRUD
+			im_dir = optarg;
+			break;
+
+		case 'j': // Set the number of extraction writers
+			if ( (sscanf( optarg, "%d", &writers ) != 1) || (writers < 1) ) {
+			    logMessage( LOG_ERROR_LEVEL, "Bad  writer count [%s]", optarg );
+                return(-1);
+			}
+			break;
+
 		case 'c': // Set cache line size
 			if ( sscanf( optarg, "%u", &cache_size ) != 1 ) {
 			    logMessage( LOG_ERROR_LEVEL, "Bad  cache size [%s]", argv[optind] );
@@ -128,6 +202,27 @@ int main( int argc, char *argv[] ) {
 			}
             break;
 
+        case 's': // Seed the random values
+			if ( sscanf(optarg, "%lu", &seed) != 1 ) {
+			    logMessage( LOG_ERROR_LEVEL, "Bad  random seed [%s]", optarg );
+                return(-1);
+			}
+			setRandomSeed( seed );
+            break;
+
+		case 'm': // Dump the counters periodically
+			if ( sscanf(optarg, "%u", &stats_period) != 1 ) {
+			    logMessage( LOG_ERROR_LEVEL, "Bad  metrics period [%s]", optarg );
+                return(-1);
+			}
+			stats = 1;
+			break;
+
+		case 'M': // Dump the counters to a Prometheus file
+			stats_file = optarg;
+			stats = 1;
+			break;
+
 		default:  // Default (unknown)
 			fprintf( stderr, "Unknown command line option (%c), aborting.\n", ch );
 			return( -1 );
@@ -141,25 +236,48 @@ int main( int argc, char *argv[] ) {
 	if ( verbose ) {
 		enableLogLevels( LOG_INFO_LEVEL );
 	}
+	if ( stats && crud_stats_start(stats_period, stats_file) ) {
+		return( -1 );
+	}
 
 	// If we are running the unit tests, do that
 	if ( unit_tests ) {
 
 		// Enable verbose, run the tests and check the results
 		enableLogLevels( LOG_INFO_LEVEL );
-		if ( b64UnitTest() || crudIOUnitTest() ) {
+		logMessage( LOG_INFO_LEVEL, "CRUD unit tests random seed %lu (-s to repeat)", getRandomSeed() );
+		if ( b64UnitTest() || crc32cUnitTest() || crud_request_unit_test() || crud_compress_unit_test() ||
+			crud_metrics_unit_test() || crud_client_unit_test() || crudIOUnitTest() ) {
 			logMessage( LOG_ERROR_LEVEL, "CRUD unit tests failed.\n\n" );
 		} else {
 			logMessage( LOG_INFO_LEVEL, "CRUD unit tests completed successfully.\n\n" );
 		}
 
+	} else if (im_dir != NULL) {
+
+		// Loading a host directory into the crud file system
+		if (import_crud(im_dir) == 0) {
+			logMessage(LOG_INFO_LEVEL, "Directory [%s] loaded into crud successfully.\n\n", im_dir);
+		} else {
+			logMessage(LOG_ERROR_LEVEL, "Loading directory [%s] into crud failed.\n\n", im_dir);
+		}
+
+	} else if (ex_dir != NULL) {
+
+		// Extracting the whole crud file system
+		if (export_crud(ex_dir, writers) == 0) {
+			logMessage(LOG_INFO_LEVEL, "CRUD file system extracted to [%s] successfully.\n\n", ex_dir);
+		} else {
+			logMessage(LOG_ERROR_LEVEL, "CRUD file system extraction to [%s] failed.\n\n", ex_dir);
+		}
+
 	} else if (extract_file) {
 
 		// Extracting a file from the crud file systems
 		if (extract_file_from_crud(ex_file) == 0) {
 			logMessage(LOG_INFO_LEVEL, "File [%s] extracted from crud successfully.\n\n", ex_file);
 		} else {
-			logMessage(LOG_ERROR_LEVEL, "File [%s] extraction failed, aborting.\n\n");
+			logMessage(LOG_ERROR_LEVEL, "File [%s] extraction failed, aborting.\n\n", ex_file);
 		}
 
 	} else {
@@ -178,11 +296,17 @@ int main( int argc, char *argv[] ) {
 			logMessage( LOG_INFO_LEVEL, "CRUD simulation completed successfully.\n\n" );
 		} else {
 			logMessage( LOG_INFO_LEVEL, "CRUD simulation failed.\n\n" );
+			ret = -1;
 		}
 	}
 
-	// Return successfully
-	return( 0 );
+	// Dump the counters one last time
+	if ( stats ) {
+		crud_stats_stop();
+	}
+
+	// Return the simulation result (the load test counts failed runs)
+	return( ret );
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -197,9 +321,10 @@ int main( int argc, char *argv[] ) {
 int simulate_CRUD( char *wload ) {
 
 	// Local variables
-	char line[2048], fname[128], command[128], text[2048], *sep, *rbuf;
+	char line[2048], text[2048], *rbuf;
+	CrudWorkloadLine op;
 	FILE *fhandle = NULL;
-	int32_t err=0, len, off, fields, linecount;
+	int32_t err=0, linecount;
 	CrudSimulationTable ftable[CRUD_SIM_MAX_OPEN_FILES];
 	int idx, i;
 
@@ -222,9 +347,7 @@ int simulate_CRUD( char *wload ) {
 
 			// Parse out the string
 			linecount ++;
-			fields = sscanf(line, "%s %s %d %d", fname, command, &len, &off);
-			sep = strchr(line, ':');
-			if ( (fields != 4) || (sep == NULL) ) {
+			if ( crud_parse_workload_line(line, &op) ) {
 				logMessage( LOG_ERROR_LEVEL, "CRUD un-parsable workload string, aborting [%s], line %d",
 						line, linecount );
 				fclose( fhandle );
@@ -233,34 +356,34 @@ int simulate_CRUD( char *wload ) {
 
 			// Just log the contents
 			logMessage(LOG_INFO_LEVEL, "File [%s], command [%s], len=%d, offset=%d",
-					fname, command, len, off);
+					op.fname, op.command, op.len, op.off);
 
 			// Now process the commands
-			if (strncmp(command, "FORMAT", 6) == 0) {
+			if (strncmp(op.command, "FORMAT", 6) == 0) {
 
 				// Log the command executed
 				logMessage(LOG_INFO_LEVEL, "CRUD_SIM : Formatting CRUD filesystem");
 
 				// Now perform the format
-				if (crud_format() != len) {
+				if (crud_format() != op.len) {
 					// Failed, error out
 					logMessage(LOG_ERROR_LEVEL, "Formatting failed, aborting simulation.");
 					return(-1);
 				}
 
-			} else if (strncmp(command, "MOUNT", 5) == 0) {
+			} else if (strncmp(op.command, "MOUNT", 5) == 0) {
 
 				// Log the command executed
 				logMessage(LOG_INFO_LEVEL, "CRUD_SIM : Mounting CRUD filesystem");
 
 				// Now perform the filesystem mount
-				if (crud_mount() != len) {
+				if (crud_mount() != op.len) {
 					// Failed, error out
 					logMessage(LOG_ERROR_LEVEL, "Mount failed, aborting simulation.");
 					return(-1);
 				}
 
-			} else if (strncmp(command, "UNMOUNT", 5) == 0) {
+			} else if (strncmp(op.command, "UNMOUNT", 5) == 0) {
 
 				// Log the command executed
 				logMessage(LOG_INFO_LEVEL, "CRUD_SIM : Un-mounting CRUD filesystem");
@@ -284,7 +407,7 @@ int simulate_CRUD( char *wload ) {
 				}
 
 				// Now perform the filesystem unmount
-				if (crud_unmount() != len) {
+				if (crud_unmount() != op.len) {
 					// Failed, error out
 					logMessage(LOG_ERROR_LEVEL, "Mount failed, aborting simulation.");
 					return(-1);
@@ -300,7 +423,7 @@ int simulate_CRUD( char *wload ) {
 				idx = -1;
 				i = 0;
 				while ( (i < CRUD_SIM_MAX_OPEN_FILES) && (idx == -1) ) {
-					if ( (ftable[i].filename != NULL) && (strcmp(ftable[i].filename,fname) == 0) ) {
+					if ( (ftable[i].filename != NULL) && (strcmp(ftable[i].filename,op.fname) == 0) ) {
 						idx = i;
 					}
 					i++;
@@ -310,100 +433,88 @@ int simulate_CRUD( char *wload ) {
 				if (idx == -1) {
 
 					// Log message, find unused index and save filename for later use
-					logMessage(LOG_INFO_LEVEL, "CRUD_SIM : Opening file [%s]", fname);
+					logMessage(LOG_INFO_LEVEL, "CRUD_SIM : Opening file [%s]", op.fname);
 					idx = 0;
 					while ((ftable[idx].filename != NULL) && (idx < CRUD_SIM_MAX_OPEN_FILES)) {
 						idx++;
 					}
 					CMPSC_ASSERT1(idx<CRUD_SIM_MAX_OPEN_FILES, "Too many open files on CRUD sim [%d]", idx);
-					ftable[idx].filename = strdup(fname);
+					ftable[idx].filename = strdup(op.fname);
 
 					// Now perform the open
 					ftable[idx].fhandle = crud_open(ftable[idx].filename);
 					if (ftable[idx].fhandle == -1) {
 						// Failed, error out
-						logMessage(LOG_ERROR_LEVEL, "Open of new file [%s] failed, aborting simulation.", fname);
+						logMessage(LOG_ERROR_LEVEL, "Open of new file [%s] failed, aborting simulation.", op.fname);
 						return(-1);
 					}
 
 				}
 
 				// Now execute the specific command
-				if (strncmp(command, "WRITEAT", 7) == 0) {
+				if (strncmp(op.command, "WRITEAT", 7) == 0) {
 
 					// Log the command executed
-					logMessage(LOG_INFO_LEVEL, "CRUD_SIM : Writing %d bytes at position %d from file [%s]", len, off, fname);
+					logMessage(LOG_INFO_LEVEL, "CRUD_SIM : Writing %d bytes at position %d from file [%s]", op.len, op.off, op.fname);
 
 					// First perform the seek
-					if (crud_seek(ftable[idx].fhandle, off)) {
+					if (crud_seek(ftable[idx].fhandle, op.off)) {
 						// Failed, error out
-						logMessage(LOG_ERROR_LEVEL, "Seek/WriteAt file [%s] to position %d failed, aborting simulation.", fname, off);
+						logMessage(LOG_ERROR_LEVEL, "Seek/WriteAt file [%s] to position %d failed, aborting simulation.", op.fname, op.off);
 						return(-1);
 					}
 
 					// Now see if we need more data to fill, terminate the lines
-					CMPSC_ASSERT1(len<1024, "Simulated workload command text too large [%d]", len);
-					CMPSC_ASSERT2((strlen(sep+1)>=len), "Workload str [%d<%d]", strlen(sep+1), len);
-					strncpy(text, sep+1, len);
-					text[len] = 0x0;
-					for (i=0; i<strlen(text); i++) {
-						if (text[i] == '*') {
-							text[i] = '\n';
-						}
-					}
+					CMPSC_ASSERT1(op.len<1024, "Simulated workload command text too large [%d]", op.len);
+					CMPSC_ASSERT2((strlen(op.text)>=op.len), "Workload str [%d<%d]", strlen(op.text), op.len);
+					crud_workload_text(&op, text);
 
 					// Now perform the write
-					if (crud_write(ftable[idx].fhandle, text, len) != len) {
+					if (crud_write(ftable[idx].fhandle, text, op.len) != op.len) {
 						// Failed, error out
-						logMessage(LOG_ERROR_LEVEL, "WriteAt of file [%s], length %d failed, aborting simulation.", fname, len);
+						logMessage(LOG_ERROR_LEVEL, "WriteAt of file [%s], length %d failed, aborting simulation.", op.fname, op.len);
 						return(-1);
 					}
 
-				} else if (strncmp(command, "WRITE", 5) == 0) {
+				} else if (strncmp(op.command, "WRITE", 5) == 0) {
 
 					// Now see if we need more data to fill, terminate the lines
-					CMPSC_ASSERT1(len<1024, "Simulated workload command text too large [%d]", len);
-					CMPSC_ASSERT2((strlen(sep+1)>=len), "Workload str [%d<%d]", strlen(sep+1), len);
-					strncpy(text, sep+1, len);
-					text[len] = 0x0;
-					for (i=0; i<strlen(text); i++) {
-						if (text[i] == '*') {
-							text[i] = '\n';
-						}
-					}
+					CMPSC_ASSERT1(op.len<1024, "Simulated workload command text too large [%d]", op.len);
+					CMPSC_ASSERT2((strlen(op.text)>=op.len), "Workload str [%d<%d]", strlen(op.text), op.len);
+					crud_workload_text(&op, text);
 
 					// Log the command executed
-					logMessage(LOG_INFO_LEVEL, "CRUD_SIM : Writing %d bytes to file [%s]", len, fname);
+					logMessage(LOG_INFO_LEVEL, "CRUD_SIM : Writing %d bytes to file [%s]", op.len, op.fname);
 
 					// Now perform the write
-					if (crud_write(ftable[idx].fhandle, text, len) != len) {
+					if (crud_write(ftable[idx].fhandle, text, op.len) != op.len) {
 						// Failed, error out
-						logMessage(LOG_ERROR_LEVEL, "Write of file [%s], length %d failed, aborting simulation.", fname, len);
+						logMessage(LOG_ERROR_LEVEL, "Write of file [%s], length %d failed, aborting simulation.", op.fname, op.len);
 						return(-1);
 					}
 
-				} else if (strncmp(command, "SEEK", 4) == 0) {
+				} else if (strncmp(op.command, "SEEK", 4) == 0) {
 
 					// Log the command executed
-					logMessage(LOG_INFO_LEVEL, "CRUD_SIM : Seeking to position %d in file [%s]", off, fname);
+					logMessage(LOG_INFO_LEVEL, "CRUD_SIM : Seeking to position %d in file [%s]", op.off, op.fname);
 
 					// Now perform the seek
-					if (crud_seek(ftable[idx].fhandle, off) != len) {
+					if (crud_seek(ftable[idx].fhandle, op.off) != op.len) {
 						// Failed, error out
-						logMessage(LOG_ERROR_LEVEL, "Seek in file [%s] to position %d failed, aborting simulation.", fname, off);
+						logMessage(LOG_ERROR_LEVEL, "Seek in file [%s] to position %d failed, aborting simulation.", op.fname, op.off);
 						return(-1);
 					}
 
-				} else if (strncmp(command, "READ", 4) == 0) {
+				} else if (strncmp(op.command, "READ", 4) == 0) {
 
 					// Log the command executed
-					logMessage(LOG_INFO_LEVEL, "CRUD_SIM : Reading %d bytes from file [%s]", len, fname);
+					logMessage(LOG_INFO_LEVEL, "CRUD_SIM : Reading %d bytes from file [%s]", op.len, op.fname);
 
 					// Now perform the read
-					rbuf = malloc(len);
-					if (crud_read(ftable[idx].fhandle, rbuf, len) != len) {
+					rbuf = malloc(op.len);
+					if (crud_read(ftable[idx].fhandle, rbuf, op.len) != op.len) {
 						// Failed, error out
-						logMessage(LOG_ERROR_LEVEL, "Read file [%s] of length %d failed, aborting simulation.", fname, off);
+						logMessage(LOG_ERROR_LEVEL, "Read file [%s] of length %d failed, aborting simulation.", op.fname, op.off);
 						return(-1);
 					}
 					free(rbuf);
@@ -412,7 +523,7 @@ int simulate_CRUD( char *wload ) {
 				} else {
 
 					// Bomb out, don't understand the command
-					CMPSC_ASSERT1(0, "CRUD_SIM : Failed, unknown command [%s]", command);
+					CMPSC_ASSERT1(0, "CRUD_SIM : Failed, unknown command [%s]", op.command);
 
 				}
 			}
@@ -431,6 +542,224 @@ int simulate_CRUD( char *wload ) {
 	return( 0 );
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : export_writer
+// Description  : An export writer thread, it writes chunks to their host
+//                files until the queue is empty and the export is over
+//
+// Inputs       : arg - unused
+// Outputs      : NULL
+
+void *export_writer(void *arg) {
+
+	// Local variables
+	CrudExportChunk chunk;
+	int32_t done, n;
+
+	pthread_mutex_lock( &exporter.lock );
+	while ( 1 ) {
+
+		// Wait for a chunk (or the end)
+		while ( (exporter.count == 0) && !exporter.stopping ) {
+			pthread_cond_wait( &exporter.changed, &exporter.lock );
+		}
+		if ( exporter.count == 0 ) {
+			break;
+		}
+		chunk = exporter.queue[exporter.head];
+		exporter.head = (exporter.head + 1) % exporter.nbufs;
+		exporter.count--;
+		pthread_mutex_unlock( &exporter.lock );
+
+		// Write it where it goes in the file, other writers may be ahead of us
+		for ( done = 0; done < chunk.length; done += n ) {
+			n = pwrite( chunk.file->fhandle, &chunk.data[done], chunk.length - done, chunk.offset + done );
+			if ( n <= 0 ) {
+				logMessage( LOG_ERROR_LEVEL, "CRUD: export write() failed, error=%s", strerror(errno) );
+				break;
+			}
+		}
+
+		// Give the buffer back, close the file after its last chunk
+		pthread_mutex_lock( &exporter.lock );
+		if ( done < chunk.length ) {
+			chunk.file->failed = 1;
+			exporter.failed = 1;
+		}
+		exporter.free_bufs[exporter.nfree++] = chunk.data;
+		chunk.file->pending--;
+		export_file_done( chunk.file );
+		pthread_cond_broadcast( &exporter.changed );
+	}
+	pthread_mutex_unlock( &exporter.lock );
+
+	return( NULL );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : export_file_done
+// Description  : Close a host file once it is read and written (call with the
+//                exporter locked)
+//
+// Inputs       : file - the host file
+// Outputs      : none
+
+void export_file_done( CrudExportFile *file ) {
+
+	if ( file->reading || (file->pending > 0) ) {
+		return;
+	}
+	if ( close(file->fhandle) != 0 ) {
+		exporter.failed = 1;
+	}
+	free( file );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : export_start
+// Description  : Start the export writers, with two buffers for each so the
+//                next chunk is read from CRUD while the last is written
+//
+// Inputs       : writers - the number of writer threads
+// Outputs      : 0 if successful, -1 if failure
+
+int export_start( int writers ) {
+
+	// Local variables
+	int i;
+
+	memset( &exporter, 0x0, sizeof(exporter) );
+	exporter.writers = (writers < 1) ? 1 : ((writers > CRUD_SIM_MAX_WRITERS) ? CRUD_SIM_MAX_WRITERS : writers);
+	exporter.nbufs = exporter.writers * 2;
+	exporter.queue = malloc( exporter.nbufs * sizeof(CrudExportChunk) );
+	exporter.free_bufs = malloc( exporter.nbufs * sizeof(char *) );
+	for ( i = 0; i < exporter.nbufs; i++ ) {
+		exporter.free_bufs[exporter.nfree++] = malloc( CRUD_SIM_STREAM_CHUNK );
+	}
+	pthread_mutex_init( &exporter.lock, NULL );
+	pthread_cond_init( &exporter.changed, NULL );
+	for ( i = 0; i < exporter.writers; i++ ) {
+		if ( pthread_create(&exporter.threads[i], NULL, export_writer, NULL) != 0 ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD: export writer thread failed to start." );
+			exporter.writers = i;
+			return( -1 );
+		}
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : export_file
+// Description  : Stream one file out of CRUD into a new host file, a chunk at
+//                a time (the writers put the chunks in the host file)
+//
+// Inputs       : crud_name - the name of the file in CRUD
+//                host_name - the host file to create
+// Outputs      : 0 if successful, -1 if failure
+
+int export_file( char *crud_name, char *host_name ) {
+
+	// Local variables
+	CrudExportFile *file;
+	CrudExportChunk *chunk;
+	int16_t fd;
+	int32_t len;
+	off_t offset = 0;
+	char *buf;
+
+	// Find the file in CRUD (do not add it), then make the host file
+	if ( ((fd = crud_find(crud_name)) == -1) || ((fd = crud_open(crud_name)) == -1) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD : extraction failed on crud interface [%s].", crud_name );
+		return( -1 );
+	}
+	file = malloc( sizeof(CrudExportFile) );
+	file->pending = 0;
+	file->reading = 1;
+	file->failed = 0;
+	file->fhandle = open( host_name, O_WRONLY|O_CREAT|O_EXCL, S_IRUSR|S_IWUSR|S_IRGRP );
+	if ( file->fhandle == -1 ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD: extraction open() failed [%s], error=%s", host_name, strerror(errno) );
+		free( file );
+		crud_close( fd );
+		return( -1 );
+	}
+
+	// Read chunks into free buffers and queue them, a short read is the end
+	do {
+		pthread_mutex_lock( &exporter.lock );
+		while ( exporter.nfree == 0 ) {
+			pthread_cond_wait( &exporter.changed, &exporter.lock );
+		}
+		buf = exporter.free_bufs[--exporter.nfree];
+		pthread_mutex_unlock( &exporter.lock );
+
+		len = crud_read( fd, buf, CRUD_SIM_STREAM_CHUNK );
+
+		pthread_mutex_lock( &exporter.lock );
+		if ( len <= 0 ) {
+			exporter.free_bufs[exporter.nfree++] = buf;
+		} else {
+			chunk = &exporter.queue[(exporter.head + exporter.count) % exporter.nbufs];
+			chunk->file = file;
+			chunk->offset = offset;
+			chunk->length = len;
+			chunk->data = buf;
+			exporter.count++;
+			file->pending++;
+			offset += len;
+		}
+		pthread_cond_broadcast( &exporter.changed );
+		pthread_mutex_unlock( &exporter.lock );
+	} while ( len == CRUD_SIM_STREAM_CHUNK );
+
+	// The writers close it when they are done with it
+	pthread_mutex_lock( &exporter.lock );
+	if ( len == -1 ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD : extraction read failed [%s].", crud_name );
+		exporter.failed = 1;
+	}
+	file->reading = 0;
+	export_file_done( file );
+	pthread_mutex_unlock( &exporter.lock );
+	crud_close( fd );
+
+	return( (len == -1) ? -1 : 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : export_finish
+// Description  : Let the writers empty the queue, stop them and free the buffers
+//
+// Inputs       : none
+// Outputs      : 0 if every write worked, -1 if failure
+
+int export_finish( void ) {
+
+	// Local variables
+	int i;
+
+	pthread_mutex_lock( &exporter.lock );
+	exporter.stopping = 1;
+	pthread_cond_broadcast( &exporter.changed );
+	pthread_mutex_unlock( &exporter.lock );
+	for ( i = 0; i < exporter.writers; i++ ) {
+		pthread_join( exporter.threads[i], NULL );
+	}
+	for ( i = 0; i < exporter.nfree; i++ ) {
+		free( exporter.free_bufs[i] );
+	}
+	free( exporter.free_bufs );
+	free( exporter.queue );
+	pthread_mutex_destroy( &exporter.lock );
+	pthread_cond_destroy( &exporter.changed );
+	return( exporter.failed ? -1 : 0 );
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // Function     : extract_file_from_crud
@@ -442,36 +771,178 @@ int simulate_CRUD( char *wload ) {
 int extract_file_from_crud(char *ex_file) {
 
 	// Local variables
-	int16_t fd;
-	int32_t len;
-	char buf[CRUD_MAX_OBJECT_SIZE];
-    int fhandle, flags;
-    mode_t mode;
-	// Open the file, read from it, close it
-	if ( (crud_mount()) || ((fd = crud_open(ex_file)) == -1) ||
-		 ((len = crud_read(fd, buf, CRUD_MAX_OBJECT_SIZE)) == -1) ||
-		 (crud_close(fd) == -1)	) {
-		// Error out
+	int ret;
+
+	// Stream the file out, one writer is enough to overlap reads and writes
+	if ( crud_mount() || export_start(1) ) {
 		logMessage(LOG_INFO_LEVEL, "CRUD : extraction failed on crud interface [%s].", ex_file);
 		return(-1);
 	}
+	ret = export_file( ex_file, ex_file );
+	if ( export_finish() || crud_unmount() ) {
+		ret = -1;
+	}
+	return( ret );
+}
 
-    // Setup the file for creating and open
-    flags = O_WRONLY|O_CREAT|O_EXCL; // Create a NEW file (no overwrite)
-    mode = S_IRUSR|S_IWUSR|S_IRGRP;   // User can read/write, group read
-    fhandle = open(ex_file, flags, mode);
-    if ( fhandle == -1 ) {
-        fprintf( stderr, "CRUD: extraction open() failed, error=%s\n", strerror(errno) );
-        return( -1 );
-    }
-
-    // Now write the read bytes to the file, then close
-    if (write(fhandle, buf, len) != len) {
-        fprintf( stderr, "CRUD: extraction write() failed, error=%s\n", strerror(errno) );
-        return( -1 );
-    }
-    close( fhandle );
-
-    // Return successfully
-	return( 0 );
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : export_crud
+// Description  : Extract every file in the CRUD file system into a host
+//                directory (made if it is not there)
+//
+// Inputs       : dir - the host directory
+//                writers - the number of writer threads
+// Outputs      : 0 if successful test, -1 if failure
+
+int export_crud(char *dir, int writers) {
+
+	// Local variables
+	char name[CRUD_MAX_PATH_LENGTH], path[PATH_MAX];
+	int16_t fd = -1;
+	int ret = 0, files = 0;
+
+	if ( (mkdir(dir, S_IRWXU|S_IRGRP|S_IXGRP) == -1) && (errno != EEXIST) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD: export mkdir() failed [%s], error=%s", dir, strerror(errno) );
+		return( -1 );
+	}
+	if ( crud_mount() || export_start(writers) ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD : export failed on crud interface." );
+		return( -1 );
+	}
+
+	// Every file in the table, names with a directory in them are left alone
+	while ( (fd = crud_next_file(fd, name)) != -1 ) {
+		if ( strchr(name, '/') != NULL ) {
+			logMessage( LOG_WARNING_LEVEL, "CRUD : not exporting [%s], it is not a plain name.", name );
+			continue;
+		}
+		snprintf( path, sizeof(path), "%s/%s", dir, name );
+		if ( export_file(name, path) ) {
+			ret = -1;
+		} else {
+			files++;
+		}
+	}
+
+	if ( export_finish() || crud_unmount() ) {
+		ret = -1;
+	}
+	logMessage( LOG_INFO_LEVEL, "CRUD : exported %d files to [%s] with %d writers.", files, dir, exporter.writers );
+	return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : import_crud
+// Description  : Load every regular file in a host directory into the CRUD
+//                file system.  The files are mapped rather than read, and
+//                handed to crud_create_files a group at a time.
+//
+// Inputs       : dir - the host directory
+// Outputs      : 0 if successful, -1 if failure
+
+int import_crud(char *dir) {
+
+	// Local variables
+	char *names[CRUD_SIM_IMPORT_GROUP], path[PATH_MAX];
+	void *maps[CRUD_SIM_IMPORT_GROUP];
+	uint32_t lengths[CRUD_SIM_IMPORT_GROUP];
+	struct timeval start, stop;
+	struct dirent *entry;
+	struct stat st;
+	int n = 0, fhandle, created, total = 0, ret = 0;
+	DIR *dhandle;
+
+	if ( (dhandle = opendir(dir)) == NULL ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD: import opendir() failed [%s], error=%s", dir, strerror(errno) );
+		return( -1 );
+	}
+	if ( crud_mount() ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD : import failed on crud interface." );
+		closedir( dhandle );
+		return( -1 );
+	}
+	gettimeofday( &start, NULL );
+
+	while ( (entry = readdir(dhandle)) != NULL ) {
+
+		// Map each regular file that fits in an object
+		snprintf( path, sizeof(path), "%s/%s", dir, entry->d_name );
+		if ( (stat(path, &st) != 0) || !S_ISREG(st.st_mode) ) {
+			continue;
+		}
+		if ( st.st_size > CRUD_MAX_OBJECT_SIZE ) {
+			logMessage( LOG_WARNING_LEVEL, "CRUD : not loading [%s], %ld bytes is too big.", path, st.st_size );
+			continue;
+		}
+		if ( (fhandle = open(path, O_RDONLY)) == -1 ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD: import open() failed [%s], error=%s", path, strerror(errno) );
+			ret = -1;
+			continue;
+		}
+		maps[n] = NULL;
+		if ( st.st_size > 0 ) {
+			maps[n] = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fhandle, 0 );
+			if ( maps[n] == MAP_FAILED ) {
+				logMessage( LOG_ERROR_LEVEL, "CRUD: import mmap() failed [%s], error=%s", path, strerror(errno) );
+				close( fhandle );
+				ret = -1;
+				continue;
+			}
+			madvise( maps[n], st.st_size, MADV_SEQUENTIAL );
+		}
+		close( fhandle );
+		names[n] = strdup( entry->d_name );
+		lengths[n++] = st.st_size;
+
+		// Hand over a full group
+		if ( n == CRUD_SIM_IMPORT_GROUP ) {
+			if ( (created = import_group(names, maps, lengths, n)) < n ) {
+				ret = -1;
+			}
+			total += (created > 0) ? created : 0;
+			n = 0;
+		}
+	}
+	if ( n > 0 ) {
+		if ( (created = import_group(names, maps, lengths, n)) < n ) {
+			ret = -1;
+		}
+		total += (created > 0) ? created : 0;
+	}
+	closedir( dhandle );
+
+	if ( crud_unmount() ) {
+		ret = -1;
+	}
+	gettimeofday( &stop, NULL );
+	logMessage( LOG_INFO_LEVEL, "CRUD : loaded %d files from [%s] in %ld usec.", total, dir, compareTimes(&start, &stop) );
+	return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : import_group
+// Description  : Create a group of mapped files in CRUD, then unmap them
+//
+// Inputs       : names - the file names (freed here)
+//                maps - the mapped contents (unmapped here)
+//                lengths - the file sizes
+//                count - the number of files
+// Outputs      : the number of files created, -1 if failure
+
+int import_group(char **names, void **maps, uint32_t *lengths, int count) {
+
+	// Local variables
+	int created, i;
+
+	created = crud_create_files( count, names, maps, lengths );
+	for ( i = 0; i < count; i++ ) {
+		if ( maps[i] != NULL ) {
+			munmap( maps[i], lengths[i] );
+		}
+		free( names[i] );
+	}
+	return( created );
 }
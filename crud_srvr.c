@@ -0,0 +1,151 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File          : crud_srvr.c
+//  Description   : This is the main program for the local CRUD server, a
+//                  stand-in for the reference crud_server binary.
+//
+//  Author        : Xuejian Zhou
+//  Last Modified : Mon Oct 19 2026
+//
+
+// Include Files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Project Includes
+#include <crud_network.h>
+#include <crud_metrics.h>
+#include <cmpsc311_log.h>
+#include <cmpsc311_util.h>
+
+// Defines
+#define CRUD_SRVR_ARGUMENTS "hvdul:p:s:m:M:"
+#define USAGE \
+	"USAGE: crudsrvr [-h] [-v] [-d] [-u] [-l <logfile>] [-p <port>] [-s <seed>] [-m <sec>] [-M <file>]\n" \
+	"\n" \
+	"where:\n" \
+	"    -h - help mode (display this message)\n" \
+	"    -v - verbose output\n" \
+	"    -d - save the store deduplicated (smaller, but the reference server cannot load it)\n" \
+	"    -u - run the store unit tests instead of the server\n" \
+	"    -l - write log messages to the filename <logfile>\n" \
+	"    -p - port number of server to connect to.\n" \
+	"    -s - seed for the random values (unit tests), to repeat a run\n" \
+	"    -m - log the runtime counters every <sec> seconds (and at exit)\n" \
+	"    -M - write the runtime counters to <file> in Prometheus text format\n" \
+	"\n" \
+
+//
+// Global Data
+int            crud_network_shutdown = 0;    // Flag indicating shutdown
+unsigned char *crud_network_address = NULL;  // Address of CRUD server (unused)
+unsigned short crud_network_port = 0;        // Port of CRUD server
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : main
+// Description  : The main function for the local CRUD server
+//
+// Inputs       : argc - the number of command line parameters
+//                argv - the parameters
+// Outputs      : 0 if successful, -1 if failure
+
+int main( int argc, char *argv[] ) {
+
+	// Local variables
+	int ch, verbose = 0, unit_tests = 0, log_initialized = 0, stats = 0, ret = 0;
+	uint32_t stats_period = 0;
+	uint64_t seed;
+	char *stats_file = NULL;
+
+	// Process the command line parameters
+	while ((ch = getopt(argc, argv, CRUD_SRVR_ARGUMENTS)) != -1) {
+
+		switch (ch) {
+		case 'h': // Help, print usage
+			fprintf( stderr, USAGE );
+			return( -1 );
+
+		case 'v': // Verbose Flag
+			verbose = 1;
+			break;
+
+		case 'd': // Deduplicated store file
+			crud_set_store_compatible( 0 );
+			break;
+
+		case 'u': // Unit Tests Flag
+			unit_tests = 1;
+			break;
+
+		case 'l': // Set the log filename
+			initializeLogWithFilename( optarg );
+			log_initialized = 1;
+			break;
+
+		case 'p': // Set the network port number
+			if ( sscanf(optarg, "%hu", &crud_network_port) != 1 ) {
+				logMessage( LOG_ERROR_LEVEL, "Bad  port number [%s]", optarg );
+				return(-1);
+			}
+			break;
+
+		case 's': // Seed the random values
+			if ( sscanf(optarg, "%lu", &seed) != 1 ) {
+				logMessage( LOG_ERROR_LEVEL, "Bad  random seed [%s]", optarg );
+				return(-1);
+			}
+			setRandomSeed( seed );
+			break;
+
+		case 'm': // Dump the counters periodically
+			if ( sscanf(optarg, "%u", &stats_period) != 1 ) {
+				logMessage( LOG_ERROR_LEVEL, "Bad  metrics period [%s]", optarg );
+				return(-1);
+			}
+			stats = 1;
+			break;
+
+		case 'M': // Dump the counters to a Prometheus file
+			stats_file = optarg;
+			stats = 1;
+			break;
+
+		default:  // Default (unknown)
+			fprintf( stderr, "Unknown command line option (%c), aborting.\n", ch );
+			return( -1 );
+		}
+	}
+
+	// Setup the log as needed
+	if ( ! log_initialized ) {
+		initializeLogWithFilehandle( CMPSC311_LOG_STDERR );
+	}
+	if ( verbose ) {
+		enableLogLevels( LOG_INFO_LEVEL );
+	}
+
+	// Run the unit tests or the server
+	if ( unit_tests ) {
+		logMessage( LOG_OUTPUT_LEVEL, "CRUD store unit tests random seed %lu (-s to repeat)", getRandomSeed() );
+		if ( crud_compress_unit_test() || crud_metrics_unit_test() || crud_unit_test() ) {
+			logMessage( LOG_ERROR_LEVEL, "CRUD store unit tests failed.\n\n" );
+			return( -1 );
+		}
+		logMessage( LOG_OUTPUT_LEVEL, "CRUD store unit tests completed successfully.\n\n" );
+		return( 0 );
+	}
+	if ( stats && crud_stats_start(stats_period, stats_file) ) {
+		return( -1 );
+	}
+	if ( crud_server() ) {
+		logMessage( LOG_ERROR_LEVEL, "CRUD server failed.\n\n" );
+		ret = -1;
+	}
+	if ( stats ) {
+		crud_stats_stop();
+	}
+	return( ret );
+}
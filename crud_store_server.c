@@ -0,0 +1,291 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File          : crud_store_server.c
+//  Description   : This is the server side of the CRUD communication protocol.
+//                  It accepts one client connection at a time and runs each
+//                  request against the local object store (crud_driver.c).
+//
+//  Author        : Xuejian Zhou
+//  Last Modified : Mon Oct 19 2026
+//
+
+// Include Files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+// Project Include Files
+#include <crud_network.h>
+#include <crud_request.h>
+#include <crud_compress.h>
+#include <crud_metrics.h>
+#include <cmpsc311_log.h>
+#include <cmpsc311_util.h>
+
+// Defines
+#define CRUD_STORE_FILENAME "crud_content.crd"
+
+// Functional prototypes
+int crud_server_handle_connection(int sock, char *buf, char *packed);
+int crud_read_bytes(int sock, void *buf, uint32_t len);
+int crud_send_bytes(int sock, void *buf, uint32_t len);
+void crud_signal_handler(int sig);
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_server
+// Description  : This is the main loop of the server, it loads the store,
+//                then serves client connections until shutdown.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_server(void) {
+
+	// Local variables
+	int server, client, optval = 1;
+	struct sockaddr_in saddr, caddr;
+	socklen_t clen;
+	struct sigaction action;
+	char *buf, *packed;
+
+	// Load the old store contents if there are any
+	if (access(CRUD_STORE_FILENAME, F_OK) == 0) {
+		if (crud_load_store(CRUD_STORE_FILENAME)) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD: initialization of object storage failed.");
+			return(-1);
+		}
+	}
+	// Catch SIGINT without restarting accept() so the loop sees the shutdown
+	memset(&action, 0x0, sizeof(action));
+	action.sa_handler = crud_signal_handler;
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	// Create, bind and listen on the server socket
+	saddr.sin_family = AF_INET;
+	saddr.sin_port = htons(crud_network_port ? crud_network_port : CRUD_DEFAULT_PORT);
+	saddr.sin_addr.s_addr = htonl(INADDR_ANY);
+	if ((server = socket(PF_INET, SOCK_STREAM, 0)) == -1) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD socket() create failed : [%s]", strerror(errno));
+		return(-1);
+	}
+	if (setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval)) != 0) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD set socket option create failed : [%s]", strerror(errno));
+		return(-1);
+	}
+	if (bind(server, (struct sockaddr *)&saddr, sizeof(saddr)) == -1) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD bind() create failed : [%s]", strerror(errno));
+		return(-1);
+	}
+	if (listen(server, CRUD_MAX_BACKLOG) == -1) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD listen() create failed : [%s]", strerror(errno));
+		return(-1);
+	}
+
+	// Serve one connection at a time, the store is shared between them
+	buf = malloc(CRUD_MAX_OBJECT_SIZE);
+	packed = malloc(CRUD_MAX_OBJECT_SIZE);
+	while (!crud_network_shutdown) {
+		clen = sizeof(caddr);
+		if ((client = accept(server, (struct sockaddr *)&caddr, &clen)) == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			logMessage(LOG_ERROR_LEVEL, "CRUD server accept failued, aborting.");
+			break;
+		}
+		logMessage(LOG_INFO_LEVEL, "CRUD: client connected [%s]", inet_ntoa(caddr.sin_addr));
+		setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof(optval));
+		crud_server_handle_connection(client, buf, packed);
+		close(client);
+	}
+
+	// Save the store on the way out
+	free(buf);
+	free(packed);
+	close(server);
+	return(crud_save_store(CRUD_STORE_FILENAME));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_server_handle_connection
+// Description  : Serve the requests on one client connection until the client
+//                sends CRUD_CLOSE or goes away.
+//
+// Inputs       : sock - the client socket
+//                buf - the object sized buffer to move payloads through
+//                packed - an object sized buffer for compressed payloads
+// Outputs      : 0 if closed cleanly, -1 if failure
+
+int crud_server_handle_connection(int sock, char *buf, char *packed) {
+
+	// Local variables
+	CrudRequest request;
+	CrudResponse response;
+	CrudOID oid;
+	CRUD_REQUEST_TYPES req;
+	uint32_t length, rlength;
+	int32_t unpacked;
+	uint8_t flags, res, compress;
+	uint64_t offset, wire;
+
+	while (1) {
+
+		// Get the request header and pull it apart
+		if (crud_read_bytes(sock, &wire, sizeof(wire))) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD receive packet header failed : [%s]", strerror(errno));
+			return(-1);
+		}
+		request = ntohll64(wire);
+		deconstruct_crud_request(request, &oid, &req, &length, &flags, &res);
+		if ((req >= CRUD_MAXVAL) || (length > CRUD_MAX_OBJECT_SIZE)) {
+			logMessage(LOG_ERROR_LEVEL, "Send failure, bad CRUD opcode extract [%lx]", request);
+			return(-1);
+		}
+		logMessage(LOG_INFO_LEVEL, "Received CRUD request: %s, len=%d, oid=%d, flgs=%d",
+				CRUD_REQUEST_TYPE_LABLES[req], length, oid, flags);
+
+		// The compression flag is between us and the client, the store never sees it
+		compress = flags & CRUD_COMPRESS_FLAG;
+		request = CRUD_SET_FIELD(request, FLAGS, flags & ~CRUD_COMPRESS_FLAG);
+
+		// Get the rest of the packet: payload for CREATE/UPDATE, offset for ranged READ
+		if ((req == CRUD_CREATE) || (req == CRUD_UPDATE)) {
+			if (crud_read_bytes(sock, compress ? packed : buf, length)) {
+				logMessage(LOG_ERROR_LEVEL, "CRUD receive packet failed : [%s]", strerror(errno));
+				return(-1);
+			}
+			if (compress) {
+				if ((unpacked = crud_decompress(packed, length, buf, CRUD_MAX_OBJECT_SIZE)) == -1) {
+					logMessage(LOG_ERROR_LEVEL, "CRUD bad compressed payload [OID %u, %u bytes]", oid, length);
+					return(-1);
+				}
+				request = CRUD_SET_FIELD(request, LENGTH, unpacked);
+			}
+		}
+		if ((req == CRUD_READ) && (flags & CRUD_RANGE_FLAG)) {
+			if (crud_read_bytes(sock, &wire, sizeof(wire))) {
+				logMessage(LOG_ERROR_LEVEL, "CRUD receive packet failed : [%s]", strerror(errno));
+				return(-1);
+			}
+			offset = ntohll64(wire);
+			response = crud_bus_request_range(request, (uint32_t)offset, buf);
+		} else {
+			response = crud_bus_request(request, buf);
+		}
+
+		// Tell the client what we support when it connects
+		if (req == CRUD_INIT) {
+			response = CRUD_SET_FIELD(response, FLAGS, CRUD_RANGE_FLAG | CRUD_COMPRESS_FLAG);
+			response = CRUD_SET_FIELD(response, LENGTH, CRUD_FEATURE_CLONE);
+		}
+
+		// Compress the data of a good READ if the client asked and it is worth it
+		deconstruct_crud_request(response, &oid, &req, &rlength, &flags, &res);
+		if (compress && (req == CRUD_READ) && (res == 0) && (rlength >= CRUD_COMPRESS_THRESHOLD) &&
+			((length = crud_compress(buf, rlength, packed, rlength - 1)) > 0)) {
+			response = CRUD_SET_FIELD(response, LENGTH, length);
+			response = CRUD_SET_FIELD(response, FLAGS, flags | CRUD_COMPRESS_FLAG);
+			rlength = length;
+		} else {
+			compress = 0;
+		}
+
+		// Send the response header, then the data for a good READ
+		wire = htonll64(response);
+		if (crud_send_bytes(sock, &wire, sizeof(wire)) ||
+			((req == CRUD_READ) && (res == 0) && crud_send_bytes(sock, compress ? packed : buf, rlength))) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD send failed : [%s]", strerror(errno));
+			return(-1);
+		}
+
+		// The client is done, save the store so it survives the next run
+		if (req == CRUD_CLOSE) {
+			return(crud_save_store(CRUD_STORE_FILENAME));
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_read_bytes
+// Description  : Read exactly len bytes from the socket
+//
+// Inputs       : sock - the socket to read from
+//                buf - the place to put the bytes
+//                len - the number of bytes
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_read_bytes(int sock, void *buf, uint32_t len) {
+
+	ssize_t got;
+	uint32_t total = 0;
+
+	while (total < len) {
+		got = read(sock, (char *)buf + total, len - total);
+		if ((got == -1) && (errno == EINTR)) {
+			continue;
+		}
+		if (got <= 0) {
+			return(-1);
+		}
+		total += got;
+	}
+	crud_metric_add(CRUD_METRIC_BYTES_RECEIVED, len);
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_send_bytes
+// Description  : Write exactly len bytes to the socket
+//
+// Inputs       : sock - the socket to write to
+//                buf - the bytes to send
+//                len - the number of bytes
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_send_bytes(int sock, void *buf, uint32_t len) {
+
+	ssize_t sent;
+	uint32_t total = 0;
+
+	while (total < len) {
+		sent = write(sock, (char *)buf + total, len - total);
+		if ((sent == -1) && (errno == EINTR)) {
+			continue;
+		}
+		if (sent <= 0) {
+			return(-1);
+		}
+		total += sent;
+	}
+	crud_metric_add(CRUD_METRIC_BYTES_SENT, len);
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_signal_handler
+// Description  : Stop the server loop on SIGINT (the store is saved on exit)
+//
+// Inputs       : sig - the signal
+// Outputs      : none
+
+void crud_signal_handler(int sig) {
+	crud_network_shutdown = 1;
+}
@@ -0,0 +1,52 @@
+#ifndef CRUD_TRACE_INCLUDED
+#define CRUD_TRACE_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_trace.h
+//  Description    : This is the header file for the static trace points on
+//                   the hot paths (provider "crud").  When <sys/sdt.h> is
+//                   installed (systemtap-sdt-dev) each probe is a single nop
+//                   plus an ELF note, so it costs nothing until perf or
+//                   bpftrace attaches to it; otherwise (or with
+//                   -DCRUD_NO_PROBES) the probes compile away.
+//
+//                   Probes (see crud_trace.bt and crud_store.bt):
+//                     file_entry(op, fd, count)       crud_file_io public calls
+//                     file_return(op, fd, result)
+//                     bus_entry(type, oid, length, flags)   client bus request
+//                     bus_return(type, oid, length, result)
+//                     bus_retry(type, oid, attempt)
+//                     batch_entry(count)              client request batch
+//                     batch_return(count, result)
+//                     store_entry(type, oid, length, flags) local server store
+//                     store_return(type, oid, length, result)
+//
+//                   op is a constant string ("read", "write" ...), type a
+//                   CRUD_REQUEST_TYPES value; count is the number of ranges
+//                   for readv/writev and fd is -1 for open/sync.
+//
+//  Author         : Xuejian Zhou
+//  Last Modified  : Mon Oct 19 2026
+//
+
+#if !defined(CRUD_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define CRUD_PROBES_ENABLED 1
+#endif
+#endif
+
+#ifdef CRUD_PROBES_ENABLED
+#define CRUD_PROBE1(name, a)          DTRACE_PROBE1(crud, name, a)
+#define CRUD_PROBE2(name, a, b)       DTRACE_PROBE2(crud, name, a, b)
+#define CRUD_PROBE3(name, a, b, c)    DTRACE_PROBE3(crud, name, a, b, c)
+#define CRUD_PROBE4(name, a, b, c, d) DTRACE_PROBE4(crud, name, a, b, c, d)
+#else
+#define CRUD_PROBE1(name, a)          do { } while (0)
+#define CRUD_PROBE2(name, a, b)       do { } while (0)
+#define CRUD_PROBE3(name, a, b, c)    do { } while (0)
+#define CRUD_PROBE4(name, a, b, c, d) do { } while (0)
+#endif
+
+#endif
@@ -9,9 +9,34 @@
 //
 
 // Includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
 
 // Project includes
 #include <crud_driver.h>
+#include <crud_request.h>
+#include <cmpsc311_log.h>
+#include <cmpsc311_util.h>
+
+// Defines
+#define CRUD_REQUEST_TEST_COUNT 1024
+#define CRUD_REQUEST_BENCH_ROUNDS 4096
+
+//
+// Global data
+
+// Printable names of the request types and flags
+const char *CRUD_REQUEST_TYPE_LABLES[CRUD_MAXVAL] = {
+	"CRUD_INIT", "CRUD_FORMAT", "CRUD_CREATE", "CRUD_READ",
+	"CRUD_UPDATE", "CRUD_DELETE", "CRUD_CLOSE", "CRUD_UNKNOWN",
+	"CRUD_CLONE"
+};
+const char *CRUD_FLAG_TYPE_LABLES[CRUD_FLAGMAX] = {
+	"CRUD_NULL_FLAG", "CRUD_PRIORITY_OBJECT", "CRUD_RANGE_FLAG",
+	"CRUD_PRIORITY_OBJECT|CRUD_RANGE_FLAG", "CRUD_COMPRESS_FLAG"
+};
 
 // Functions
 
@@ -32,15 +57,7 @@ CrudRequest construct_crud_request(CrudOID oid, CRUD_REQUEST_TYPES req,
 		uint32_t length, uint8_t flags, uint8_t res) {
 
 	// Build up the request fields
-	CrudRequest request = 0;
-	request = ((uint64_t) oid) << 32;
-	request |= req << 28;
-	request |= length << 4;
-	request |= flags << 1;
-	request |= res;
-
-	// Return successfully
-	return (request);
+	return (crud_request_encode(oid, req, length, flags, res));
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -61,14 +78,157 @@ int deconstruct_crud_request(CrudRequest request, CrudOID *oid,
 		uint8_t *res) {
 
 	// Pull out the fields
-	uint32_t bottom;
-	*oid = request >> 32;
-	bottom = (uint32_t) request & 0xffffffff;
-	*req = bottom >> 28;
-	*length = (bottom << 4) >> 8;
-	*flags = (bottom & 0xe) >> 1;
-	*res = (bottom & 1);
+	*oid = crud_request_oid(request);
+	*req = crud_request_type(request);
+	*length = crud_request_length(request);
+	*flags = crud_request_flags(request);
+	*res = crud_request_result(request);
 
 	// Return successfully
 	return (0);
 }
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_parse_workload_line
+// Description  : Split a line of a simulator workload file into its fields
+//
+// Inputs       : line - the line (the text field points into it)
+//                op - the place to put the fields
+// Outputs      : 0 if successful, -1 if the line does not parse
+
+int crud_parse_workload_line(char *line, CrudWorkloadLine *op) {
+
+	// Four fields, then the text after the separator
+	if (sscanf(line, "%s %s %d %d", op->fname, op->command, &op->len, &op->off) != 4) {
+		return (-1);
+	}
+	if ((op->text = strchr(line, ':')) == NULL) {
+		return (-1);
+	}
+	op->text++;
+	return (0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_workload_text
+// Description  : Copy out the data of a WRITE/WRITEAT line, the workload
+//                files write newlines as '*'
+//
+// Inputs       : op - the parsed line
+//                text - the place to put the data (len+1 bytes)
+// Outputs      : the number of bytes of data
+
+int32_t crud_workload_text(CrudWorkloadLine *op, char *text) {
+
+	int32_t i;
+
+	strncpy(text, op->text, op->len);
+	text[op->len] = 0x0;
+	for (i = 0; text[i] != 0x0; i++) {
+		if (text[i] == '*') {
+			text[i] = '\n';
+		}
+	}
+	return (op->len);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_request_unit_test
+// Description  : Check the request codec against the bit layout (the shifts
+//                the code used before it), then time the old shifts, the
+//                codec and the batch codec over the same requests.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int crud_request_unit_test(void) {
+
+	// Local variables
+	CrudRequestFields *fields, *back;
+	CrudRequest *requests, legacy;
+	struct timeval start, stop;
+	volatile uint64_t sink = 0;
+	long times[3];
+	int i, round;
+
+	fields = malloc(CRUD_REQUEST_TEST_COUNT * sizeof(CrudRequestFields));
+	back = malloc(CRUD_REQUEST_TEST_COUNT * sizeof(CrudRequestFields));
+	requests = malloc(CRUD_REQUEST_TEST_COUNT * sizeof(CrudRequest));
+
+	// Random fields, checked one at a time against the old shifts
+	for (i = 0; i < CRUD_REQUEST_TEST_COUNT; i++) {
+		fields[i].oid = getRandomValue(0, -1);
+		fields[i].req = getRandomValue(0, CRUD_MAXVAL - 1);
+		fields[i].length = getRandomValue(0, CRUD_MAX_OBJECT_SIZE);
+		fields[i].flags = getRandomValue(0, 7);
+		fields[i].res = getRandomValue(0, 1);
+		legacy = ((uint64_t)fields[i].oid << 32) | ((uint64_t)fields[i].req << 28) |
+				(fields[i].length << 4) | (fields[i].flags << 1) | fields[i].res;
+		requests[i] = crud_request_encode(fields[i].oid, fields[i].req, fields[i].length,
+				fields[i].flags, fields[i].res);
+		if ((requests[i] != legacy) || (crud_request_oid(legacy) != fields[i].oid) ||
+			(crud_request_type(legacy) != fields[i].req) || (crud_request_length(legacy) != fields[i].length) ||
+			(crud_request_flags(legacy) != fields[i].flags) || (crud_request_result(legacy) != fields[i].res) ||
+			(crud_request_length(legacy) != ((legacy << 36) >> 40))) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD request codec mismatch [%lx != %lx]", requests[i], legacy);
+			return(-1);
+		}
+	}
+
+	// The batch functions have to agree with the single ones
+	crud_request_encode_batch(fields, requests, CRUD_REQUEST_TEST_COUNT);
+	crud_request_decode_batch(requests, back, CRUD_REQUEST_TEST_COUNT);
+	for (i = 0; i < CRUD_REQUEST_TEST_COUNT; i++) {
+		if ((requests[i] != crud_request_encode(fields[i].oid, fields[i].req, fields[i].length,
+				fields[i].flags, fields[i].res)) || (back[i].oid != fields[i].oid) ||
+			(back[i].req != fields[i].req) || (back[i].length != fields[i].length) ||
+			(back[i].flags != fields[i].flags) || (back[i].res != fields[i].res)) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD request batch codec mismatch at %d", i);
+			return(-1);
+		}
+	}
+
+	// Time an encode and decode of every request: old shifts, codec, batch codec
+	gettimeofday(&start, NULL);
+	for (round = 0; round < CRUD_REQUEST_BENCH_ROUNDS; round++) {
+		for (i = 0; i < CRUD_REQUEST_TEST_COUNT; i++) {
+			legacy = ((uint64_t)fields[i].oid << 32) | ((uint64_t)fields[i].req << 28) |
+					(fields[i].length << 4) | (fields[i].flags << 1) | fields[i].res;
+			sink += (legacy >> 32) + ((legacy << 32) >> 60) + ((legacy << 36) >> 40) +
+					((legacy << 60) >> 61) + ((legacy << 63) >> 63);
+		}
+	}
+	gettimeofday(&stop, NULL);
+	times[0] = compareTimes(&start, &stop);
+	gettimeofday(&start, NULL);
+	for (round = 0; round < CRUD_REQUEST_BENCH_ROUNDS; round++) {
+		for (i = 0; i < CRUD_REQUEST_TEST_COUNT; i++) {
+			legacy = crud_request_encode(fields[i].oid, fields[i].req, fields[i].length,
+					fields[i].flags, fields[i].res);
+			sink += crud_request_oid(legacy) + crud_request_type(legacy) + crud_request_length(legacy) +
+					crud_request_flags(legacy) + crud_request_result(legacy);
+		}
+	}
+	gettimeofday(&stop, NULL);
+	times[1] = compareTimes(&start, &stop);
+	gettimeofday(&start, NULL);
+	for (round = 0; round < CRUD_REQUEST_BENCH_ROUNDS; round++) {
+		crud_request_encode_batch(fields, requests, CRUD_REQUEST_TEST_COUNT);
+		crud_request_decode_batch(requests, back, CRUD_REQUEST_TEST_COUNT);
+		sink += back[round % CRUD_REQUEST_TEST_COUNT].length;
+	}
+	gettimeofday(&stop, NULL);
+	times[2] = compareTimes(&start, &stop);
+
+	// Log the results and return
+	logMessage(LOG_INFO_LEVEL, "CRUD request codec: %d requests in usec, shifts %ld, codec %ld, batch %ld [%lx]",
+			CRUD_REQUEST_TEST_COUNT * CRUD_REQUEST_BENCH_ROUNDS, times[0], times[1], times[2], sink);
+	free(fields);
+	free(back);
+	free(requests);
+	logMessage(LOG_INFO_LEVEL, "CRUD request codec unit test successful.");
+	return(0);
+}